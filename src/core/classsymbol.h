@@ -27,6 +27,7 @@ class ClassSymbol : public Symbol
 
 protected:
     friend class Symbol;
+    friend class TreeSitterHelper;
     ClassSymbol(QObject *parent, const QueryMatch &match, Kind kind);
 
     // mutable for lazy initialization
@@ -16,6 +16,7 @@
 #include "project.h"
 #include "querymatch.h"
 #include "rangemark.h"
+#include "settings.h"
 #include "symbol.h"
 #include "treesitter/predicates.h"
 #include "utils/log.h"
@@ -23,11 +24,16 @@
 
 #include <QFile>
 #include <QJSEngine>
+#include <QJsonDocument>
 #include <QMap>
 #include <QPlainTextEdit>
+#include <QPointer>
 #include <QTextBlock>
 #include <QTextDocument>
 #include <QTextStream>
+#include <QTimer>
+#include <QtQml/private/qjsvalue_p.h>
+#include <QtQml/private/qv4engine_p.h>
 #include <algorithm>
 #include <kdalgorithms.h>
 #include <memory>
@@ -54,9 +60,19 @@ CodeDocument::~CodeDocument() = default;
 
 CodeDocument::CodeDocument(Type type, QObject *parent)
     : TextDocument(type, parent)
+    , m_textTracker(std::make_unique<TextChangeTracker>(this))
     , m_treeSitterHelper(std::make_unique<TreeSitterHelper>(this))
 {
-    connect(textEdit()->document(), &QTextDocument::contentsChange, this, &CodeDocument::changeContent);
+    connect(document(), &QTextDocument::contentsChange, this, &CodeDocument::changeContent);
+    // Reloading the document doesn't notify about the changes, start again from scratch.
+    connect(this, &Document::fileUpdated, this, [this]() {
+        m_textTracker->reset();
+        // The snapshot shares the text of the tracker, see snapshotText
+        resetSnapshot();
+        m_treeSitterHelper->clear();
+        if (m_lspClient)
+            changeContentLsp({});
+    });
 }
 
 void CodeDocument::setLspClient(Lsp::Client *client)
@@ -78,7 +94,7 @@ bool CodeDocument::hasLspClient() const
  */
 Symbol *CodeDocument::currentSymbol(const std::function<bool(const Symbol &)> &filterFunc) const
 {
-    const int pos = textEdit()->textCursor().position();
+    const int pos = textCursor().position();
 
     const auto symbolList = symbols();
     for (auto symbol : symbolList | std::views::reverse) {
@@ -161,7 +177,7 @@ NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Transforms, patterns);
 const Core::Symbol *CodeDocument::symbolUnderCursor() const
 {
     const auto containsCursor = [this](const Core::Symbol *symbol) {
-        return symbol->selectionRange().contains(textEdit()->textCursor().position());
+        return symbol->selectionRange().contains(textCursor().position());
     };
 
     const auto symbols = this->symbols();
@@ -181,7 +197,7 @@ const Core::Symbol *CodeDocument::symbolUnderCursor() const
  */
 QString CodeDocument::hover() const
 {
-    return hover(textEdit()->textCursor().position());
+    return hover(textCursor().position());
 }
 
 QString CodeDocument::hover(int position, std::function<void(const QString &)> asyncCallback /*  = {} */) const
@@ -293,7 +309,7 @@ Document *CodeDocument::followSymbol()
     // Set the cursor position to the beginning of any selected text.
     // That way, calling followSymbol twice in a row causes Clangd
     // to switch between declaration and definition.
-    auto cursor = textEdit()->textCursor();
+    auto cursor = textCursor();
     return followSymbol(cursor.selectionStart());
 }
 
@@ -303,7 +319,7 @@ Document *CodeDocument::followSymbol()
 // - Go to the definition, if the symbol under cursor is a declaration
 Document *CodeDocument::followSymbol(int pos)
 {
-    auto cursor = textEdit()->textCursor();
+    auto cursor = textCursor();
     cursor.setPosition(pos);
 
     Lsp::DeclarationParams params;
@@ -364,7 +380,7 @@ Document *CodeDocument::switchDeclarationDefinition()
     if (!checkClient())
         return {};
 
-    auto cursor = textEdit()->textCursor();
+    auto cursor = textCursor();
     auto symbolList = symbols();
 
     auto currentFunction = kdalgorithms::find_if(symbolList, [&cursor](const auto &symbol) {
@@ -591,13 +607,27 @@ Symbol *CodeDocument::findSymbol(const QString &name, int options) const
 
 void CodeDocument::didOpen()
 {
+    // The document is loaded without notifying the changes, so the text needs to be updated.
+    m_textTracker->reset();
+    resetSnapshot();
+    m_treeSitterHelper->clear();
+
+    openLspDocument();
+}
+
+void CodeDocument::openLspDocument() const
+{
+    m_lspReleased = false;
     if (!m_lspClient)
         return;
 
+    // The whole text is sent below, no need to send the previous changes.
+    m_lspChanges.clear();
+
     Lsp::DidOpenTextDocumentParams params;
     params.textDocument.uri = toUri();
     params.textDocument.version = revision();
-    params.textDocument.text = textEdit()->toPlainText().toStdString();
+    params.textDocument.text = document()->toPlainText().toStdString();
     params.textDocument.languageId = m_lspClient->languageId();
 
     m_lspClient->didOpen(std::move(params));
@@ -605,17 +635,72 @@ void CodeDocument::didOpen()
 
 void CodeDocument::didClose()
 {
-    if (!m_lspClient)
+    // Already closed on the server when the memory was released.
+    if (!m_lspClient || m_lspReleased)
         return;
 
+    // The document is closed, pending changes are not relevant anymore.
+    m_lspChanges.clear();
+
     Lsp::DidCloseTextDocumentParams params;
     params.textDocument.uri = toUri();
 
     m_lspClient->didClose(std::move(params));
 }
 
+/**
+ * \brief Returns the text of the change tracker, so the snapshot doesn't hold another copy of the text
+ *
+ * The snapshot is reset before the tracker is updated, as the TextDocument connection to contentsChange is made
+ * first: the tracker text is then detached only if the previous snapshot is still used somewhere.
+ */
+QString CodeDocument::snapshotText() const
+{
+    return m_textTracker->text();
+}
+
+/**
+ * \brief Returns an estimate of the memory used by the document, including the syntax tree, in bytes
+ */
+qint64 CodeDocument::memoryUsage() const
+{
+    // Rough size of a Tree-sitter tree, per character of the text
+    constexpr qint64 TreeSizePerCharacter = 16;
+
+    qint64 size = TextDocument::memoryUsage();
+    // The cached snapshot usually shares the text of the tracker, see snapshotText
+    const auto snapshot = cachedSnapshot();
+    if (!snapshot || !m_textTracker->isShared(snapshot->text()))
+        size += m_textTracker->memoryUsage();
+    if (m_treeSitterHelper->hasSyntaxTree())
+        size += document()->characterCount() * TreeSizePerCharacter;
+    return size;
+}
+
+/**
+ * \brief Releases the syntax tree and closes the document on the language server
+ *
+ * Both are recreated on demand, symbols are kept as they may still be used.
+ */
+void CodeDocument::doReleaseMemory()
+{
+    TextDocument::doReleaseMemory();
+    m_textTracker->release();
+    m_treeSitterHelper->releaseTree();
+
+    if (m_lspClient && !m_lspReleased) {
+        didClose();
+        m_lspReleased = true;
+    }
+}
+
 Lsp::Client *CodeDocument::client() const
 {
+    // The document may have been closed on the server when releasing memory.
+    if (m_lspReleased)
+        openLspDocument();
+    // Make sure the server knows about the latest changes before sending any request.
+    sendLspChanges();
     return m_lspClient;
 }
 
@@ -629,16 +714,62 @@ std::unique_ptr<TreeSitterHelper> &CodeDocument::helper()
     return m_treeSitterHelper;
 }
 
+// The setting is checked for each query: it's cached, and updated when the settings change, instead of being looked up
+// in the settings every time.
+static bool isQueryProfilingEnabled()
+{
+    static QPointer<Settings> settings;
+    static bool enabled = false;
+    if (settings != Settings::instance()) {
+        settings = Settings::instance();
+        auto update = []() {
+            enabled = settings->value<bool>(Settings::TreeSitterProfileQueries);
+        };
+        update();
+        QObject::connect(settings, &Settings::settingsChanged, settings, update);
+        QObject::connect(settings, &Settings::settingsLoaded, settings, update);
+    }
+    return enabled;
+}
+
+// Profiling of the queries is opt-in, using the treesitter/profile_queries setting.
+// The profiles are logged, and appended as JSON lines to the treesitter/profile_file file if set.
+static void setQueryProfiling(treesitter::QueryCursor &cursor, const std::shared_ptr<treesitter::Query> &query)
+{
+    if (!isQueryProfilingEnabled())
+        return;
+
+    cursor.setProfiling([query](const treesitter::QueryProfile &profile) {
+        spdlog::info("CodeDocument::query - profile of {}\n{}", query->source(), profile.toString());
+
+        const auto fileName = Settings::instance()->value<QString>(Settings::TreeSitterProfileFile);
+        if (fileName.isEmpty())
+            return;
+        QFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+            spdlog::warn("CodeDocument::query - can't write the query profile to {}", fileName);
+            return;
+        }
+        auto json = profile.toJson();
+        json["query"] = query->source();
+        file.write(QJsonDocument(json).toJson(QJsonDocument::Compact));
+        file.write("\n");
+    });
+}
+
 std::optional<treesitter::QueryCursor> CodeDocument::createQueryCursor(const std::shared_ptr<treesitter::Query> &query)
 {
-    const auto &tree = m_treeSitterHelper->syntaxTree();
-    if (!tree || !query) {
+    const auto root = m_treeSitterHelper->queryRoot();
+    if (!root || !query) {
         return {};
     }
 
     treesitter::QueryCursor cursor;
     cursor.setProgressCallback(ScriptDialogItem::updateProgress);
-    cursor.execute(query, tree->rootNode(), std::make_unique<treesitter::Predicates>(text()));
+    cursor.setCancellationToken(ScriptDialogItem::cancellationToken());
+    setQueryProfiling(cursor, query);
+    // The text parsed is shared with the predicates, instead of copying the document text
+    cursor.execute(query, *root, std::make_unique<treesitter::Predicates>(m_textTracker->text()));
     return cursor;
 }
 
@@ -665,6 +796,8 @@ Core::QueryMatchList CodeDocument::query(const std::shared_ptr<treesitter::Query
     }
 
     auto matches = cursor->allRemainingMatches();
+    if (cursor->isCancelled())
+        spdlog::warn("{}: the query was cancelled, only {} matches found", FUNCTION_NAME, matches.size());
 
     return kdalgorithms::transformed<Core::QueryMatchList>(matches, [this](const treesitter::QueryMatch &match) {
         return QueryMatch(*this, match);
@@ -707,6 +840,74 @@ Core::QueryMatch CodeDocument::queryFirst(const QString &query)
     return this->queryFirst(m_treeSitterHelper->constructQuery(query));
 }
 
+/*!
+ * \qmlmethod int CodeDocument::queryEach(string query, function callback)
+ * Runs the given Tree-sitter `query` and calls `callback` with each match, as soon as it is found. Returns the number
+ * of matches passed to the callback.
+ *
+ * Contrary to `query`, the matches are not collected in an array first: this is faster and uses less memory for
+ * queries with a lot of matches, especially if only some of them are used. The query stops if the callback returns
+ * `false`, or if the callback changes the document. An exception thrown by the callback stops the query too, and is
+ * passed through.
+ *
+ * ``` javascript
+ * let count = 0;
+ * document.queryEach("(function_definition) @function", match => {
+ *     Message.log(match.get("function").text);
+ *     // Stop after 10 functions
+ *     return ++count < 10;
+ * });
+ * ```
+ * \sa CodeDocument::query
+ */
+int CodeDocument::queryEach(const QString &query, const QJSValue &callback)
+{
+    LOG(LOG_ARG("query", query));
+
+    auto engine = QJSValuePrivate::engine(&callback);
+    if (!callback.isCallable() || !engine) {
+        spdlog::error("{}: the callback is not a function", FUNCTION_NAME);
+        return 0;
+    }
+
+    auto cursor = createQueryCursor(m_treeSitterHelper->constructQuery(query));
+    if (!cursor.has_value())
+        return 0;
+
+    // The cursor runs on the current syntax tree, which is updated in place when the document changes, and released
+    // if the callback opens other documents over the memory budget: prevent the latter.
+    MemoryLock lock(this);
+    bool changed = false;
+    auto connection = connect(this, &TextDocument::textChanged, this, [&changed]() {
+        changed = true;
+    });
+
+    int count = 0;
+    QJSValue error;
+    while (auto match = cursor->nextMatch()) {
+        ++count;
+        const auto result = callback.call({engine->jsEngine()->toScriptValue(QueryMatch(*this, match.value()))});
+        if (result.isError()) {
+            error = result;
+            break;
+        }
+        if (changed) {
+            spdlog::warn("{}: the document was changed by the callback, the query is stopped", FUNCTION_NAME);
+            break;
+        }
+        if (result.isBool() && !result.toBool())
+            break;
+    }
+    disconnect(connection);
+    if (cursor->isCancelled())
+        spdlog::warn("{}: the query was cancelled", FUNCTION_NAME);
+    // Pass the exception through, like TextDocument::edit
+    if (error.isError())
+        engine->jsEngine()->throwError(error);
+
+    LOG_RETURN("count", count);
+}
+
 /**
  * \qmlmethod array<QueryMatch> CodeDocument::queryInRange(RangeMark range, string query)
  *
@@ -723,7 +924,24 @@ Core::QueryMatchList CodeDocument::queryInRange(const Core::RangeMark &range, co
         return {};
     }
 
-    const auto nodes = m_treeSitterHelper->nodesInRange(range);
+    const auto &tree = m_treeSitterHelper->syntaxTree();
+    if (!tree)
+        return {};
+
+    // Most of the time the range is the range of a node (e.g. a capture of a match), so the query only needs to run on
+    // the node covering the range. Otherwise, it runs on all the outermost nodes in the range.
+    // As for nodesInRange, the outermost node is used if several nodes have the same range.
+    auto node = m_treeSitterHelper->nodeCoveringRange(range.start(), range.end());
+    for (auto parent = node.parent(); !parent.isNull() && parent.startPosition() == node.startPosition()
+         && parent.endPosition() == node.endPosition();
+         parent = node.parent()) {
+        node = parent;
+    }
+    QList<treesitter::Node> nodes;
+    if (range.contains(node.startPosition()) && range.contains(node.endPosition() - 1))
+        nodes.push_back(node);
+    else
+        nodes = m_treeSitterHelper->nodesInRange(range);
 
     if (nodes.isEmpty()) {
         spdlog::warn("{}: No nodes in range", FUNCTION_NAME);
@@ -736,13 +954,20 @@ Core::QueryMatchList CodeDocument::queryInRange(const Core::RangeMark &range, co
         return {};
 
     treesitter::QueryCursor cursor;
+    cursor.setProgressCallback(ScriptDialogItem::updateProgress);
+    cursor.setCancellationToken(ScriptDialogItem::cancellationToken());
+    setQueryProfiling(cursor, tsQuery);
     Core::QueryMatchList matches;
-    for (const treesitter::Node &node : nodes) {
-        cursor.execute(tsQuery, node, std::make_unique<treesitter::Predicates>(text()));
+    for (const treesitter::Node &queryNode : std::as_const(nodes)) {
+        cursor.execute(tsQuery, queryNode, std::make_unique<treesitter::Predicates>(m_textTracker->text()));
         matches.append(kdalgorithms::transformed<QList<QueryMatch>>(cursor.allRemainingMatches(),
                                                                     [this](const treesitter::QueryMatch &match) {
                                                                         return QueryMatch(*this, match);
                                                                     }));
+        if (cursor.isCancelled()) {
+            spdlog::warn("{}: the query was cancelled, only {} matches found", FUNCTION_NAME, matches.size());
+            break;
+        }
     }
     return matches;
 }
@@ -754,81 +979,86 @@ int CodeDocument::revision() const
 
 bool CodeDocument::checkClient() const
 {
-    Q_ASSERT(textEdit());
-    if (!client()) {
+    Q_ASSERT(document());
+    if (!m_lspClient) {
         spdlog::error("{}: CodeDocument {} has no LSP client - API not available", FUNCTION_NAME, fileName());
         return false;
     }
     return true;
 }
 
-void CodeDocument::changeContentLsp(int position, int charsRemoved, int charsAdded)
+void CodeDocument::changeContentLsp(const std::optional<TextChange> &change)
 {
-    Q_UNUSED(position)
-    Q_UNUSED(charsRemoved)
-    Q_UNUSED(charsAdded)
-
-    // TODO: Keep copy of previous string around, so we can find the oldEndPosition.
-    // const auto document = textEdit()->document();
-    // const auto startblock = document->findBlock(position);
-    // spdlog::warn("{} - start point: {}, {}", FUNCTION_NAME, startblock.blockNumber(), position -
-    // startblock.position());
+    if (!checkClient()) {
+        return;
+    }
 
-    // const auto newEndPosition = position + charsAdded;
-    // const auto newEndBlock = document->findBlock(newEndPosition);
-    // spdlog::warn("{} - new end point: {}, {}", FUNCTION_NAME, newEndBlock.blockNumber(), newEndPosition -
-    // newEndBlock.position());
+    // The whole text will be sent when the document is reopened on the server.
+    if (m_lspReleased)
+        return;
 
-    // const auto plain = document->toPlainText();
-    // spdlog::warn("{} - added: {}", FUNCTION_NAME, plain.sliced(position, charsAdded));
+    const bool incremental = m_lspClient->canSendDocumentChanges(Lsp::TextDocumentSyncKind::Incremental);
+    if (!incremental && !m_lspClient->canSendDocumentChanges(Lsp::TextDocumentSyncKind::Full)) {
+        spdlog::error("{}: LSP server does not support Document changes!", FUNCTION_NAME);
+        return;
+    }
 
-    if (!checkClient()) {
+    if (m_lspChanges.empty()) {
+        QTimer::singleShot(0, this, &CodeDocument::sendLspChanges);
+    } else if (std::holds_alternative<Lsp::TextDocumentContentChangeEventFull>(m_lspChanges.front())) {
+        // The entire document is going to be sent anyway, which will include this change.
         return;
     }
 
-    if (client()->canSendDocumentChanges(Lsp::TextDocumentSyncKind::Full)
-        || client()->canSendDocumentChanges(Lsp::TextDocumentSyncKind::Incremental)) {
-        // TODO: We currently always send the entire document to the Language server, even
-        // if it supports incremental changes.
-        // Change this, so we also send incremental updates.
-        //
-        // This currently isn't implemented, as changeContent only gets called *after*
-        // the change has happened, but the LSP server needs the locations from *before* the change
-        // has happened, which can no longer be queried.
+    if (incremental && change) {
+        // The range is using the positions from *before* the change, as expected by the LSP server.
+        Lsp::TextDocumentContentChangeEventPartial event {};
+        event.range.start.line = change->start.line;
+        event.range.start.character = change->start.column;
+        event.range.end.line = change->oldEnd.line;
+        event.range.end.character = change->oldEnd.column;
+        event.text = change->addedText.toStdString();
+
+        m_lspChanges.emplace_back(std::move(event));
+    } else {
+        // The text is set when sending the changes, so all changes until then are part of it.
+        m_lspChanges.clear();
+        m_lspChanges.emplace_back(Lsp::TextDocumentContentChangeEventFull {});
+    }
+}
 
-        Lsp::VersionedTextDocumentIdentifier document;
-        document.version = ++m_revision;
-        document.uri = toUri();
+void CodeDocument::sendLspChanges() const
+{
+    if (m_lspChanges.empty() || !m_lspClient)
+        return;
 
-        std::vector<Lsp::TextDocumentContentChangeEvent> events;
+    auto events = std::move(m_lspChanges);
+    m_lspChanges.clear();
 
-        // Set text
-        Lsp::TextDocumentContentChangeEventFull event {};
-        event.text = text().toStdString();
+    if (auto *event = std::get_if<Lsp::TextDocumentContentChangeEventFull>(&events.front())) {
+        event->text = m_textTracker->text().toStdString();
+    }
 
-        events.emplace_back(std::move(event));
+    Lsp::VersionedTextDocumentIdentifier document;
+    document.version = ++m_revision;
+    document.uri = toUri();
 
-        Lsp::DidChangeTextDocumentParams params;
-        params.textDocument = document;
-        params.contentChanges = events;
+    Lsp::DidChangeTextDocumentParams params;
+    params.textDocument = document;
+    params.contentChanges = std::move(events);
 
-        client()->didChange(std::move(params));
-    } else {
-        spdlog::error("{}: LSP server does not support Document changes!", FUNCTION_NAME);
-    }
+    m_lspClient->didChange(std::move(params));
 }
 
-void CodeDocument::changeContentTreeSitter(int position, int charsRemoved, int charsAdded)
+void CodeDocument::changeContentTreeSitter(const std::optional<TextChange> &change)
 {
-    Q_UNUSED(position)
-    Q_UNUSED(charsRemoved)
-    Q_UNUSED(charsAdded)
-
     // Note: This invalidates all existing treesitter::Node instances of this tree!
     // Only use treesitter nodes as long as you're certain the document isn't edited!
-    // TODO: If we keep the old string around, we could implement incremental parsing here.
-    // If TreeSitter parsing ever becomes a performance bottleneck, this would be where to fix it.
-    m_treeSitterHelper->clear();
+    // The tree is edited here, and reparsed incrementally the next time it is needed.
+    if (change)
+        m_treeSitterHelper->edit(change.value());
+    else
+        m_treeSitterHelper->clear();
 }
 
 void CodeDocument::changeContent(int position, int charsRemoved, int charsAdded)
@@ -842,8 +1072,9 @@ void CodeDocument::changeContent(int position, int charsRemoved, int charsAdded)
     // As we're not quite done with updating the text at this point, we cannot redraw yet!
     LoggerDisabler disabler;
 
-    changeContentLsp(position, charsRemoved, charsAdded);
-    changeContentTreeSitter(position, charsRemoved, charsAdded);
+    const auto change = m_textTracker->update(position, charsRemoved, charsAdded);
+    changeContentLsp(change);
+    changeContentTreeSitter(change);
 }
 
 AstNode CodeDocument::astNodeAt(int pos)
@@ -18,6 +18,7 @@
 #include "treesitter/parser.h"
 #include "treesitter/query.h"
 
+#include <QJSValue>
 #include <functional>
 #include <memory>
 
@@ -34,6 +35,8 @@ class Query;
 namespace Core {
 
 class TreeSitterHelper;
+class TextChangeTracker;
+struct TextChange;
 struct RegexpTransform;
 class AstNode;
 
@@ -53,6 +56,7 @@ public:
 
     Q_INVOKABLE Core::QueryMatchList query(const QString &query);
     Q_INVOKABLE Core::QueryMatch queryFirst(const QString &query);
+    Q_INVOKABLE int queryEach(const QString &query, const QJSValue &callback);
     Q_INVOKABLE Core::QueryMatchList queryInRange(const Core::RangeMark &range, const QString &query);
 
     // This overload exists for improved performance. It's not user-facing API.
@@ -81,6 +85,8 @@ public:
 
     virtual QList<treesitter::Range> includedRanges() const;
 
+    qint64 memoryUsage() const override;
+
 public slots:
     void selectSymbol(const QString &name, int options = NoFindFlags);
 
@@ -94,6 +100,8 @@ protected:
 
     void didOpen() override;
     void didClose() override;
+    void doReleaseMemory() override;
+    QString snapshotText() const override;
 
     Lsp::Client *client() const;
     std::string toUri() const;
@@ -113,12 +121,21 @@ private:
     std::optional<treesitter::QueryCursor> createQueryCursor(const std::shared_ptr<treesitter::Query> &query);
 
     void changeContent(int position, int charsRemoved, int charsAdded);
-    void changeContentLsp(int position, int charsRemoved, int charsAdded);
-    void changeContentTreeSitter(int position, int charsRemoved, int charsAdded);
+    void changeContentLsp(const std::optional<TextChange> &change);
+    void changeContentTreeSitter(const std::optional<TextChange> &change);
+    void sendLspChanges() const;
+    void openLspDocument() const;
+
+    std::unique_ptr<TextChangeTracker> m_textTracker;
 
     // Language Server
     QPointer<Lsp::Client> m_lspClient;
-    int m_revision = 0;
+    // Changes are batched and sent in one didChange notification, either on the next event loop
+    // iteration or before the next request to the LSP server.
+    mutable std::vector<Lsp::TextDocumentContentChangeEvent> m_lspChanges;
+    mutable int m_revision = 0;
+    // The document has been closed on the server to save memory, and is reopened on the next request.
+    mutable bool m_lspReleased = false;
 
     // TreeSitter
     friend TreeSitterHelper;
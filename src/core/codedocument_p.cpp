@@ -9,15 +9,137 @@
 */
 
 #include "codedocument_p.h"
+#include "classsymbol.h"
 #include "codedocument.h"
 #include "treesitter/languages.h"
 #include "treesitter/tree_cursor.h"
 #include "utils/log.h"
 
+#include <QPlainTextEdit>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <algorithm>
 #include <kdalgorithms.h>
 
 namespace Core {
 
+// Same conversion as QTextDocument::toPlainText, used on the text of a QTextCursor selection.
+static QString toPlainText(QString text)
+{
+    for (auto &c : text) {
+        switch (c.unicode()) {
+        case 0xfdd0: // QTextBeginningOfFrame
+        case 0xfdd1: // QTextEndOfFrame
+        case QChar::ParagraphSeparator:
+        case QChar::LineSeparator:
+            c = u'\n';
+            break;
+        case QChar::Nbsp:
+            c = u' ';
+            break;
+        default:
+            break;
+        }
+    }
+    return text;
+}
+
+static TextChange::Point pointAt(const QTextDocument *document, int position)
+{
+    const auto block = document->findBlock(position);
+    return {.line = block.blockNumber(), .column = position - block.position()};
+}
+
+static treesitter::Point toTreeSitterPoint(const TextChange::Point &point)
+{
+    // Tree-sitter works with UTF-16, so columns are in bytes, not characters.
+    return {.row = static_cast<uint32_t>(point.line), .column = static_cast<uint32_t>(point.column * sizeof(QChar))};
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// TextChangeTracker
+///////////////////////////////////////////////////////////////////////////////
+TextChangeTracker::TextChangeTracker(CodeDocument *document)
+    : m_document(document)
+{
+}
+
+void TextChangeTracker::reset()
+{
+    m_text = m_document->document()->toPlainText();
+    m_released = false;
+}
+
+std::optional<TextChange> TextChangeTracker::update(int position, int charsRemoved, int charsAdded)
+{
+    // Without the previous text, the change can't be mapped.
+    if (m_released) {
+        reset();
+        return {};
+    }
+
+    const auto document = m_document->document();
+    // QTextDocument::characterCount includes the last paragraph separator, which is not part of the text.
+    const auto newSize = document->characterCount() - 1;
+
+    // QTextDocument may report changes including the last paragraph separator (e.g. when calling setPlainText).
+    // In that case, we can't map the change to the plain text.
+    if (position < 0 || position + charsRemoved > m_text.size()
+        || m_text.size() - charsRemoved + charsAdded != newSize) {
+        reset();
+        return {};
+    }
+
+    QTextCursor cursor(document);
+    cursor.setPosition(position);
+    cursor.setPosition(position + charsAdded, QTextCursor::KeepAnchor);
+
+    TextChange change {.position = position,
+                       .charsRemoved = charsRemoved,
+                       .charsAdded = charsAdded,
+                       .start = pointAt(document, position),
+                       .oldEnd = {},
+                       .newEnd = pointAt(document, position + charsAdded),
+                       .addedText = toPlainText(cursor.selectedText())};
+
+    change.oldEnd = change.start;
+    for (const auto &c : QStringView(m_text).sliced(position, charsRemoved)) {
+        if (c == u'\n') {
+            ++change.oldEnd.line;
+            change.oldEnd.column = 0;
+        } else {
+            ++change.oldEnd.column;
+        }
+    }
+
+    m_text.replace(position, charsRemoved, change.addedText);
+    return change;
+}
+
+void TextChangeTracker::release()
+{
+    m_text = {};
+    m_released = true;
+}
+
+const QString &TextChangeTracker::text()
+{
+    if (m_released)
+        reset();
+    return m_text;
+}
+
+bool TextChangeTracker::isShared(const QString &text) const
+{
+    return !m_released && !m_text.isEmpty() && m_text.constData() == text.constData();
+}
+
+qint64 TextChangeTracker::memoryUsage() const
+{
+    return m_text.size() * sizeof(QChar);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // TreeSitterHelper
 ///////////////////////////////////////////////////////////////////////////////
@@ -30,7 +152,67 @@ void TreeSitterHelper::clear()
 {
     m_tree = {};
     m_symbols.clear();
-    m_flags &= ~HasSymbols;
+    m_changedRanges.clear();
+    m_flags &= ~(HasSymbols | TreeEdited | SymbolsEdited);
+}
+
+void TreeSitterHelper::releaseTree()
+{
+    m_tree = {};
+    m_flags &= ~TreeEdited;
+
+    // Without the edited tree, the parts of the new tree with a different structure are unknown.
+    if (m_flags & SymbolsEdited) {
+        m_symbols.clear();
+        m_changedRanges.clear();
+        m_flags &= ~SymbolsEdited;
+    }
+}
+
+bool TreeSitterHelper::hasSyntaxTree() const
+{
+    return m_tree.has_value();
+}
+
+// Updates the current tree with the given change of the document, so the next call to syntaxTree()
+// can reparse the document incrementally, reusing the unchanged parts of the old tree.
+void TreeSitterHelper::edit(const TextChange &change)
+{
+    // No tree yet, the next parse will be a full parse anyway.
+    if (!m_tree) {
+        m_symbols.clear();
+        m_changedRanges.clear();
+        m_flags &= ~(HasSymbols | SymbolsEdited);
+        return;
+    }
+
+    // The symbols are kept, and updated incrementally the next time they are needed (see updateSymbols).
+    if (m_flags & (HasSymbols | SymbolsEdited)) {
+        const int removedEnd = change.position + change.charsRemoved;
+        const int addedEnd = change.position + change.charsAdded;
+        auto mapPosition = [&](int position, int insidePosition) {
+            if (position >= removedEnd)
+                return position + addedEnd - removedEnd;
+            return position > change.position ? insidePosition : position;
+        };
+        for (auto &range : m_changedRanges) {
+            range.start = mapPosition(range.start, change.position);
+            range.end = mapPosition(range.end, addedEnd);
+        }
+        addChangedRange(change.position, addedEnd);
+        m_flags = (m_flags & ~HasSymbols) | SymbolsEdited;
+    }
+
+    const treesitter::InputEdit edit {
+        .start_byte = static_cast<uint32_t>(change.position * sizeof(QChar)),
+        .old_end_byte = static_cast<uint32_t>((change.position + change.charsRemoved) * sizeof(QChar)),
+        .new_end_byte = static_cast<uint32_t>((change.position + change.charsAdded) * sizeof(QChar)),
+        .start_point = toTreeSitterPoint(change.start),
+        .old_end_point = toTreeSitterPoint(change.oldEnd),
+        .new_end_point = toTreeSitterPoint(change.newEnd),
+    };
+    m_tree->edit(edit);
+    m_flags |= TreeEdited;
 }
 
 treesitter::Parser &TreeSitterHelper::parser()
@@ -47,13 +229,28 @@ treesitter::Parser &TreeSitterHelper::parser()
 
 std::optional<treesitter::Tree> &TreeSitterHelper::syntaxTree()
 {
-    if (!m_tree) {
+    if (!m_tree || (m_flags & TreeEdited)) {
         auto &parser = this->parser();
         if (!parser.setIncludedRanges(m_document->includedRanges())) {
             spdlog::warn("{}: Unable to set the included ranges on the treesitter parser!", FUNCTION_NAME);
             parser.setIncludedRanges({});
         }
-        m_tree = parser.parseString(m_document->text());
+
+        // The text tracker always holds the current text of the document.
+        // If the old tree has been edited, pass it along to reparse incrementally.
+        const auto &text = m_document->m_textTracker->text();
+        auto tree = parser.parseString(text, m_tree ? &m_tree.value() : nullptr);
+        m_flags &= ~TreeEdited;
+
+        // The parts of the tree with a different structure may have different symbols, even if not edited.
+        if (tree && m_tree && (m_flags & SymbolsEdited)) {
+            for (const auto &range : m_tree->changedRanges(*tree))
+                addChangedRange(range.start_byte / sizeof(QChar), range.end_byte / sizeof(QChar));
+        }
+        m_tree = std::move(tree);
+        // The tree may have been released to save memory, see CodeDocument::doReleaseMemory
+        m_document->reacquireMemory();
+
         if (!m_tree) {
             spdlog::warn("{}: Failed to parse document {}!", FUNCTION_NAME, m_document->fileName());
         }
@@ -61,11 +258,22 @@ std::optional<treesitter::Tree> &TreeSitterHelper::syntaxTree()
     return m_tree;
 }
 
+std::optional<treesitter::Node> TreeSitterHelper::queryRoot()
+{
+    if (m_queryRoot)
+        return m_queryRoot;
+
+    const auto &tree = syntaxTree();
+    if (!tree)
+        return {};
+    return tree->rootNode();
+}
+
 std::shared_ptr<treesitter::Query> TreeSitterHelper::constructQuery(const QString &query)
 {
     std::shared_ptr<treesitter::Query> tsQuery;
     try {
-        tsQuery = std::make_shared<treesitter::Query>(parser().language(), query);
+        tsQuery = treesitter::QueryCache::instance().get(parser().language(), query);
     } catch (treesitter::Query::Error &error) {
         spdlog::error("{}: Failed to parse query `{}` error: {} at: {}", FUNCTION_NAME, query, error.description,
                       error.utf8_offset);
@@ -74,7 +282,7 @@ std::shared_ptr<treesitter::Query> TreeSitterHelper::constructQuery(const QStrin
     return tsQuery;
 }
 
-// `nodesInRange` returns only the outermost nodes that fit entirely in the given range.
+// `nodesInRange` returns only the outermost nodes that fit entirely in the given range, in document order.
 // The subsequent children of these outermost nodes are *not* returned, even though
 // they are also technically in the range!
 // This is used by queryInRange to find on which nodes to run the query on.
@@ -88,10 +296,6 @@ QList<treesitter::Node> TreeSitterHelper::nodesInRange(const RangeMark &range)
         return {};
     }
 
-    QList<treesitter::Node> nodesToVisit;
-    QList<treesitter::Node> nodesInRange;
-    nodesToVisit.emplace_back(tree->rootNode());
-
     auto compareToRange = [&range](const treesitter::Node &node) {
         if (range.contains(node.startPosition()) && range.contains(node.endPosition() - 1))
             return RangeComparison::Contains;
@@ -101,21 +305,27 @@ QList<treesitter::Node> TreeSitterHelper::nodesInRange(const RangeMark &range)
         return RangeComparison::Disjoint;
     };
 
-    // Note: This could be improved performance-wise using the first_child_for_byte
-    // functions on either TSNode, or TSTreeCursor.
-    // However, these functions aren't currently wrapped and would make the search a bit more complex.
-    while (!nodesToVisit.isEmpty()) {
-        auto node = nodesToVisit.takeLast();
-        switch (compareToRange(node)) {
-        case RangeComparison::Contains:
-            nodesInRange.emplace_back(node);
-            break;
-        case RangeComparison::Overlaps:
-            nodesToVisit.append(node.children());
+    // Depth-first traversal with a tree cursor, only descending into the nodes overlapping the range, directly to
+    // the first child ending after the start of the range.
+    QList<treesitter::Node> nodesInRange;
+    treesitter::TreeCursor cursor(tree->rootNode());
+    while (true) {
+        const auto node = cursor.currentNode();
+        // The next nodes are all after the range
+        if (static_cast<int>(node.startPosition()) > range.end())
             break;
-        default:
+
+        const auto comparison = compareToRange(node);
+        if (comparison == RangeComparison::Contains)
+            nodesInRange.emplace_back(node);
+        if (comparison == RangeComparison::Overlaps && cursor.gotoFirstChildForPosition(range.start()))
+            continue;
+
+        bool hasNext = cursor.gotoNextSibling();
+        while (!hasNext && cursor.gotoParent())
+            hasNext = cursor.gotoNextSibling();
+        if (!hasNext)
             break;
-        }
     }
 
     return nodesInRange;
@@ -146,24 +356,100 @@ treesitter::Node TreeSitterHelper::nodeCoveringRange(int start, int end)
 
 void TreeSitterHelper::assignSymbolContexts()
 {
-    auto contextForSymbol = [this](Symbol *symbol) {
-        auto surroundsSymbol = [&symbol](const Symbol *otherSymbol) {
-            return symbol != otherSymbol && otherSymbol->range().contains(symbol->range());
-        };
-        auto surroundingSymbols = kdalgorithms::filtered(m_symbols, surroundsSymbol);
-
-        kdalgorithms::sort_by(
-            surroundingSymbols,
-            [](const auto &symbol) {
-                return symbol->range().length();
-            },
-            kdalgorithms::descending);
-        return surroundingSymbols;
+    QList<Symbol *> contexts;
+    Core::assignSymbolContexts(
+        m_symbols,
+        [](const Symbol *symbol) {
+            return symbol->range().start();
+        },
+        [](const Symbol *symbol) {
+            return symbol->range().end();
+        },
+        [&](qsizetype index, const std::vector<qsizetype> &contextIndexes) {
+            contexts.clear();
+            for (auto contextIndex : contextIndexes)
+                contexts.push_back(m_symbols[contextIndex]);
+            m_symbols[index]->assignContext(contexts);
+        });
+}
+
+void TreeSitterHelper::addChangedRange(int start, int end)
+{
+    m_changedRanges.push_back({.start = start, .end = end});
+}
+
+// Updates the symbols after the document has been edited.
+// For each change, the symbols in the smallest node covering it are extracted again, by running the symbol queries on
+// this node only. The symbols surrounding the node are kept if the change is inside their body, otherwise their node
+// is used instead. All other symbols are kept as is, their ranges have been updated by the edits already.
+void TreeSitterHelper::updateSymbols()
+{
+    // Reparsing the document adds the ranges with a different structure to m_changedRanges.
+    const auto &tree = syntaxTree();
+    if (!tree || !(m_flags & SymbolsEdited)) {
+        m_symbols = querySymbols(m_document);
+        return;
+    }
+
+    const auto root = tree->rootNode();
+    QList<treesitter::Node> nodes;
+    for (const auto &range : std::as_const(m_changedRanges)) {
+        auto node = nodeCoveringRange(range.start, range.end);
+
+        auto surroundingSymbols = kdalgorithms::filtered(m_symbols, [&node](const Symbol *symbol) {
+            return symbol->range().start() <= static_cast<int>(node.startPosition())
+                && static_cast<int>(node.endPosition()) <= symbol->range().end();
+        });
+        kdalgorithms::sort_by(surroundingSymbols, [](const auto &symbol) {
+            return symbol->range().length();
+        });
+        for (const auto *symbol : std::as_const(surroundingSymbols)) {
+            const auto body = symbol->m_queryMatch.get("body");
+            if (body.isValid() && body.start() < range.start && range.end < body.end())
+                break;
+            node = nodeCoveringRange(symbol->range().start(), symbol->range().end());
+        }
+
+        if (node == root) {
+            m_symbols = querySymbols(m_document);
+            return;
+        }
+        nodes.push_back(node);
+    }
+
+    // Only keep the outermost nodes, nodes of a tree are either nested or disjoint.
+    std::ranges::sort(nodes, [](const treesitter::Node &left, const treesitter::Node &right) {
+        return left.startPosition() < right.startPosition()
+            || (left.startPosition() == right.startPosition() && left.endPosition() > right.endPosition());
+    });
+    QList<treesitter::Node> queryRoots;
+    for (const auto &node : std::as_const(nodes)) {
+        if (queryRoots.isEmpty() || node.startPosition() >= queryRoots.last().endPosition())
+            queryRoots.push_back(node);
+    }
+
+    auto isInQueryRoots = [&queryRoots](const Symbol *symbol) {
+        return kdalgorithms::any_of(queryRoots, [symbol](const treesitter::Node &node) {
+            return static_cast<int>(node.startPosition()) <= symbol->range().start()
+                && symbol->range().end() <= static_cast<int>(node.endPosition());
+        });
     };
+    QList<Symbol *> symbols;
+    for (auto *symbol : std::as_const(m_symbols)) {
+        if (isInQueryRoots(symbol))
+            continue;
+        // The members may have changed
+        if (auto *classSymbol = qobject_cast<ClassSymbol *>(symbol))
+            classSymbol->m_members.reset();
+        symbols.push_back(symbol);
+    }
 
-    for (const auto &symbol : m_symbols | std::views::reverse) {
-        symbol->assignContext(contextForSymbol(symbol));
+    for (const auto &node : std::as_const(queryRoots)) {
+        m_queryRoot = node;
+        symbols.append(querySymbols(m_document));
     }
+    m_queryRoot.reset();
+    m_symbols = std::move(symbols);
 }
 
 const QList<Core::Symbol *> &TreeSitterHelper::symbols()
@@ -171,9 +457,12 @@ const QList<Core::Symbol *> &TreeSitterHelper::symbols()
     if (m_flags & HasSymbols)
         return m_symbols;
 
-    m_flags |= HasSymbols;
-
-    m_symbols = querySymbols(m_document);
+    if (m_flags & SymbolsEdited)
+        updateSymbols();
+    else
+        m_symbols = querySymbols(m_document);
+    m_changedRanges.clear();
+    m_flags = (m_flags | HasSymbols) & ~SymbolsEdited;
 
     kdalgorithms::sort_by(m_symbols, [](const auto &symbol) {
         return symbol->range().start();
@@ -184,4 +473,28 @@ const QList<Core::Symbol *> &TreeSitterHelper::symbols()
     return m_symbols;
 }
 
+QList<Symbol *> querySymbols(CodeDocument *document, const QList<SymbolQuery> &queries,
+                             const std::function<Symbol::Kind(Symbol::Kind kind, const QueryMatch &match)> &symbolKind)
+{
+    auto toQuery = [](const SymbolQuery &symbolQuery) {
+        return symbolQuery.query;
+    };
+    const auto matches = document->query(kdalgorithms::transformed<QStringList>(queries, toQuery).join('\n'));
+
+    QList<Symbol *> symbols;
+    symbols.reserve(matches.size());
+    for (const auto &match : matches) {
+        const auto patternIndex = match.patternIndex();
+        if (patternIndex < 0 || patternIndex >= queries.size()) {
+            spdlog::error("{}: Symbol query with more patterns than queries", FUNCTION_NAME);
+            continue;
+        }
+        auto kind = queries.at(patternIndex).kind;
+        if (symbolKind)
+            kind = symbolKind(kind, match);
+        symbols.push_back(Symbol::makeSymbol(document, match, kind));
+    }
+    return symbols;
+}
+
 } // namespace Core
@@ -19,11 +19,67 @@
 #include "treesitter/tree.h"
 
 #include <QList>
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <vector>
 
 namespace Core {
 
 class CodeDocument;
 
+// A change of the document text, with the positions before and after the change.
+// Lines and columns are 0-based, columns are in UTF-16 code units (QChar), like in the LSP.
+struct TextChange
+{
+    struct Point
+    {
+        int line = 0;
+        int column = 0;
+    };
+
+    int position = 0;
+    int charsRemoved = 0;
+    int charsAdded = 0;
+
+    Point start;
+    Point oldEnd;
+    Point newEnd;
+
+    QString addedText;
+};
+
+// Keeps a copy of the text of the document, updated on every change.
+//
+// QTextDocument only notifies changes after they happened, but both Tree-sitter and the LSP need
+// the positions from *before* the change, which can only be computed from the previous text.
+class TextChangeTracker
+{
+public:
+    explicit TextChangeTracker(CodeDocument *document);
+
+    // Reset the copy to the current text of the document.
+    void reset();
+
+    // Update the copy with a change notified by QTextDocument::contentsChange.
+    // Returns an empty optional if the change can't be mapped to the previous text (e.g. on setPlainText), in
+    // which case the copy is reset.
+    std::optional<TextChange> update(int position, int charsRemoved, int charsAdded);
+
+    // Release the copy, it's recreated from the document text the next time it's needed.
+    void release();
+
+    const QString &text();
+    // Returns true if `text` shares the same buffer as the copy (e.g. the text snapshot of the document).
+    bool isShared(const QString &text) const;
+    qint64 memoryUsage() const;
+
+private:
+    CodeDocument *const m_document;
+    QString m_text;
+    bool m_released = false;
+};
+
 class TreeSitterHelper
 {
 public:
@@ -36,10 +92,17 @@ public:
     explicit TreeSitterHelper(CodeDocument *document);
 
     void clear();
+    void edit(const TextChange &change);
+    // Release the syntax tree, it's reparsed the next time it's needed. Symbols are kept.
+    void releaseTree();
+    bool hasSyntaxTree() const;
 
     treesitter::Parser &parser();
     std::optional<treesitter::Tree> &syntaxTree();
 
+    // Node the document queries are run on: the root node, or a subtree while updating the symbols.
+    std::optional<treesitter::Node> queryRoot();
+
     std::shared_ptr<treesitter::Query> constructQuery(const QString &query);
     QList<treesitter::Node> nodesInRange(const RangeMark &range);
     treesitter::Node nodeCoveringRange(int start, int end);
@@ -47,17 +110,96 @@ public:
     const QList<Core::Symbol *> &symbols();
 
 private:
+    void updateSymbols();
+    void addChangedRange(int start, int end);
     void assignSymbolContexts();
 
     enum Flags {
         HasSymbols = 0x01,
+        TreeEdited = 0x02,
+        // The symbols are outdated, but can be updated incrementally using m_changedRanges
+        SymbolsEdited = 0x04,
+    };
+
+    // Range of the text changed since the symbols were extracted, in characters
+    struct ChangedRange
+    {
+        int start;
+        int end;
     };
 
     CodeDocument *const m_document;
     std::optional<treesitter::Parser> m_parser;
     std::optional<treesitter::Tree> m_tree;
     QList<Core::Symbol *> m_symbols;
+    QList<ChangedRange> m_changedRanges;
+    std::optional<treesitter::Node> m_queryRoot;
     int m_flags = 0;
 };
 
+/**
+ * Query finding some of the symbols of a document, with the captures used by Symbol (`name`, `range` and
+ * `selectionRange`), and the kind of the symbols found.
+ * The query must be a single pattern (use an alternation for more), see querySymbols.
+ */
+struct SymbolQuery
+{
+    QString query;
+    Symbol::Kind kind;
+};
+
+/**
+ * Returns the symbols found by all the `queries` in `document`.
+ * The queries are combined into a single query, executed once: the syntax tree is traversed only once, and the pattern
+ * index of each match gives the query, and so the kind of the symbol. `symbolKind` can refine the kind of a symbol
+ * using its match.
+ */
+QList<Symbol *>
+querySymbols(CodeDocument *document, const QList<SymbolQuery> &queries,
+             const std::function<Symbol::Kind(Symbol::Kind kind, const QueryMatch &match)> &symbolKind = {});
+
+// Calls `assign(index, contexts)` for each of the `symbols`, with the indexes of the symbols surrounding it, from the
+// outermost one. Symbols with the same range surround each other.
+// The ranges, given by `start(symbol)` and `end(symbol)`, are either nested or disjoint, like the nodes of a syntax
+// tree: a single sweep over the symbols sorted by position, keeping a stack of the surrounding symbols, is enough.
+template <typename Symbols, typename Start, typename End, typename Assign>
+void assignSymbolContexts(const Symbols &symbols, Start start, End end, Assign assign)
+{
+    const auto sameRange = [&](qsizetype left, qsizetype right) {
+        return start(symbols[left]) == start(symbols[right]) && end(symbols[left]) == end(symbols[right]);
+    };
+
+    // Surrounding symbols first: by start position, then by end position descending
+    std::vector<qsizetype> order(symbols.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::stable_sort(order, [&](qsizetype left, qsizetype right) {
+        if (start(symbols[left]) != start(symbols[right]))
+            return start(symbols[left]) < start(symbols[right]);
+        return end(symbols[left]) > end(symbols[right]);
+    });
+
+    std::vector<qsizetype> stack;
+    std::vector<qsizetype> contexts;
+    for (size_t first = 0; first < order.size();) {
+        size_t last = first + 1;
+        while (last < order.size() && sameRange(order[first], order[last]))
+            ++last;
+
+        const auto symbolEnd = end(symbols[order[first]]);
+        while (!stack.empty() && end(symbols[stack.back()]) < symbolEnd)
+            stack.pop_back();
+
+        for (size_t i = first; i < last; ++i) {
+            contexts = stack;
+            for (size_t j = first; j < last; ++j) {
+                if (j != i)
+                    contexts.push_back(order[j]);
+            }
+            assign(order[i], contexts);
+        }
+        stack.insert(stack.end(), order.begin() + first, order.begin() + last);
+        first = last;
+    }
+}
+
 } // namespace Core
@@ -10,9 +10,93 @@
 
 #include "cppdocument_p.h"
 #include "cppdocument.h"
+#include "settings.h"
+#include "utils/log.h"
 
 namespace Core {
 
+std::optional<QRegularExpression> excludedMacrosRegex()
+{
+    auto macros = Settings::instance()->value<QStringList>(Settings::CppExcludedMacros);
+    if (macros.isEmpty()) {
+        return {};
+    }
+
+    QRegularExpression regex(macros.join("|"));
+    if (!regex.isValid()) {
+        spdlog::error("{}: Failed to create regex for excluded macros: {}", FUNCTION_NAME, regex.errorString());
+        return {};
+    }
+    return regex;
+}
+
+QList<treesitter::Range> includedRangesExcluding(const QString &text, const QRegularExpression &regex)
+{
+    QList<treesitter::Range> ranges;
+    treesitter::Point lastPoint {0, 0};
+    uint32_t lastByte = 0;
+
+    // Iterate over the lines the same way as over the blocks of a QTextDocument:
+    // the length of a line includes its line separator.
+    uint32_t lineNumber = 0;
+    qsizetype lineStart = 0;
+    qsizetype lineLength = 0;
+    while (true) {
+        const auto lineEnd = text.indexOf('\n', lineStart);
+        const auto line = QStringView(text).sliced(lineStart, (lineEnd == -1 ? text.size() : lineEnd) - lineStart);
+        lineLength = line.size() + 1;
+
+        QRegularExpressionMatch match;
+        auto index = line.indexOf(regex, 0, &match);
+
+        // Run this in a loop to support multiple macros on the same line.
+        while (index != -1) {
+            // We need to construct a range from the end of the last match to the start of the current match.
+            //
+            // Note that the ranges have an inclusive start and an exclusive end..
+            //
+            // Also Note that the column seems to be in bytes, not characters.
+            // This is why we multiply by sizeof(QChar) to get the correct column.
+            // At least that's what the TreeSitterInspector shows us.
+            auto endPoint =
+                treesitter::Point {.row = lineNumber, .column = static_cast<uint32_t>(index * sizeof(QChar))};
+            ranges.push_back({.start_point = lastPoint,
+                              .end_point = endPoint,
+                              .start_byte = lastByte,
+                              // No need to add - 1 here, the ranges are exclusive at the end.
+                              .end_byte = static_cast<uint32_t>((lineStart + index) * sizeof(QChar))});
+
+            auto matchLength = match.capturedLength();
+            lastByte = static_cast<uint32_t>((lineStart + index + matchLength) * sizeof(QChar));
+            lastPoint = {.row = lineNumber, .column = static_cast<uint32_t>((index + matchLength) * sizeof(QChar))};
+            if (lastPoint.column == static_cast<uint32_t>(lineLength)) {
+                ++lastPoint.row;
+                lastPoint.column = 0;
+            }
+
+            index = line.indexOf(regex, index + matchLength, &match);
+        }
+
+        if (lineEnd == -1)
+            break;
+        lineStart = lineEnd + 1;
+        ++lineNumber;
+    }
+
+    if (!ranges.isEmpty()) {
+        // Add the last range, up to the end of the document, but only if we have another range.
+        // Leaving the ranges empty will parse the entire document, so that's easiest.
+        auto endPoint =
+            treesitter::Point {.row = lineNumber, .column = static_cast<uint32_t>(lineLength * sizeof(QChar))};
+        ranges.push_back({.start_point = lastPoint,
+                          .end_point = endPoint,
+                          .start_byte = lastByte,
+                          .end_byte = static_cast<uint32_t>((text.size() + 1) * sizeof(QChar))});
+    }
+
+    return ranges;
+}
+
 bool IncludeHelper::Include::operator==(const Include &other) const
 {
     return name == other.name && scope == other.scope;
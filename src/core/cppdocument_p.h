@@ -10,8 +10,12 @@
 
 #pragma once
 
+#include "codedocument_p.h"
+#include "symbol.h"
+#include "treesitter/parser.h"
 #include "utils/json.h"
 
+#include <QRegularExpression>
 #include <map>
 #include <optional>
 #include <vector>
@@ -58,6 +62,25 @@ namespace Queries {
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(ToggleSectionSettings, tag, debug, return_values);
 
+/**
+ * Returns the queries finding all the symbols of a C++ file, shared by CppDocument and the project SymbolIndex.
+ * The kind of the functions found is refined using `cppFunctionKind`.
+ */
+const QList<SymbolQuery> &cppSymbolQueries();
+Symbol::Kind cppFunctionKind(bool hasReturnType, const QString &name);
+
+/**
+ * Returns the regular expression matching the macros excluded from the parsing (see Settings::CppExcludedMacros).
+ * Returns an empty optional if there are no such macros.
+ */
+std::optional<QRegularExpression> excludedMacrosRegex();
+
+/**
+ * Returns the ranges of `text` the parser should parse, skipping all matches of `regex`.
+ * Returns an empty list (parse the entire text) if nothing matches.
+ */
+QList<treesitter::Range> includedRangesExcluding(const QString &text, const QRegularExpression &regex);
+
 class IncludeHelper
 {
 public:
@@ -0,0 +1,423 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "directorywalker.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#ifdef Q_OS_UNIX
+#include <dirent.h>
+#include <sys/stat.h>
+#else
+#include <QDirIterator>
+#endif
+
+namespace Core {
+
+static QString joinPath(const QString &directory, const QString &name)
+{
+    return directory.isEmpty() ? name : directory + '/' + name;
+}
+
+// Convert a .gitignore glob into a regular expression, '*' and '?' don't match '/' but '**' does
+static QString globToRegularExpression(QStringView glob)
+{
+    QString result;
+    for (qsizetype i = 0; i < glob.size(); ++i) {
+        const QChar c = glob[i];
+        if (c == '*') {
+            if (i + 1 < glob.size() && glob[i + 1] == '*') {
+                ++i;
+                if (i + 1 < glob.size() && glob[i + 1] == '/') {
+                    ++i;
+                    result += "(?:.*/)?";
+                } else {
+                    result += ".*";
+                }
+            } else {
+                result += "[^/]*";
+            }
+        } else if (c == '?') {
+            result += "[^/]";
+        } else if (c == '[') {
+            const auto end = glob.indexOf(']', i + 1);
+            if (end == -1) {
+                result += "\\[";
+                continue;
+            }
+            auto set = glob.mid(i + 1, end - i - 1).toString();
+            if (set.startsWith('!'))
+                set[0] = '^';
+            result += '[' + set + ']';
+            i = end;
+        } else if (c == '\\' && i + 1 < glob.size()) {
+            result += QRegularExpression::escape(QString(glob[++i]));
+        } else {
+            result += QRegularExpression::escape(QString(c));
+        }
+    }
+    return result;
+}
+
+//=============================================================================
+// IgnoreRules
+//=============================================================================
+/**
+ * \brief Set of ignore patterns for one directory, chained to the patterns of its parent directories
+ */
+class IgnoreRules
+{
+public:
+    IgnoreRules(std::shared_ptr<const IgnoreRules> parent, QString base, const QStringList &patterns)
+        : m_parent(std::move(parent))
+        , m_base(std::move(base))
+    {
+        for (auto pattern : patterns) {
+            pattern = pattern.trimmed();
+            if (pattern.isEmpty() || pattern.startsWith('#'))
+                continue;
+
+            Rule rule;
+            if (pattern.startsWith('!')) {
+                rule.negated = true;
+                pattern.remove(0, 1);
+            }
+            if (pattern.endsWith('/')) {
+                rule.directoryOnly = true;
+                pattern.chop(1);
+            }
+            if (pattern.startsWith('/')) {
+                rule.anchored = true;
+                pattern.remove(0, 1);
+            } else {
+                rule.anchored = pattern.contains('/');
+            }
+            if (pattern.isEmpty())
+                continue;
+
+            rule.regex.setPattern(QRegularExpression::anchoredPattern(globToRegularExpression(pattern)));
+            rule.regex.optimize();
+            m_rules.push_back(std::move(rule));
+        }
+    }
+
+    bool isEmpty() const { return m_rules.empty(); }
+
+    // `relativePath` is relative to the root of the walk, `name` is the last part of it
+    bool isIgnored(const QString &relativePath, const QString &name, bool isDirectory) const
+    {
+        if (!m_rules.empty()) {
+            const auto pathFromBase = m_base.isEmpty() ? QStringView(relativePath)
+                                                       : QStringView(relativePath).mid(m_base.size() + 1);
+            // Last matching pattern wins
+            for (auto it = m_rules.crbegin(); it != m_rules.crend(); ++it) {
+                if (it->directoryOnly && !isDirectory)
+                    continue;
+                if (it->regex.matchView(it->anchored ? pathFromBase : QStringView(name)).hasMatch())
+                    return !it->negated;
+            }
+        }
+        return m_parent ? m_parent->isIgnored(relativePath, name, isDirectory) : false;
+    }
+
+private:
+    struct Rule
+    {
+        QRegularExpression regex;
+        bool negated = false;
+        bool directoryOnly = false;
+        bool anchored = false;
+    };
+
+    std::shared_ptr<const IgnoreRules> m_parent;
+    QString m_base;
+    std::vector<Rule> m_rules;
+};
+
+static QStringList readGitIgnore(const QString &path)
+{
+    QFile file(path + "/.gitignore");
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return {};
+
+    QStringList patterns;
+    QTextStream stream(&file);
+    while (!stream.atEnd())
+        patterns.push_back(stream.readLine());
+    return patterns;
+}
+
+//=============================================================================
+// DirectoryWalker
+//=============================================================================
+DirectoryWalker::DirectoryWalker(QString root, Options options)
+    : m_root(std::move(root))
+    , m_options(std::move(options))
+{
+    auto rules = std::make_shared<const IgnoreRules>(nullptr, QString(), m_options.excludes);
+    if (!rules->isEmpty())
+        m_rootRules = std::move(rules);
+
+    for (const auto &filter : m_options.nameFilters) {
+        m_nameFilters.emplace_back(QRegularExpression::wildcardToRegularExpression(filter),
+                                   QRegularExpression::CaseInsensitiveOption);
+        // Compile now, as the expressions are used by multiple threads
+        m_nameFilters.back().optimize();
+    }
+}
+
+DirectoryWalker::~DirectoryWalker() = default;
+
+const QString &DirectoryWalker::root() const
+{
+    return m_root;
+}
+
+/**
+ * \brief Returns the rules inherited by `relativePath` from its parent directories
+ */
+std::shared_ptr<const IgnoreRules> DirectoryWalker::rulesFor(const QString &relativePath) const
+{
+    auto rules = m_rootRules;
+    if (!m_options.useGitIgnore || relativePath.isEmpty())
+        return rules;
+
+    QString path;
+    const auto parts = relativePath.split('/');
+    for (const auto &part : parts) {
+        auto gitIgnore = std::make_shared<const IgnoreRules>(rules, path, readGitIgnore(absolutePath(path)));
+        if (!gitIgnore->isEmpty())
+            rules = std::move(gitIgnore);
+        path = joinPath(path, part);
+    }
+    return rules;
+}
+
+/**
+ * \brief Returns the content of `relativePath`, without any ignored files
+ *
+ * `rules` are the rules inherited from the parent directories, they are updated with the `.gitignore` file of this
+ * directory, if any.
+ */
+DirectoryWalker::Directory DirectoryWalker::listDirectory(const QString &relativePath,
+                                                          std::shared_ptr<const IgnoreRules> &rules) const
+{
+    const auto path = absolutePath(relativePath);
+    if (m_options.useGitIgnore) {
+        auto gitIgnore = std::make_shared<const IgnoreRules>(rules, relativePath, readGitIgnore(path));
+        if (!gitIgnore->isEmpty())
+            rules = std::move(gitIgnore);
+    }
+
+    Directory directory {.path = relativePath};
+    auto addEntry = [&](const QString &name, bool isDirectory) {
+        if (rules && rules->isIgnored(joinPath(relativePath, name), name, isDirectory))
+            return;
+        if (isDirectory) {
+            directory.directories.push_back(name);
+        } else if (m_nameFilters.empty() || std::ranges::any_of(m_nameFilters, [&name](const auto &regex) {
+                       return regex.match(name).hasMatch();
+                   })) {
+            directory.files.push_back(name);
+        }
+    };
+
+#ifdef Q_OS_UNIX
+    // Use the entry type from readdir when available, to avoid a stat call for each file
+    DIR *dir = opendir(QFile::encodeName(path).constData());
+    if (!dir)
+        return directory;
+    while (const auto *entry = readdir(dir)) {
+        if (entry->d_name[0] == '.')
+            continue;
+        bool isDirectory = false;
+        bool isFile = false;
+        switch (entry->d_type) {
+        case DT_DIR:
+            isDirectory = true;
+            break;
+        case DT_REG:
+            isFile = true;
+            break;
+        case DT_LNK:
+        case DT_UNKNOWN: {
+            // Follow links to files, but not to directories
+            struct stat st;
+            if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                break;
+            if (S_ISLNK(st.st_mode)) {
+                isFile = fstatat(dirfd(dir), entry->d_name, &st, 0) == 0 && S_ISREG(st.st_mode);
+            } else {
+                isDirectory = S_ISDIR(st.st_mode);
+                isFile = S_ISREG(st.st_mode);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        if (isDirectory || isFile)
+            addEntry(QFile::decodeName(entry->d_name), isDirectory);
+    }
+    closedir(dir);
+#else
+    QDirIterator it(path, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        it.next();
+        const auto fi = it.fileInfo();
+        if (fi.isDir()) {
+            if (!fi.isSymLink())
+                addEntry(fi.fileName(), true);
+        } else if (fi.isFile()) {
+            addEntry(fi.fileName(), false);
+        }
+    }
+#endif
+    return directory;
+}
+
+DirectoryWalker::Directory DirectoryWalker::list(const QString &relativePath) const
+{
+    auto rules = rulesFor(relativePath);
+    return listDirectory(relativePath, rules);
+}
+
+std::vector<DirectoryWalker::Directory> DirectoryWalker::walk(const QString &relativePath) const
+{
+    if (!m_options.recursive)
+        return {list(relativePath)};
+
+    auto rules = rulesFor(relativePath);
+    struct Task
+    {
+        QString path;
+        std::shared_ptr<const IgnoreRules> rules;
+    };
+    // Each worker has its own queue: it takes the last directory added to it, and steal the first one of another
+    // worker when its queue is empty.
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::vector<Directory> result;
+    };
+
+    const int threadCount = static_cast<int>(std::clamp(std::thread::hardware_concurrency(), 1u, 16u));
+    std::vector<Worker> workers(threadCount);
+    // Number of directories queued or being listed
+    std::atomic<int> pending = 1;
+    // Number of directories queued
+    std::atomic<int> queued = 1;
+    workers[0].tasks.push_back({relativePath, std::move(rules)});
+
+    // Idle workers wait for a directory to be queued, or for the walk to be done. The mutex is locked before notifying,
+    // so the notification can't be sent between the check of a waiting worker and its wait.
+    std::mutex waitMutex;
+    std::condition_variable wakeUp;
+    auto notifyAll = [&]() {
+        {
+            std::lock_guard lock(waitMutex);
+        }
+        wakeUp.notify_all();
+    };
+
+    auto takeTask = [&workers, &queued](int index) -> std::optional<Task> {
+        {
+            auto &worker = workers[index];
+            std::lock_guard lock(worker.mutex);
+            if (!worker.tasks.empty()) {
+                auto task = std::move(worker.tasks.back());
+                worker.tasks.pop_back();
+                --queued;
+                return task;
+            }
+        }
+        for (int i = 1; i < static_cast<int>(workers.size()); ++i) {
+            auto &worker = workers[(index + i) % workers.size()];
+            std::lock_guard lock(worker.mutex);
+            if (!worker.tasks.empty()) {
+                auto task = std::move(worker.tasks.front());
+                worker.tasks.pop_front();
+                --queued;
+                return task;
+            }
+        }
+        return {};
+    };
+
+    auto run = [&](int index) {
+        auto &worker = workers[index];
+        while (pending.load() > 0) {
+            auto task = takeTask(index);
+            if (!task) {
+                std::unique_lock lock(waitMutex);
+                wakeUp.wait(lock, [&]() {
+                    return pending.load() == 0 || queued.load() > 0;
+                });
+                continue;
+            }
+            auto directory = listDirectory(task->path, task->rules);
+            if (const auto count = static_cast<int>(directory.directories.size()); count > 0) {
+                pending += count;
+                {
+                    std::lock_guard lock(worker.mutex);
+                    for (const auto &name : std::as_const(directory.directories))
+                        worker.tasks.push_back({joinPath(task->path, name), task->rules});
+                }
+                queued += count;
+                // This worker takes one of the directories itself, the others are for the idle workers
+                if (count > 1)
+                    notifyAll();
+            }
+            worker.result.push_back(std::move(directory));
+            if (--pending == 0)
+                notifyAll();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (int i = 1; i < threadCount; ++i)
+        threads.emplace_back(run, i);
+    run(0);
+    for (auto &thread : threads)
+        thread.join();
+
+    std::vector<Directory> result;
+    for (auto &worker : workers)
+        std::ranges::move(worker.result, std::back_inserter(result));
+    return result;
+}
+
+QString DirectoryWalker::absolutePath(const QString &relativePath) const
+{
+    return relativePath.isEmpty() ? m_root : m_root + '/' + relativePath;
+}
+
+QStringList DirectoryWalker::files() const
+{
+    QStringList result;
+    for (const auto &directory : walk()) {
+        for (const auto &name : directory.files)
+            result.push_back(joinPath(directory.path, name));
+    }
+    std::ranges::sort(result);
+    return result;
+}
+
+} // namespace Core
@@ -0,0 +1,78 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#pragma once
+
+#include <QRegularExpression>
+#include <QStringList>
+#include <memory>
+#include <vector>
+
+namespace Core {
+
+class IgnoreRules;
+
+/**
+ * \brief Walk a directory tree in parallel, skipping ignored files and directories
+ *
+ * Sub-directories are listed by a pool of threads, each thread stealing work from the others when it runs out of
+ * directories. Hidden files and directories (starting with a '.') are skipped, and symbolic links to directories are
+ * not followed.
+ *
+ * Files and directories matching an exclude glob, or a pattern from a `.gitignore` file, are skipped. The globs use the
+ * `.gitignore` syntax: `*`, `?`, `[...]` and `**` wildcards, a leading `!` to negate a pattern, a trailing `/` to
+ * match only directories, and a `/` in the pattern to anchor it to the root.
+ */
+class DirectoryWalker
+{
+public:
+    struct Options
+    {
+        // Globs of files and directories to exclude, relative to the root
+        QStringList excludes;
+        // Wildcards the file names should match (e.g. `*.cpp`), all files are returned if empty
+        QStringList nameFilters;
+        bool recursive = true;
+        bool useGitIgnore = true;
+    };
+
+    struct Directory
+    {
+        // Path relative to the root, empty for the root itself
+        QString path;
+        // Names of the files and sub-directories
+        QStringList files;
+        QStringList directories;
+    };
+
+    explicit DirectoryWalker(QString root, Options options = {});
+    ~DirectoryWalker();
+
+    const QString &root() const;
+
+    // Returns the content of the directory `relativePath`.
+    Directory list(const QString &relativePath) const;
+    // Returns all directories from `relativePath`, in no particular order.
+    std::vector<Directory> walk(const QString &relativePath = {}) const;
+    // Returns all files, relative to the root, sorted.
+    QStringList files() const;
+
+private:
+    QString absolutePath(const QString &relativePath) const;
+    std::shared_ptr<const IgnoreRules> rulesFor(const QString &relativePath) const;
+    Directory listDirectory(const QString &relativePath, std::shared_ptr<const IgnoreRules> &rules) const;
+
+    const QString m_root;
+    const Options m_options;
+    std::shared_ptr<const IgnoreRules> m_rootRules;
+    std::vector<QRegularExpression> m_nameFilters;
+};
+
+} // namespace Core
@@ -17,6 +17,7 @@
 #include <QMessageBox>
 #include <QSignalBlocker>
 #include <QUrl>
+#include <utility>
 
 namespace Core {
 
@@ -152,6 +153,47 @@ void Document::reload()
     emit fileUpdated();
 }
 
+/**
+ * \brief Returns an estimate of the memory used by the document, in bytes
+ */
+qint64 Document::memoryUsage() const
+{
+    return 0;
+}
+
+/**
+ * \brief Releases the memory that can be recomputed or reloaded on demand
+ *
+ * The document stays valid and can be used as before, this is transparent for the callers. It's only called on
+ * unmodified documents. The memoryReacquired signal is emitted the first time the document is used again.
+ */
+void Document::releaseMemory()
+{
+    Q_ASSERT(!isMemoryLocked());
+    doReleaseMemory();
+    m_memoryReleased = true;
+}
+
+/**
+ * \brief Returns true if the memory can't be released, see MemoryLock
+ */
+bool Document::isMemoryLocked() const
+{
+    return m_memoryLocks > 0;
+}
+
+/**
+ * \brief Notifies that the memory released by doReleaseMemory is used again
+ *
+ * To be called by subclasses when recreating or reloading what has been released.
+ */
+void Document::reacquireMemory() const
+{
+    if (!std::exchange(m_memoryReleased, false))
+        return;
+    emit const_cast<Document *>(this)->memoryReacquired();
+}
+
 /*!
  * \qmlmethod bool Document::load(string fileName)
  * Load the document `fileName` **without changing the type**. If the current document has some changes, save them
@@ -214,6 +256,7 @@ bool Document::saveAs(const QString &fileName)
         }
     }
 
+    const bool existed = exists();
     const bool saveDone = doSave(m_fileName);
     if (saveDone) {
         setHasChanged(false);
@@ -221,6 +264,8 @@ bool Document::saveAs(const QString &fileName)
             didOpen();
         const QFileInfo fi(m_fileName);
         m_lastModified = fi.lastModified();
+        if (!existed)
+            emit existsChanged();
     }
     return saveDone;
 }
@@ -249,4 +294,19 @@ void Document::setHasChanged(bool newHasChanged)
     emit hasChangedChanged();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// MemoryLock
+///////////////////////////////////////////////////////////////////////////////
+MemoryLock::MemoryLock(Document *document)
+    : m_document(document)
+{
+    Q_ASSERT(m_document);
+    ++m_document->m_memoryLocks;
+}
+
+MemoryLock::~MemoryLock()
+{
+    --m_document->m_memoryLocks;
+}
+
 } // namespace Core
@@ -63,6 +63,11 @@ public:
     bool hasChangedOnDisk() const;
     void reload();
 
+    // Memory management, used by the Project to release documents not used recently
+    virtual qint64 memoryUsage() const;
+    void releaseMemory();
+    bool isMemoryLocked() const;
+
 public slots:
     bool load(const QString &fileName);
     bool save();
@@ -75,10 +80,14 @@ signals:
     void errorStringChanged();
     void hasChangedChanged();
     void fileUpdated();
+    // Emitted when the memory released by releaseMemory is used again
+    void memoryReacquired();
 
 protected:
     virtual bool doSave(const QString &fileName) = 0;
     virtual bool doLoad(const QString &fileName) = 0;
+    virtual void doReleaseMemory() { }
+    void reacquireMemory() const;
 
     virtual void didOpen() { }
     virtual void didClose() { }
@@ -94,11 +103,31 @@ private:
     Type m_type;
     QString m_errorString;
     bool m_hasChanged = false;
+    mutable bool m_memoryReleased = false;
+    int m_memoryLocks = 0;
+    friend class MemoryLock;
 
     // Members used for refreshing file after external changes
     QDateTime m_lastModified;
 };
 
+/**
+ * \brief Prevents the memory of a Document from being released, until destroyed
+ *
+ * Use it while holding data released by Document::releaseMemory, like the syntax tree used by a running query, when
+ * the document may be released in the meantime (e.g. by a script callback opening other documents).
+ */
+class MemoryLock
+{
+public:
+    explicit MemoryLock(Document *document);
+    ~MemoryLock();
+
+private:
+    Q_DISABLE_COPY_MOVE(MemoryLock)
+    Document *const m_document;
+};
+
 NLOHMANN_JSON_SERIALIZE_ENUM(Document::Type,
                              {{Document::Type::Cpp, "cpp_type"},
                               {Document::Type::Text, "text_type"},
@@ -0,0 +1,282 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "fileindex.h"
+#include "utils/log.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QSet>
+#include <algorithm>
+#include <chrono>
+
+namespace Core {
+
+static QString joinPath(const QString &directory, const QString &name)
+{
+    return directory.isEmpty() ? name : directory + '/' + name;
+}
+
+static QString extensionKey(const QString &fileName)
+{
+    const auto index = fileName.lastIndexOf('.');
+    return index == -1 ? QString() : fileName.mid(index + 1).toLower();
+}
+
+static void insertSorted(QStringList &list, const QString &value)
+{
+    list.insert(std::lower_bound(list.begin(), list.end(), value), value);
+}
+
+static void removeSorted(QStringList &list, const QString &value)
+{
+    auto it = std::lower_bound(list.begin(), list.end(), value);
+    if (it != list.end() && *it == value)
+        list.erase(it);
+}
+
+static QHash<QString, DirectoryWalker::Directory> toDirectoryHash(std::vector<DirectoryWalker::Directory> directories)
+{
+    QHash<QString, DirectoryWalker::Directory> result;
+    result.reserve(directories.size());
+    for (auto &directory : directories)
+        result.insert(directory.path, std::move(directory));
+    return result;
+}
+
+FileIndex::FileIndex(QObject *parent)
+    : QObject(parent)
+{
+}
+
+FileIndex::~FileIndex()
+{
+    // Make sure the background scan is done before destroying the object
+    if (m_pending.valid())
+        m_pending.wait();
+}
+
+const QString &FileIndex::root() const
+{
+    return m_root;
+}
+
+/**
+ * \brief Set the root directory of the index, and start scanning it in the background.
+ */
+void FileIndex::setRoot(const QString &root, const QStringList &excludes)
+{
+    if (m_pending.valid())
+        m_pending.wait();
+    m_root = root;
+    delete m_watcher;
+    m_watcher = nullptr;
+    m_directories.clear();
+    m_files.clear();
+    m_filesByExtension.clear();
+
+    if (m_root.isEmpty()) {
+        m_walker.reset();
+        m_pending = {};
+        return;
+    }
+
+    m_walker = std::make_shared<const DirectoryWalker>(m_root, DirectoryWalker::Options {.excludes = excludes});
+    m_pending = std::async(std::launch::async, [this, walker = m_walker]() {
+        auto directories = toDirectoryHash(walker->walk());
+        QMetaObject::invokeMethod(this, &FileIndex::installWhenReady, Qt::QueuedConnection);
+        return directories;
+    });
+}
+
+QStringList FileIndex::files()
+{
+    ensureReady();
+    return m_files;
+}
+
+QStringList FileIndex::filesWithExtension(const QString &extension)
+{
+    ensureReady();
+    auto it = m_filesByExtension.find(extension.toLower());
+    if (it == m_filesByExtension.end())
+        return {};
+    if (extension.isEmpty())
+        return it->second;
+
+    QStringList result;
+    const QString suffix = '.' + extension;
+    std::ranges::copy_if(it->second, std::back_inserter(result), [&suffix](const QString &file) {
+        return file.endsWith(suffix);
+    });
+    return result;
+}
+
+QStringList FileIndex::filesWithExtensions(const QStringList &extensions)
+{
+    ensureReady();
+    QSet<QString> keys;
+    QStringList result;
+    for (const auto &extension : extensions) {
+        const auto key = extension.toLower();
+        if (keys.contains(key))
+            continue;
+        keys.insert(key);
+        auto it = m_filesByExtension.find(key);
+        if (it == m_filesByExtension.end())
+            continue;
+        const auto middle = result.size();
+        result.append(it->second);
+        std::inplace_merge(result.begin(), result.begin() + middle, result.end());
+    }
+    return result;
+}
+
+/**
+ * \brief Updates the index for `fileName`, an absolute path, after it has been created or removed.
+ *
+ * Only the directory of the file is listed again, or its closest indexed parent if the directory is new.
+ */
+void FileIndex::updateFile(const QString &fileName)
+{
+    ensureReady();
+    if (m_root.isEmpty())
+        return;
+
+    QString relativePath = QDir(m_root).relativeFilePath(QFileInfo(fileName).absolutePath());
+    if (relativePath == ".." || relativePath.startsWith("../") || QDir::isAbsolutePath(relativePath))
+        return;
+    if (relativePath == ".")
+        relativePath.clear();
+
+    while (!m_directories.contains(relativePath)) {
+        // Not indexed, even the root: the root has been removed
+        if (relativePath.isEmpty())
+            return;
+        const auto index = relativePath.lastIndexOf('/');
+        relativePath = index == -1 ? QString() : relativePath.left(index);
+    }
+    updateDirectory(absolutePath(relativePath));
+}
+
+void FileIndex::ensureReady()
+{
+    if (m_pending.valid())
+        setDirectories(m_pending.get());
+}
+
+void FileIndex::installWhenReady()
+{
+    // The root may have changed since the notification was sent, don't block on a new scan
+    if (m_pending.valid() && m_pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        setDirectories(m_pending.get());
+}
+
+void FileIndex::setDirectories(DirectoryHash directories)
+{
+    m_directories = std::move(directories);
+
+    QStringList paths;
+    paths.reserve(m_directories.size());
+    for (auto it = m_directories.cbegin(); it != m_directories.cend(); ++it) {
+        paths.push_back(absolutePath(it.key()));
+        for (const auto &name : it.value().files) {
+            const auto file = joinPath(it.key(), name);
+            m_files.push_back(file);
+            m_filesByExtension[extensionKey(name)].push_back(file);
+        }
+    }
+    std::ranges::sort(m_files);
+    for (auto &[extension, files] : m_filesByExtension)
+        std::ranges::sort(files);
+
+    m_watcher = new QFileSystemWatcher(this);
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, &FileIndex::updateDirectory);
+    const auto failed = m_watcher->addPaths(paths);
+    if (!failed.isEmpty())
+        spdlog::warn("{}: can't watch {} directories, the file index may be out-of-date", FUNCTION_NAME,
+                     failed.size());
+}
+
+void FileIndex::updateDirectory(const QString &path)
+{
+    const QString relativePath = path == m_root ? QString() : path.mid(m_root.size() + 1);
+    if (!m_directories.contains(relativePath))
+        return;
+
+    if (!QFileInfo(path).isDir()) {
+        removeDirectory(relativePath);
+        emit directoryUpdated(relativePath);
+        return;
+    }
+
+    const auto oldDirectory = m_directories.value(relativePath);
+    auto newDirectory = m_walker->list(relativePath);
+
+    const auto oldFiles = QSet<QString>(oldDirectory.files.cbegin(), oldDirectory.files.cend());
+    const auto newFiles = QSet<QString>(newDirectory.files.cbegin(), newDirectory.files.cend());
+    for (const auto &name : oldFiles - newFiles)
+        removeFile(joinPath(relativePath, name));
+    for (const auto &name : newFiles - oldFiles)
+        addFile(joinPath(relativePath, name));
+
+    const auto oldDirs = QSet<QString>(oldDirectory.directories.cbegin(), oldDirectory.directories.cend());
+    const auto newDirs = QSet<QString>(newDirectory.directories.cbegin(), newDirectory.directories.cend());
+    for (const auto &name : oldDirs - newDirs)
+        removeDirectory(joinPath(relativePath, name));
+    for (const auto &name : newDirs - oldDirs)
+        addDirectories(joinPath(relativePath, name));
+
+    m_directories.insert(relativePath, std::move(newDirectory));
+    emit directoryUpdated(relativePath);
+}
+
+void FileIndex::addDirectories(const QString &relativePath)
+{
+    const auto directories = toDirectoryHash(m_walker->walk(relativePath));
+    for (auto it = directories.cbegin(); it != directories.cend(); ++it) {
+        m_watcher->addPath(absolutePath(it.key()));
+        for (const auto &name : it.value().files)
+            addFile(joinPath(it.key(), name));
+        m_directories.insert(it.key(), it.value());
+    }
+}
+
+void FileIndex::removeDirectory(const QString &relativePath)
+{
+    const auto directory = m_directories.take(relativePath);
+    m_watcher->removePath(absolutePath(relativePath));
+    for (const auto &name : directory.files)
+        removeFile(joinPath(relativePath, name));
+    for (const auto &name : directory.directories)
+        removeDirectory(joinPath(relativePath, name));
+}
+
+void FileIndex::addFile(const QString &relativePath)
+{
+    insertSorted(m_files, relativePath);
+    insertSorted(m_filesByExtension[extensionKey(relativePath.mid(relativePath.lastIndexOf('/') + 1))], relativePath);
+}
+
+void FileIndex::removeFile(const QString &relativePath)
+{
+    removeSorted(m_files, relativePath);
+    auto it = m_filesByExtension.find(extensionKey(relativePath.mid(relativePath.lastIndexOf('/') + 1)));
+    if (it != m_filesByExtension.end())
+        removeSorted(it->second, relativePath);
+}
+
+QString FileIndex::absolutePath(const QString &relativePath) const
+{
+    return relativePath.isEmpty() ? m_root : m_root + '/' + relativePath;
+}
+
+} // namespace Core
@@ -0,0 +1,88 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#pragma once
+
+#include "directorywalker.h"
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <future>
+#include <unordered_map>
+
+class QFileSystemWatcher;
+
+namespace Core {
+
+/**
+ * \brief Index of all the files in a directory tree
+ *
+ * The index is built in a background thread when the root is set, and kept up-to-date using a QFileSystemWatcher
+ * afterward. Files are sharded by extension, so getting the files with some extensions only depends on the number of
+ * results, not on the size of the tree.
+ *
+ * The tree is listed using a DirectoryWalker, so ignored files (see DirectoryWalker) are not part of the index.
+ * Changes on disk are applied when the watcher notifies them, which requires the event loop to run: use updateFile for
+ * files created or removed synchronously, e.g. when a script saves a document.
+ */
+class FileIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FileIndex(QObject *parent = nullptr);
+    ~FileIndex() override;
+
+    const QString &root() const;
+    void setRoot(const QString &root, const QStringList &excludes = {});
+
+    // All paths are relative to the root, and sorted.
+    QStringList files();
+    // The extension is case sensitive.
+    QStringList filesWithExtension(const QString &extension);
+    // The extensions are case insensitive.
+    QStringList filesWithExtensions(const QStringList &extensions);
+
+    // Apply the creation or removal of the file right away, without waiting for the watcher.
+    void updateFile(const QString &fileName);
+
+signals:
+    // Emitted when a change on disk is applied to the index
+    void directoryUpdated(const QString &relativePath);
+
+private:
+    using DirectoryHash = QHash<QString, DirectoryWalker::Directory>;
+
+    void ensureReady();
+    void installWhenReady();
+    void setDirectories(DirectoryHash directories);
+
+    void updateDirectory(const QString &path);
+    void addDirectories(const QString &relativePath);
+    void removeDirectory(const QString &relativePath);
+    void addFile(const QString &relativePath);
+    void removeFile(const QString &relativePath);
+
+    QString absolutePath(const QString &relativePath) const;
+
+    QString m_root;
+    std::shared_ptr<const DirectoryWalker> m_walker;
+    std::future<DirectoryHash> m_pending;
+    QFileSystemWatcher *m_watcher = nullptr;
+
+    // Content of each directory, the key is the path relative to the root (empty for the root itself)
+    DirectoryHash m_directories;
+    // Sorted list of all files, and the same sharded by lowercase extension
+    QStringList m_files;
+    std::unordered_map<QString, QStringList> m_filesByExtension;
+};
+
+} // namespace Core
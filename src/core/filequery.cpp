@@ -0,0 +1,216 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "filequery.h"
+#include "cppdocument_p.h"
+#include "document.h"
+#include "scriptdialogitem.h"
+#include "settings.h"
+#include "treesitter/parser.h"
+#include "treesitter/predicates.h"
+#include "treesitter/query.h"
+#include "treesitter/tree.h"
+#include "utils/log.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <atomic>
+#include <optional>
+#include <unordered_map>
+
+namespace Core {
+
+namespace {
+
+    struct FileTask
+    {
+        QString fileName;
+        Document::Type type;
+        std::vector<std::shared_ptr<treesitter::Query>> queries;
+        std::optional<QString> text;
+    };
+
+}
+
+static bool hasTreeSitterSupport(Document::Type type)
+{
+    switch (type) {
+    case Document::Type::Cpp:
+    case Document::Type::Qml:
+    case Document::Type::CSharp:
+    case Document::Type::Rust:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Reads the file the same way TextDocument does, so positions are the same as in the document.
+static std::optional<QString> readFile(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        spdlog::warn("{}: Can't load file {}: {}", FUNCTION_NAME, fileName, file.errorString());
+        return {};
+    }
+
+    QTextStream stream(file.readAll());
+    QString text = stream.readAll();
+    text.replace("\r\n", "\n");
+    return text;
+}
+
+static FileQueryMatchList queryInFile(const FileTask &task, treesitter::Parser &parser,
+                                      const std::optional<QRegularExpression> &excludedMacros,
+                                      const treesitter::CancellationToken &cancellation)
+{
+    const auto text = task.text ? task.text : readFile(task.fileName);
+    if (!text)
+        return {};
+
+    if (task.type == Document::Type::Cpp && excludedMacros) {
+        if (!parser.setIncludedRanges(includedRangesExcluding(*text, *excludedMacros)))
+            parser.setIncludedRanges({});
+    }
+
+    const auto tree = parser.parseString(*text);
+    parser.setIncludedRanges({});
+    if (!tree) {
+        spdlog::warn("{}: Failed to parse file {}!", FUNCTION_NAME, task.fileName);
+        return {};
+    }
+
+    FileQueryMatchList result;
+    for (int queryIndex = 0; queryIndex < static_cast<int>(task.queries.size()); ++queryIndex) {
+        const auto &query = task.queries[queryIndex];
+        treesitter::QueryCursor cursor;
+        cursor.setCancellationToken(cancellation);
+        cursor.execute(query, tree->rootNode(), std::make_unique<treesitter::Predicates>(*text));
+
+        for (auto match = cursor.nextMatch(); match.has_value(); match = cursor.nextMatch()) {
+            FileQueryMatch fileMatch {.fileName = task.fileName, .captures = {}, .queryIndex = queryIndex};
+            const auto captures = match->captures();
+            fileMatch.captures.reserve(captures.size());
+            for (const auto &capture : captures) {
+                const auto point = capture.node.startPoint();
+                fileMatch.captures.push_back({
+                    .name = query->captureAt(capture.id).name,
+                    .start = static_cast<int>(capture.node.startPosition()),
+                    .end = static_cast<int>(capture.node.endPosition()),
+                    .line = static_cast<int>(point.row) + 1,
+                    .column = static_cast<int>(point.column / sizeof(QChar)) + 1,
+                    .text = capture.node.textIn(*text),
+                });
+            }
+            result.push_back(std::move(fileMatch));
+        }
+    }
+    return result;
+}
+
+FileQueryMatchList queryInFiles(const QStringList &fileNames, const QString &query,
+                                const QHash<QString, QString> &texts)
+{
+    return queryInFiles(fileNames, QStringList {query}, texts);
+}
+
+FileQueryMatchList queryInFiles(const QStringList &fileNames, const QStringList &queries,
+                                const QHash<QString, QString> &texts)
+{
+    static const auto mimeTypes =
+        Settings::instance()->value<std::map<std::string, Document::Type>>(Settings::MimeTypes);
+
+    // Everything touching the settings, or logging query errors, is done upfront on the calling thread.
+    // The queries are compiled once per language, and shared by all the threads.
+    std::unordered_map<Document::Type, std::vector<std::shared_ptr<treesitter::Query>>> tsQueries;
+    std::vector<FileTask> tasks;
+    tasks.reserve(fileNames.size());
+    for (const auto &fileName : fileNames) {
+        auto it = mimeTypes.find(QFileInfo(fileName).suffix().toStdString());
+        if (it == mimeTypes.end() || !hasTreeSitterSupport(it->second))
+            continue;
+
+        const auto type = it->second;
+        auto queryIt = tsQueries.find(type);
+        if (queryIt == tsQueries.end()) {
+            std::vector<std::shared_ptr<treesitter::Query>> languageQueries;
+            for (const auto &query : queries) {
+                try {
+                    languageQueries.push_back(
+                        treesitter::QueryCache::instance().get(treesitter::Parser::getLanguage(type), query));
+                } catch (treesitter::Query::Error &error) {
+                    spdlog::error("{}: Failed to parse query `{}` error: {} at: {}", FUNCTION_NAME, query,
+                                  error.description, error.utf8_offset);
+                    languageQueries.clear();
+                    break;
+                }
+            }
+            queryIt = tsQueries.emplace(type, std::move(languageQueries)).first;
+        }
+        if (queryIt->second.empty())
+            continue;
+
+        auto textIt = texts.constFind(fileName);
+        tasks.push_back({.fileName = fileName,
+                         .type = type,
+                         .queries = queryIt->second,
+                         .text = textIt != texts.cend() ? std::optional<QString>(*textIt) : std::nullopt});
+    }
+    if (tasks.empty())
+        return {};
+
+    const auto excludedMacros = excludedMacrosRegex();
+    const auto cancellation = ScriptDialogItem::cancellationToken();
+
+    // Each thread picks the next file to handle, results are stored per file to keep the order of the files.
+    std::vector<FileQueryMatchList> results(tasks.size());
+    std::atomic<size_t> nextTask = 0;
+    auto run = [&]() {
+        // Parsers can't be shared between threads, and QRegularExpression is only reentrant: each thread has its own
+        // parsers and compiles its own copy of the expression, once. The queries do the same for their predicates.
+        std::unordered_map<Document::Type, treesitter::Parser> parsers;
+        std::optional<QRegularExpression> macros;
+        if (excludedMacros) {
+            macros.emplace(excludedMacros->pattern(), excludedMacros->patternOptions());
+            macros->optimize();
+        }
+
+        for (auto index = nextTask++; index < tasks.size() && !cancellation.isCancelled(); index = nextTask++) {
+            const auto &task = tasks[index];
+            auto parserIt = parsers.find(task.type);
+            if (parserIt == parsers.end())
+                parserIt =
+                    parsers.emplace(task.type, treesitter::Parser(treesitter::Parser::getLanguage(task.type))).first;
+            results[index] = queryInFile(task, parserIt->second, macros, cancellation);
+        }
+    };
+
+    QThreadPool pool;
+    const auto threadCount = std::min(QThread::idealThreadCount(), static_cast<int>(tasks.size()));
+    pool.setMaxThreadCount(threadCount);
+    for (int i = 0; i < threadCount; ++i)
+        pool.start(run);
+
+    // Keep the user interface responsive while the threads are running.
+    while (!pool.waitForDone(50))
+        ScriptDialogItem::updateProgress();
+    if (cancellation.isCancelled())
+        spdlog::warn("{}: the query was cancelled, the matches are incomplete", FUNCTION_NAME);
+
+    FileQueryMatchList matches;
+    for (auto &result : results)
+        matches.append(std::move(result));
+    return matches;
+}
+
+} // namespace Core
@@ -0,0 +1,65 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+namespace Core {
+
+/**
+ * Capture of a query run directly on a file, without any document.
+ * Positions are in characters, `line` and `column` are 1-based.
+ */
+struct FileQueryCapture
+{
+    QString name;
+    int start = -1;
+    int end = -1;
+    int line = -1;
+    int column = -1;
+    QString text;
+};
+
+struct FileQueryMatch
+{
+    QString fileName;
+    QList<FileQueryCapture> captures;
+    // Index of the query matching, when running multiple queries
+    int queryIndex = 0;
+};
+
+using FileQueryMatchList = QList<FileQueryMatch>;
+
+/**
+ * Runs the Tree-sitter `query` on all `fileNames`, without creating any document.
+ *
+ * The files are read, parsed and queried in parallel, using one parser per thread. Only files with a document type
+ * supporting Tree-sitter are queried, the query is compiled once per language.
+ * The content of some files can be overridden with `texts` (file name to text), for example for changed documents.
+ *
+ * The matches are returned in the order of `fileNames`.
+ */
+FileQueryMatchList queryInFiles(const QStringList &fileNames, const QString &query,
+                                const QHash<QString, QString> &texts = {});
+
+/**
+ * Runs all the Tree-sitter `queries` on all `fileNames`, parsing each file only once.
+ *
+ * Same as above, the matches of a file are ordered by query, `FileQueryMatch::queryIndex` is the index of the query in
+ * `queries`. Files are skipped if any of the queries fails to compile for their language.
+ */
+FileQueryMatchList queryInFiles(const QStringList &fileNames, const QStringList &queries,
+                                const QHash<QString, QString> &texts = {});
+
+} // namespace Core
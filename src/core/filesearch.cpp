@@ -0,0 +1,445 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "filesearch.h"
+#include "scriptdialogitem.h"
+#include "utils/log.h"
+
+#include <QFile>
+#include <QRegularExpression>
+#include <QStringDecoder>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+namespace Core {
+
+// Same heuristic as git and ripgrep: a null byte in the first few kilobytes means the file is binary.
+static constexpr qsizetype BinaryCheckSize = 8000;
+
+/**
+ * \brief Returns the longest literal string any match of `pattern` must contain, or an empty string if none is found.
+ *
+ * This is conservative: only literals outside of any group or character class are used, and nothing is returned if
+ * the pattern has a top-level alternation, inline options or escapes it doesn't know.
+ */
+static QString requiredLiteral(const QString &pattern)
+{
+    QString best;
+    QString current;
+    auto endRun = [&]() {
+        if (current.size() > best.size())
+            best = current;
+        current.clear();
+    };
+
+    int depth = 0;
+    const auto size = pattern.size();
+    for (qsizetype i = 0; i < size; ++i) {
+        const QChar c = pattern[i];
+        QChar literal;
+        if (c == '\\') {
+            if (i + 1 >= size)
+                return {};
+            const QChar next = pattern[++i];
+            if (next.isLetterOrNumber()) {
+                // Character classes, anchors and control characters only, other escapes may consume the next ones
+                if (!QStringView(u"dDsSwWbBntrfvAzZ").contains(next))
+                    return {};
+                endRun();
+                continue;
+            }
+            literal = next;
+        } else if (c == '(') {
+            // Inline options, like (?i), change how the rest of the pattern matches
+            if (i + 2 < size && pattern[i + 1] == '?' && (pattern[i + 2].isLetter() || pattern[i + 2] == '-'))
+                return {};
+            ++depth;
+            endRun();
+            continue;
+        } else if (c == ')') {
+            --depth;
+            endRun();
+            continue;
+        } else if (c == '[') {
+            endRun();
+            ++i;
+            if (i < size && pattern[i] == '^')
+                ++i;
+            if (i < size && pattern[i] == ']')
+                ++i;
+            for (; i < size && pattern[i] != ']'; ++i) {
+                if (pattern[i] == '\\')
+                    ++i;
+            }
+            continue;
+        } else if (c == '|') {
+            if (depth == 0)
+                return {};
+            continue;
+        } else if (c == '{') {
+            endRun();
+            while (i < size && pattern[i] != '}')
+                ++i;
+            continue;
+        } else if (QStringView(u".^$*+?").contains(c)) {
+            endRun();
+            continue;
+        } else {
+            literal = c;
+        }
+
+        if (depth > 0)
+            continue;
+        // A quantified character is either optional or repeated
+        const QChar next = i + 1 < size ? pattern[i + 1] : QChar();
+        if (next == '*' || next == '?' || next == '{') {
+            endRun();
+            continue;
+        }
+        current += literal;
+        if (next == '+')
+            endRun();
+    }
+    endRun();
+    return best;
+}
+
+namespace {
+
+    struct SearchTask
+    {
+        QString fileName;
+        std::optional<QString> text;
+    };
+
+}
+
+// Decodes the file the same way TextDocument does, so positions are the same as in the document.
+// Returns nothing if the file is binary, or doesn't contain the required literal.
+static std::optional<QString> readFile(const QString &fileName, const QByteArray &literal)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        spdlog::warn("{}: Can't load file {}: {}", FUNCTION_NAME, fileName, file.errorString());
+        return {};
+    }
+
+    // Empty files can't be mapped, fallback to reading the file if the mapping fails for any reason.
+    QByteArray content;
+    QByteArrayView data;
+    if (const auto size = file.size(); size > 0) {
+        if (const auto *mapped = file.map(0, size))
+            data = QByteArrayView(mapped, size);
+    }
+    if (data.isNull()) {
+        content = file.readAll();
+        data = content;
+    }
+
+    const auto encoding = QStringConverter::encodingForData(data).value_or(QStringConverter::Utf8);
+    if (encoding == QStringConverter::Utf8) {
+        if (data.first(std::min(data.size(), BinaryCheckSize)).contains('\0'))
+            return {};
+        // std::string_view::find boils down to a vectorized memchr, a lot faster than decoding and matching.
+        if (!literal.isEmpty()
+            && std::string_view(data.data(), data.size()).find(std::string_view(literal.data(), literal.size()))
+                == std::string_view::npos)
+            return {};
+    }
+
+    // The decoder skips the BOM, like QTextStream does
+    QStringDecoder decoder(encoding);
+    QString text = decoder(data);
+    text.replace("\r\n", "\n");
+    return text;
+}
+
+// Returns the line containing the position `start`
+static QString lineAt(const QString &text, qsizetype start)
+{
+    const auto lineStart = start == 0 ? 0 : text.lastIndexOf(u'\n', start - 1) + 1;
+    auto lineEnd = text.indexOf(u'\n', start);
+    if (lineEnd == -1)
+        lineEnd = text.size();
+    return text.mid(lineStart, lineEnd - lineStart);
+}
+
+static FileSearchMatchList searchInFile(const SearchTask &task, const QByteArray &literal,
+                                        const QRegularExpression &regexp, const std::atomic<bool> &canceled)
+{
+    const auto text = task.text ? task.text : readFile(task.fileName, literal);
+    if (!text)
+        return {};
+
+    FileSearchMatchList result;
+    int line = 1;
+    qsizetype lineStart = 0;
+    auto it = regexp.globalMatch(*text);
+    while (it.hasNext() && !canceled.load(std::memory_order_relaxed)) {
+        const auto match = it.next();
+        // Empty matches (e.g. `x*`) would report every position of the file
+        if (match.capturedLength() == 0)
+            continue;
+
+        const auto start = match.capturedStart();
+        line += static_cast<int>(std::count(text->cbegin() + lineStart, text->cbegin() + start, u'\n'));
+        lineStart = start == 0 ? 0 : text->lastIndexOf(u'\n', start - 1) + 1;
+
+        result.push_back({
+            .fileName = task.fileName,
+            .start = static_cast<int>(start),
+            .end = static_cast<int>(match.capturedEnd()),
+            .line = line,
+            .column = static_cast<int>(start - lineStart) + 1,
+            .lineText = lineAt(*text, start),
+        });
+    }
+    return result;
+}
+
+//=============================================================================
+// FileSearchJob
+//=============================================================================
+/**
+ * \brief State of a search, shared by the searching threads and the thread collecting the matches
+ *
+ * Each thread picks the next file to handle, results are stored per file to keep the order of the files.
+ */
+class FileSearchJob
+{
+public:
+    static constexpr auto Options =
+        QRegularExpression::MultilineOption | QRegularExpression::DotMatchesEverythingOption;
+
+    // Returns nullptr if the pattern is invalid
+    static std::unique_ptr<FileSearchJob> create(const QStringList &fileNames, const QString &pattern,
+                                                 const QHash<QString, QString> &texts)
+    {
+        const QRegularExpression regexp(pattern, Options);
+        if (!regexp.isValid()) {
+            spdlog::error("{}: Invalid pattern `{}` error: {} at: {}", FUNCTION_NAME, pattern, regexp.errorString(),
+                          regexp.patternErrorOffset());
+            return {};
+        }
+
+        auto job = std::unique_ptr<FileSearchJob>(new FileSearchJob(pattern, fileNames.size()));
+        for (const auto &fileName : fileNames) {
+            auto textIt = texts.constFind(fileName);
+            job->m_tasks.push_back({.fileName = fileName,
+                                    .text = textIt != texts.cend() ? std::optional<QString>(*textIt) : std::nullopt});
+        }
+        return job;
+    }
+
+    void start(QThreadPool &pool)
+    {
+        const auto threadCount = std::min(QThread::idealThreadCount(), static_cast<int>(m_tasks.size()));
+        pool.setMaxThreadCount(std::max(threadCount, 1));
+        for (int i = 0; i < threadCount; ++i)
+            pool.start([this]() {
+                run();
+            });
+    }
+
+    void cancel() { m_canceled = true; }
+
+    // The threads stop after the file they are searching, start needs to be called again to resume
+    void pause() { m_paused = true; }
+    void resume(QThreadPool &pool)
+    {
+        m_paused = false;
+        start(pool);
+    }
+    bool isPaused() const { return m_paused; }
+
+    // Returns the matches of the files done since the last call, in the order of the files
+    FileSearchMatchList takeMatches()
+    {
+        FileSearchMatchList matches;
+        for (; m_nextResult < m_tasks.size() && m_done[m_nextResult].load(std::memory_order_acquire); ++m_nextResult)
+            matches.append(std::move(m_results[m_nextResult]));
+        return matches;
+    }
+
+    bool isDone() const { return m_nextResult == m_tasks.size(); }
+
+private:
+    FileSearchJob(const QString &pattern, qsizetype fileCount)
+        : m_pattern(pattern)
+        , m_literal(requiredLiteral(pattern).toUtf8())
+        , m_results(fileCount)
+        , m_done(std::make_unique<std::atomic<bool>[]>(fileCount))
+    {
+        m_tasks.reserve(fileCount);
+    }
+
+    void run()
+    {
+        // QRegularExpression is only reentrant, so each thread compiles (and JIT-optimizes) its own copy, once.
+        QRegularExpression regexp(m_pattern, Options);
+        regexp.optimize();
+
+        while (!m_canceled && !m_paused) {
+            const auto index = m_nextTask++;
+            if (index >= m_tasks.size())
+                break;
+            m_results[index] = searchInFile(m_tasks[index], m_literal, regexp, m_canceled);
+            m_done[index].store(true, std::memory_order_release);
+        }
+    }
+
+    const QString m_pattern;
+    const QByteArray m_literal;
+    std::vector<SearchTask> m_tasks;
+    std::vector<FileSearchMatchList> m_results;
+    std::unique_ptr<std::atomic<bool>[]> m_done;
+    std::atomic<size_t> m_nextTask = 0;
+    std::atomic<bool> m_canceled = false;
+    std::atomic<bool> m_paused = false;
+    // Only used by the thread collecting the matches
+    size_t m_nextResult = 0;
+};
+
+FileSearchMatchList searchInFiles(const QStringList &fileNames, const QString &pattern,
+                                  const QHash<QString, QString> &texts)
+{
+    auto job = FileSearchJob::create(fileNames, pattern, texts);
+    if (!job)
+        return {};
+
+    QThreadPool pool;
+    job->start(pool);
+    // Keep the user interface responsive while the threads are running.
+    while (!pool.waitForDone(50))
+        ScriptDialogItem::updateProgress();
+    return job->takeMatches();
+}
+
+//=============================================================================
+// FileSearch
+//=============================================================================
+/**
+ * \brief Search in files asynchronously, reporting the matches as they are found.
+ *
+ * The search is done with the same engine as `searchInFiles`. The matches are collected regularly on the thread of
+ * the object, and reported in the order of the files with `matchesFound`.
+ */
+FileSearch::FileSearch(QObject *parent)
+    : QObject(parent)
+    , m_timer(new QTimer(this))
+{
+    m_timer->setInterval(50);
+    connect(m_timer, &QTimer::timeout, this, &FileSearch::collectMatches);
+}
+
+FileSearch::~FileSearch()
+{
+    if (m_job) {
+        m_job->cancel();
+        m_pool.waitForDone();
+    }
+}
+
+/**
+ * \brief Starts searching `pattern` in `fileNames`, canceling the current search if any.
+ *
+ * See `searchInFiles` for the parameters. If the pattern is invalid, `finished` is emitted right away.
+ */
+void FileSearch::start(const QStringList &fileNames, const QString &pattern, const QHash<QString, QString> &texts)
+{
+    cancel();
+
+    m_job = FileSearchJob::create(fileNames, pattern, texts);
+    if (!m_job) {
+        emit finished(false);
+        return;
+    }
+    m_job->start(m_pool);
+    m_timer->start();
+}
+
+/**
+ * \brief Cancels the current search, and waits for the threads to stop.
+ *
+ * Matches not reported yet are discarded, `finished` is emitted with `canceled` set to true.
+ */
+void FileSearch::cancel()
+{
+    if (!m_job)
+        return;
+
+    m_job->cancel();
+    m_pool.waitForDone();
+    m_timer->stop();
+    m_job.reset();
+    emit finished(true);
+}
+
+/**
+ * \brief Pauses the current search, for example once enough matches are found.
+ *
+ * The files being searched are finished, and their matches are still reported. The search is still running: it can
+ * be resumed with `resume`, or canceled.
+ */
+void FileSearch::pause()
+{
+    if (m_job)
+        m_job->pause();
+}
+
+/**
+ * \brief Resumes the search paused with `pause`, from the next file.
+ */
+void FileSearch::resume()
+{
+    if (!m_job || !m_job->isPaused())
+        return;
+
+    m_job->resume(m_pool);
+    m_timer->start();
+}
+
+bool FileSearch::isRunning() const
+{
+    return m_job != nullptr;
+}
+
+bool FileSearch::isPaused() const
+{
+    return m_job && m_job->isPaused();
+}
+
+void FileSearch::collectMatches()
+{
+    // Checked before taking the matches, so nothing is left behind when the threads are idle
+    const bool idle = m_pool.activeThreadCount() == 0;
+    const auto matches = m_job->takeMatches();
+    if (!matches.isEmpty())
+        emit matchesFound(matches);
+
+    // The search may have been canceled or restarted by a slot
+    if (m_job && m_job->isDone()) {
+        m_pool.waitForDone();
+        m_timer->stop();
+        m_job.reset();
+        emit finished(false);
+    } else if (m_job && m_job->isPaused() && idle) {
+        // Everything searched before the pause is reported, nothing happens until the search is resumed
+        m_timer->stop();
+    }
+}
+
+} // namespace Core
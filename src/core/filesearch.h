@@ -0,0 +1,83 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <memory>
+
+class QTimer;
+
+namespace Core {
+
+/**
+ * Match of a regular expression in a file.
+ * Positions are in characters, `line` and `column` are 1-based, `lineText` is the text of the first line of the match.
+ */
+struct FileSearchMatch
+{
+    QString fileName;
+    int start = -1;
+    int end = -1;
+    int line = -1;
+    int column = -1;
+    QString lineText;
+};
+
+using FileSearchMatchList = QList<FileSearchMatch>;
+
+/**
+ * Searches the regular expression `pattern` in all `fileNames`, without creating any document.
+ *
+ * The files are memory-mapped and searched in parallel. `.` matches any character including newlines, and `^`/`$`
+ * match at line boundaries. Binary files (containing a null byte) are skipped, and files not containing the longest
+ * literal required by the pattern are skipped before being decoded.
+ * The content of some files can be overridden with `texts` (file name to text), for example for changed documents.
+ *
+ * The matches are returned in the order of `fileNames`.
+ */
+FileSearchMatchList searchInFiles(const QStringList &fileNames, const QString &pattern,
+                                  const QHash<QString, QString> &texts = {});
+
+class FileSearchJob;
+
+class FileSearch : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FileSearch(QObject *parent = nullptr);
+    ~FileSearch() override;
+
+    void start(const QStringList &fileNames, const QString &pattern, const QHash<QString, QString> &texts = {});
+    void cancel();
+    void pause();
+    void resume();
+    bool isRunning() const;
+    bool isPaused() const;
+
+signals:
+    void matchesFound(const Core::FileSearchMatchList &matches);
+    void finished(bool canceled);
+
+private:
+    void collectMatches();
+
+    QThreadPool m_pool;
+    std::unique_ptr<FileSearchJob> m_job;
+    QTimer *const m_timer;
+};
+
+} // namespace Core
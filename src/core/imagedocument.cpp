@@ -20,9 +20,30 @@ ImageDocument::ImageDocument(QObject *parent)
 
 QImage ImageDocument::image() const
 {
+    if (m_released) {
+        m_image.load(fileName());
+        m_released = false;
+        reacquireMemory();
+    }
     return m_image;
 }
 
+qint64 ImageDocument::memoryUsage() const
+{
+    return m_image.sizeInBytes();
+}
+
+/**
+ * \brief Releases the image, it's loaded again from the file when needed
+ */
+void ImageDocument::doReleaseMemory()
+{
+    if (m_image.isNull())
+        return;
+    m_image = {};
+    m_released = true;
+}
+
 bool ImageDocument::doSave(const QString &fileName)
 {
     Q_UNUSED(fileName)
@@ -32,6 +53,8 @@ bool ImageDocument::doSave(const QString &fileName)
 
 bool ImageDocument::doLoad(const QString &fileName)
 {
+    m_released = false;
+    reacquireMemory();
     return m_image.load(fileName);
 }
 
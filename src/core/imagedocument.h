@@ -25,12 +25,16 @@ public:
 
     QImage image() const;
 
+    qint64 memoryUsage() const override;
+
 protected:
     bool doSave(const QString &fileName) override;
     bool doLoad(const QString &fileName) override;
+    void doReleaseMemory() override;
 
 private:
-    QImage m_image;
+    mutable QImage m_image;
+    mutable bool m_released = false;
 };
 
 } // namespace Core
@@ -16,6 +16,7 @@
 
 #include <QPlainTextEdit>
 #include <QTextBlock>
+#include <algorithm>
 
 namespace Core::Utils {
 
@@ -23,17 +24,18 @@ namespace Core::Utils {
 {
     Lsp::Position position;
 
-    auto cursor = textDocument.textEdit()->textCursor();
-    cursor.setPosition(pos, QTextCursor::MoveAnchor);
+    auto document = textDocument.document();
+    pos = std::clamp(pos, 0, document->characterCount() - 1);
+    const QTextBlock block = document->findBlock(pos);
 
-    position.line = cursor.blockNumber();
-    position.character = cursor.positionInBlock();
+    position.line = block.blockNumber();
+    position.character = pos - block.position();
     return position;
 }
 
 int lspToPos(const TextDocument &textDocument, const Lsp::Position &pos)
 {
-    auto document = textDocument.textEdit()->document();
+    auto document = textDocument.document();
     // Internally, columns are 0-based, like in LSP
     const int blockNumber = qMin((int)pos.line, document->blockCount() - 1);
     const QTextBlock &block = document->findBlockByNumber(blockNumber);
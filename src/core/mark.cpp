@@ -17,6 +17,10 @@
 #include <QPlainTextEdit>
 #include <QTextDocument>
 
+#include <algorithm>
+#include <ranges>
+#include <utility>
+
 namespace Core {
 
 /*!
@@ -48,6 +52,221 @@ namespace Core {
  * This read-only property returns the document the mark is coming from.
  */
 
+TrackedPosition::TrackedPosition(MarkRegistry *registry, int pos)
+    : m_registry(registry)
+    , m_pos(pos)
+{
+    Q_ASSERT(registry);
+    m_registry->add(this, pos);
+}
+
+TrackedPosition::~TrackedPosition()
+{
+    if (m_registry)
+        m_registry->remove(this);
+}
+
+int TrackedPosition::value() const
+{
+    return m_registry ? m_registry->value(this) : m_pos;
+}
+
+MarkRegistry::MarkRegistry(QTextDocument *document)
+{
+    m_connection = QObject::connect(document, &QTextDocument::contentsChange, document,
+                                    [this](int from, int charsRemoved, int charsAdded) {
+                                        update(from, charsRemoved, charsAdded);
+                                    });
+}
+
+MarkRegistry::~MarkRegistry()
+{
+    QObject::disconnect(m_connection);
+    // Detach all positions, so they keep their last value
+    for (int i = 0; i < static_cast<int>(m_entries.size()); ++i) {
+        if (auto entry = m_entries[i]) {
+            entry->m_pos = position(i);
+            entry->m_registry = nullptr;
+        }
+    }
+    for (const auto &added : m_added) {
+        added.position->m_pos = added.pos;
+        added.position->m_registry = nullptr;
+    }
+}
+
+void MarkRegistry::add(TrackedPosition *position, int pos)
+{
+    // The document can't change until the positions are merged, so there's no need to sort them now
+    position->m_index = -1 - static_cast<int>(m_added.size());
+    m_added.push_back({.position = position, .pos = pos});
+}
+
+void MarkRegistry::remove(TrackedPosition *position)
+{
+    if (position->m_index < 0) {
+        // Not merged yet, move the last added position in its place
+        const auto index = static_cast<size_t>(-1 - position->m_index);
+        Q_ASSERT(m_added.at(index).position == position);
+        m_added[index] = m_added.back();
+        m_added[index].position->m_index = position->m_index;
+        m_added.pop_back();
+        return;
+    }
+
+    Q_ASSERT(m_entries.at(position->m_index) == position);
+    m_entries[position->m_index] = nullptr;
+    ++m_removedCount;
+
+    // The removed positions are still updated until they are compacted, so don't wait too long
+    if (m_removedCount > 64 && m_removedCount > static_cast<int>(m_entries.size()) / 2)
+        compact();
+}
+
+int MarkRegistry::value(const TrackedPosition *position) const
+{
+    if (position->m_index < 0)
+        return m_added[-1 - position->m_index].pos;
+    return this->position(position->m_index);
+}
+
+/**
+ * \brief Registers marks to create before the next change of the document.
+ *
+ * The registry only keeps a weak reference: if the marks are gone before the document changes, nothing is created.
+ */
+void MarkRegistry::addUntracked(const std::shared_ptr<UntrackedMarks> &marks)
+{
+    // Forget the marks already gone, so a document queried again and again without being changed doesn't grow forever
+    if (m_untracked.size() >= m_untrackedCapacity) {
+        std::erase_if(m_untracked, [](const auto &untracked) {
+            return untracked.expired();
+        });
+        m_untrackedCapacity = std::max<size_t>(64, 2 * m_untracked.size());
+    }
+    m_untracked.push_back(marks);
+}
+
+void MarkRegistry::trackUntracked()
+{
+    const auto untracked = std::exchange(m_untracked, {});
+    for (const auto &weakMarks : untracked) {
+        if (auto marks = weakMarks.lock())
+            marks->track();
+    }
+    m_untrackedCapacity = 64;
+}
+
+int MarkRegistry::position(int index) const
+{
+    return m_positions[index] + (index >= m_pendingIndex ? m_pendingDelta : 0);
+}
+
+void MarkRegistry::setPosition(int index, int pos)
+{
+    m_positions[index] = pos - (index >= m_pendingIndex ? m_pendingDelta : 0);
+}
+
+int MarkRegistry::lowerBound(int pos) const
+{
+    const auto indexes = std::views::iota(0, static_cast<int>(m_positions.size()));
+    const auto it = std::ranges::partition_point(indexes, [&](int i) {
+        return position(i) < pos;
+    });
+    return it == indexes.end() ? static_cast<int>(m_positions.size()) : *it;
+}
+
+/**
+ * \brief Merges the positions added since the last change in the sorted positions.
+ *
+ * The merge starts from the end, so only the entries after the first added position are moved and re-indexed.
+ */
+void MarkRegistry::mergeAdded()
+{
+    if (m_added.empty())
+        return;
+
+    // Added positions equal to each other keep their creation order, RangeMark relies on it
+    std::ranges::stable_sort(m_added, {}, &AddedPosition::pos);
+
+    // Apply the pending delta, the positions are moved around
+    for (int i = m_pendingIndex; i < static_cast<int>(m_positions.size()); ++i)
+        m_positions[i] += m_pendingDelta;
+    m_pendingIndex = 0;
+    m_pendingDelta = 0;
+
+    int i = static_cast<int>(m_positions.size()) - 1;
+    int j = static_cast<int>(m_added.size()) - 1;
+    int k = i + j + 1;
+    m_positions.resize(k + 1);
+    m_entries.resize(k + 1);
+    while (j >= 0) {
+        // Added positions go after the existing ones equal to them
+        if (i >= 0 && m_positions[i] > m_added[j].pos) {
+            m_positions[k] = m_positions[i];
+            m_entries[k] = m_entries[i];
+            --i;
+        } else {
+            m_positions[k] = m_added[j].pos;
+            m_entries[k] = m_added[j].position;
+            --j;
+        }
+        if (auto entry = m_entries[k])
+            entry->m_index = k;
+        --k;
+    }
+    m_added.clear();
+}
+
+void MarkRegistry::compact()
+{
+    int count = 0;
+    for (int i = 0; i < static_cast<int>(m_entries.size()); ++i) {
+        if (auto entry = m_entries[i]) {
+            m_positions[count] = position(i);
+            m_entries[count] = entry;
+            entry->m_index = count;
+            ++count;
+        }
+    }
+    m_positions.resize(count);
+    m_entries.resize(count);
+    m_pendingIndex = 0;
+    m_pendingDelta = 0;
+    m_removedCount = 0;
+}
+
+void MarkRegistry::update(int from, int charsRemoved, int charsAdded)
+{
+    // The untracked marks are created first, while their positions are still the ones before the change
+    if (!m_untracked.empty())
+        trackUntracked();
+    mergeAdded();
+
+    const auto first = lowerBound(from);
+    const auto last = lowerBound(from + charsRemoved);
+
+    // Positions within the removed text are moved to the start of the edit
+    for (int i = first; i < last; ++i)
+        setPosition(i, from);
+
+    const int delta = charsAdded - charsRemoved;
+    if (delta == 0)
+        return;
+
+    // Positions after the edit are shifted, only apply the shift for the positions between the pending index and the
+    // end of the edit, the pending delta takes care of the rest
+    if (last <= m_pendingIndex) {
+        for (int i = last; i < m_pendingIndex; ++i)
+            m_positions[i] += delta;
+    } else {
+        for (int i = m_pendingIndex; i < last; ++i)
+            m_positions[i] += m_pendingDelta;
+        m_pendingIndex = last;
+    }
+    m_pendingDelta += delta;
+}
+
 bool MarkPrivate::checkEditor() const
 {
     if (!m_editor) {
@@ -59,7 +278,7 @@ bool MarkPrivate::checkEditor() const
 
 bool MarkPrivate::isValid() const
 {
-    return m_editor && m_pos >= 0;
+    return m_editor && m_pos.value() >= 0;
 }
 
 int MarkPrivate::line() const
@@ -68,7 +287,7 @@ int MarkPrivate::line() const
         return -1;
 
     int line, column;
-    m_editor->convertPosition(m_pos, &line, &column);
+    m_editor->convertPosition(m_pos.value(), &line, &column);
     return line;
 }
 
@@ -78,24 +297,14 @@ int MarkPrivate::column() const
         return -1;
 
     int line, column;
-    m_editor->convertPosition(m_pos, &line, &column);
+    m_editor->convertPosition(m_pos.value(), &line, &column);
     return column;
 }
 
-void MarkPrivate::update(int from, int charsRemoved, int charsAdded)
-{
-    Mark::updateMark(m_pos, from, charsRemoved, charsAdded);
-}
-
 MarkPrivate::MarkPrivate(TextDocument *editor, int pos)
-    : QObject(nullptr) // Important to have nullptr here, MarkPrivate is managed by shared_ptrs in Mark, MarkPrivate can
-                       // deal with the editor being deleted.
-    , m_editor(editor)
-    , m_pos(pos)
+    : m_editor(editor)
+    , m_pos(editor->m_marks.get(), pos)
 {
-    Q_ASSERT(editor);
-    auto document = editor->textEdit()->document();
-    connect(document, &QTextDocument::contentsChange, this, &MarkPrivate::update);
 }
 
 Mark::Mark(TextDocument *editor, int pos)
@@ -110,7 +319,7 @@ bool Mark::isValid() const
 
 int Mark::position() const
 {
-    return d ? d->m_pos : -1;
+    return d ? d->m_pos.value() : -1;
 }
 
 int Mark::line() const
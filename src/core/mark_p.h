@@ -10,17 +10,117 @@
 
 #pragma once
 
-#include <QObject>
+#include <QMetaObject>
 #include <QPointer>
 
+#include <memory>
+#include <vector>
+
+class QTextDocument;
+
 namespace Core {
 
+class MarkRegistry;
 class TextDocument;
 
-class MarkPrivate : public QObject
+/**
+ * Position in a document, kept up-to-date by the document's MarkRegistry.
+ *
+ * The position outlives the document: once the document is destroyed, it keeps its last value.
+ */
+class TrackedPosition
+{
+public:
+    TrackedPosition(MarkRegistry *registry, int pos);
+    ~TrackedPosition();
+
+    Q_DISABLE_COPY_MOVE(TrackedPosition)
+
+    int value() const;
+
+private:
+    friend MarkRegistry;
+    MarkRegistry *m_registry = nullptr;
+    // Index in the registry while attached (-1 - index in the added positions until they are merged), position once
+    // detached
+    int m_index = -1;
+    int m_pos = -1;
+};
+
+/**
+ * Marks created lazily, when they are needed, instead of when their positions are known.
+ *
+ * Until then, the positions are only valid for the current text of the document: the MarkRegistry calls track() before
+ * the next change of the document, so the marks are created at their position before the change.
+ */
+class UntrackedMarks
+{
+public:
+    virtual ~UntrackedMarks() = default;
+
+    // Creates the marks, may be called multiple times
+    virtual void track() = 0;
+};
+
+/**
+ * Keeps track of the positions of all the marks of a document.
+ *
+ * The positions are stored sorted, so an edit only needs to look at the marks it overlaps. Marks after the edit are
+ * shifted lazily: the shift is kept pending for all marks from a given index, and only applied when another edit
+ * needs to move this index. Consecutive edits at the same place (typing, for example) are then O(log n).
+ *
+ * New positions are not inserted right away: they are kept aside, and merged all at once in the sorted positions before
+ * the next change of the document. Creating many marks is then O(n + k log k) instead of O(n) per mark.
+ *
+ * Marks are updated the same way as Mark::updateMark.
+ */
+class MarkRegistry
 {
-    Q_OBJECT
+public:
+    explicit MarkRegistry(QTextDocument *document);
+    ~MarkRegistry();
+
+    Q_DISABLE_COPY_MOVE(MarkRegistry)
+
+    void addUntracked(const std::shared_ptr<UntrackedMarks> &marks);
 
+private:
+    friend TrackedPosition;
+
+    void add(TrackedPosition *position, int pos);
+    void remove(TrackedPosition *position);
+    int value(const TrackedPosition *position) const;
+    int position(int index) const;
+    void setPosition(int index, int pos);
+    int lowerBound(int pos) const;
+    void mergeAdded();
+    void compact();
+
+    void update(int from, int charsRemoved, int charsAdded);
+    void trackUntracked();
+
+    QMetaObject::Connection m_connection;
+    // Sorted positions, m_pendingDelta should be added for all indexes >= m_pendingIndex
+    std::vector<int> m_positions;
+    // Tracked positions, nullptr once removed, until the next compaction
+    std::vector<TrackedPosition *> m_entries;
+    int m_pendingIndex = 0;
+    int m_pendingDelta = 0;
+    int m_removedCount = 0;
+    struct AddedPosition
+    {
+        TrackedPosition *position;
+        int pos;
+    };
+    // Positions added since the last change of the document, not sorted yet
+    std::vector<AddedPosition> m_added;
+    // Marks to create before the next change, the expired ones are removed when the list grows
+    std::vector<std::weak_ptr<UntrackedMarks>> m_untracked;
+    size_t m_untrackedCapacity = 64;
+};
+
+class MarkPrivate
+{
 public:
     // Unfortunately this needs to be public, as otherwise std::make_shared can't access it
     explicit MarkPrivate(TextDocument *editor, int pos);
@@ -33,10 +133,8 @@ private:
 
     bool checkEditor() const;
 
-    void update(int from, int charsRemoved, int charsAdded);
-
     QPointer<TextDocument> m_editor;
-    int m_pos = -1;
+    TrackedPosition m_pos;
     friend class Mark;
 };
 
@@ -12,6 +12,9 @@
 #include "cppdocument.h"
 #include "csharpdocument.h"
 #include "dartdocument.h"
+#include "fileindex.h"
+#include "filequery.h"
+#include "filesearch.h"
 #include "imagedocument.h"
 #include "jsondocument.h"
 #include "logger.h"
@@ -24,22 +27,29 @@
 #include "rustdocument.h"
 #include "settings.h"
 #include "slintdocument.h"
+#include "symbolindex.h"
 #include "textdocument.h"
 #include "utils/log.h"
 
 #include <QDir>
-#include <QDirIterator>
 #include <QFileInfo>
 #include <QMetaEnum>
-#include <QProcess>
-#include <QStandardPaths>
 #include <algorithm>
 #include <kdalgorithms.h>
 #include <map>
 #include <unordered_set>
+#include <utility>
 
 namespace Core {
 
+// Documents are indexed by their canonical path, so symbolic links, or paths differing in case on case-insensitive file
+// systems, give the same document. New files don't have one yet, their clean path is used instead.
+static QString documentKey(const QString &absoluteFilePath)
+{
+    const QString canonicalPath = QFileInfo(absoluteFilePath).canonicalFilePath();
+    return canonicalPath.isEmpty() ? QDir::cleanPath(absoluteFilePath) : canonicalPath;
+}
+
 /*!
  * \qmltype Project
  * \brief Singleton for handling the current project.
@@ -63,9 +73,14 @@ namespace Core {
 
 Project::Project(QObject *parent)
     : QObject(parent)
+    , m_fileIndex(new FileIndex(this))
 {
     Q_ASSERT(m_instance == nullptr);
     m_instance = this;
+
+    connect(m_fileIndex, &FileIndex::directoryUpdated, this, [this]() {
+        m_symbolIndexOutdated = true;
+    });
 }
 
 Project::~Project()
@@ -104,6 +119,9 @@ bool Project::setRoot(const QString &newRoot)
 
     m_root = dir.absolutePath();
     Settings::instance()->loadProjectSettings(m_root);
+    m_fileIndex->setRoot(m_root, DEFAULT_VALUE(QStringList, ProjectExcludes));
+    m_symbolIndex.reset();
+    m_symbolIndexSavedFiles.clear();
     for (auto client : m_lspClients | std::views::values)
         client->openProject(m_root);
 
@@ -111,6 +129,15 @@ bool Project::setRoot(const QString &newRoot)
     return true;
 }
 
+QStringList Project::toPathType(QStringList files, PathType type) const
+{
+    if (type == FullPath) {
+        for (auto &file : files)
+            file = m_root + '/' + file;
+    }
+    return files;
+}
+
 /*!
  * \qmlmethod array<string> Project::allFiles(PathType type = RelativeToRoot)
  * Returns all files in the current project.
@@ -118,6 +145,8 @@ bool Project::setRoot(const QString &newRoot)
  *
  * - `Project.FullPath`
  * - `Project.RelativeToRoot`
+ *
+ * Hidden files, and files ignored by a `.gitignore` file or the `project/excludes` setting, are not returned.
  */
 QStringList Project::allFiles(PathType type) const
 {
@@ -126,17 +155,7 @@ QStringList Project::allFiles(PathType type) const
 
     LOG(type);
 
-    QDir dir(m_root);
-    QDirIterator it(m_root, QDirIterator::Subdirectories);
-    QStringList result;
-    while (it.hasNext()) {
-        it.next();
-        auto fi = it.fileInfo();
-        if (fi.isFile())
-            result.push_back(type == FullPath ? fi.absoluteFilePath() : dir.relativeFilePath(fi.absoluteFilePath()));
-    }
-    std::ranges::sort(result);
-    return result;
+    return toPathType(m_fileIndex->files(), type);
 }
 
 /*!
@@ -154,17 +173,7 @@ QStringList Project::allFilesWithExtension(const QString &extension, PathType ty
 
     LOG(extension, type);
 
-    QDir dir(m_root);
-    QDirIterator it(m_root, QDirIterator::Subdirectories);
-    QStringList result;
-    while (it.hasNext()) {
-        it.next();
-        auto fi = it.fileInfo();
-        if (fi.isFile() && fi.suffix() == extension)
-            result.push_back(type == FullPath ? fi.absoluteFilePath() : dir.relativeFilePath(fi.absoluteFilePath()));
-    }
-    std::ranges::sort(result);
-    return result;
+    return toPathType(m_fileIndex->filesWithExtension(extension), type);
 }
 
 /*!
@@ -182,17 +191,7 @@ QStringList Project::allFilesWithExtensions(const QStringList &extensions, PathT
 
     LOG(extensions, type);
 
-    QDir dir(m_root);
-    QDirIterator it(m_root, QDirIterator::Subdirectories);
-    QStringList result;
-    while (it.hasNext()) {
-        it.next();
-        auto fi = it.fileInfo();
-        if (fi.isFile() && extensions.contains(fi.suffix(), Qt::CaseInsensitive))
-            result.push_back(type == FullPath ? fi.absoluteFilePath() : dir.relativeFilePath(fi.absoluteFilePath()));
-    }
-    std::ranges::sort(result);
-    return result;
+    return toPathType(m_fileIndex->filesWithExtensions(extensions), type);
 }
 
 static Document *createDocument(const QString &suffix)
@@ -266,6 +265,10 @@ Lsp::Client *Project::getClient(Document::Type type)
 
 const QList<Document *> &Project::documents() const
 {
+    if (m_documentsChanged) {
+        m_documents = QList<Document *>(m_openedDocuments.cbegin(), m_openedDocuments.cend());
+        m_documentsChanged = false;
+    }
     return m_documents;
 }
 
@@ -273,20 +276,27 @@ Document *Project::getDocument(QString fileName, bool moveToBack)
 {
     QFileInfo fi(fileName);
     if (!fi.exists() && fi.isRelative())
-        fileName = m_root + '/' + fileName;
+        fileName = QDir::cleanPath(m_root + '/' + fileName);
     else
-        fileName = fi.absoluteFilePath();
-
-    auto findIt = std::ranges::find_if(m_documents, [fileName](auto document) {
-        return document->fileName() == fileName;
-    });
+        fileName = QDir::cleanPath(fi.absoluteFilePath());
 
     Document *doc = nullptr;
 
-    if (findIt != m_documents.end()) {
-        doc = *findIt;
-        if (moveToBack)
-            std::rotate(findIt, findIt + 1, m_documents.end());
+    // Closing a document clears its file name without notification, the index may be outdated.
+    auto findIt = m_documentsByName.find(documentKey(fileName));
+    if (findIt != m_documentsByName.end() && findIt->second->fileName().isEmpty()) {
+        m_documentsByName.erase(findIt);
+        findIt = m_documentsByName.end();
+    }
+
+    if (findIt != m_documentsByName.end()) {
+        doc = findIt->second;
+        auto &entry = m_documentEntries.at(doc);
+        if (moveToBack) {
+            m_openedDocuments.splice(m_openedDocuments.end(), m_openedDocuments, entry.openedIt);
+            m_documentsChanged = true;
+        }
+        markDocumentUsed(doc);
     } else {
         doc = createDocument(fi.suffix());
         if (doc) {
@@ -294,8 +304,9 @@ Document *Project::getDocument(QString fileName, bool moveToBack)
                 codeDocument->setLspClient(getClient(doc->type()));
             doc->setParent(this);
             doc->load(fileName);
-            m_documents.push_back(doc);
+            addDocument(doc);
             emit documentsChanged();
+            applyMemoryBudget();
         } else {
             spdlog::error("{}: {} - unknown document type", FUNCTION_NAME, fi.suffix());
             return nullptr;
@@ -304,6 +315,100 @@ Document *Project::getDocument(QString fileName, bool moveToBack)
     return doc;
 }
 
+void Project::addDocument(Document *document)
+{
+    DocumentEntry entry {.openedIt = m_openedDocuments.insert(m_openedDocuments.end(), document),
+                         .usedIt = m_usedDocuments.insert(m_usedDocuments.end(), document),
+                         .fileName = documentKey(document->fileName())};
+    m_documentsByName[entry.fileName] = document;
+    m_documentEntries.emplace(document, std::move(entry));
+    m_documentsChanged = true;
+
+    // Keep the index up-to-date if the document is saved or loaded under another name, or if its file is created (the
+    // key of new files is not their canonical path, see documentKey)
+    auto updateName = [this, document]() {
+        auto &entry = m_documentEntries.at(document);
+        if (auto it = m_documentsByName.find(entry.fileName); it != m_documentsByName.end() && it->second == document)
+            m_documentsByName.erase(it);
+        entry.fileName = document->fileName().isEmpty() ? QString() : documentKey(document->fileName());
+        if (!entry.fileName.isEmpty())
+            m_documentsByName[entry.fileName] = document;
+    };
+    connect(document, &Document::fileNameChanged, this, updateName);
+    connect(document, &Document::existsChanged, this, updateName);
+    // The file index is only updated from the event loop otherwise, scripts expect to find the file right away
+    connect(document, &Document::existsChanged, this, [this, document]() {
+        m_fileIndex->updateFile(document->fileName());
+    });
+    // A released document used through a pointer kept by the caller, not through getDocument
+    connect(document, &Document::memoryReacquired, this, [this, document]() {
+        if (m_documentEntries.at(document).released)
+            markDocumentUsed(document);
+    });
+    // The document may have been saved, only this file needs to be indexed again
+    connect(document, &Document::hasChangedChanged, this, [this, document]() {
+        if (!document->hasChanged() && document->type() == Document::Type::Cpp && !document->fileName().isEmpty())
+            m_symbolIndexSavedFiles.insert(document->fileName());
+    });
+}
+
+// Moves the document at the end of the list of used documents, it's measured again by applyMemoryBudget if it has
+// been released: the released memory is recreated on demand when the document is used again.
+void Project::markDocumentUsed(Document *document)
+{
+    auto &entry = m_documentEntries.at(document);
+    if (entry.released) {
+        m_usedDocuments.splice(m_usedDocuments.end(), m_releasedDocuments, entry.usedIt);
+        m_releasedMemory -= entry.releasedMemory;
+        entry.released = false;
+        entry.releasedMemory = 0;
+    } else {
+        m_usedDocuments.splice(m_usedDocuments.end(), m_usedDocuments, entry.usedIt);
+    }
+}
+
+// Releases the memory of the least recently used documents, until the memory used by all documents fits in the
+// budget set in the settings. Modified documents, the current one, the last one requested and the ones locked (see
+// MemoryLock) are never released.
+// Released documents are not measured again until they are used, through getDocument or a pointer kept by the caller
+// (see Document::memoryReacquired): each call only goes through the documents not released yet.
+void Project::applyMemoryBudget()
+{
+    const auto budget =
+        static_cast<qint64>(Settings::instance()->value<double>(Settings::MemoryBudget) * 1024 * 1024);
+    if (budget <= 0)
+        return;
+
+    qint64 total = m_releasedMemory;
+    for (auto document : m_usedDocuments)
+        total += document->memoryUsage();
+    if (total <= budget)
+        return;
+
+    const qint64 initialTotal = total;
+    int releasedCount = 0;
+    for (auto it = m_usedDocuments.begin(); it != m_usedDocuments.end() && total > budget;) {
+        auto document = *it;
+        if (document == m_current || document == m_usedDocuments.back() || document->hasChanged()
+            || document->isMemoryLocked()) {
+            ++it;
+            continue;
+        }
+        const auto size = document->memoryUsage();
+        document->releaseMemory();
+        auto &entry = m_documentEntries.at(document);
+        entry.released = true;
+        entry.releasedMemory = document->memoryUsage();
+        m_releasedMemory += entry.releasedMemory;
+        total -= size - entry.releasedMemory;
+        ++releasedCount;
+        it = std::next(it);
+        m_releasedDocuments.splice(m_releasedDocuments.end(), m_usedDocuments, entry.usedIt);
+    }
+    spdlog::debug("{}: released {} documents, from {} to {} bytes (budget: {} bytes)", FUNCTION_NAME, releasedCount,
+                  initialTotal, total, budget);
+}
+
 /*!
  * \qmlmethod Document Project::get(string fileName)
  * Gets the document for the given `fileName`. If the document is not opened yet, open it. If the document
@@ -350,7 +455,7 @@ void Project::closeAll()
 {
     LOG();
 
-    for (auto d : std::as_const(m_documents))
+    for (auto d : m_openedDocuments)
         d->close();
 }
 
@@ -367,7 +472,7 @@ void Project::saveAllDocuments()
 {
     LOG();
 
-    for (auto d : std::as_const(m_documents)) {
+    for (auto d : m_openedDocuments) {
         if (d->hasChanged()) {
             d->save();
         }
@@ -384,17 +489,43 @@ Document *Project::openPrevious(int index)
 {
     LOG(index);
 
-    Q_ASSERT(index < m_documents.size());
-    index = m_documents.size() - index - 1;
-    const QString &fileName = m_documents.at(index)->fileName();
+    Q_ASSERT(index < static_cast<int>(m_openedDocuments.size()));
+    const QString &fileName = (*std::prev(m_openedDocuments.cend(), index + 1))->fileName();
 
     LOG_RETURN("document", open(fileName));
 }
 
+/*!
+ * \qmlmethod object Project::memoryUsage()
+ * Returns an estimate of the memory used by the opened documents, in bytes, grouped by document type.
+ *
+ * Documents not used recently are released when the total exceeds the `/project/memory_budget` setting (in MB, 0 for
+ * no limit). Released documents stay valid and are reloaded transparently when used again.
+ *
+ * ```js
+ * let usage = Project.memoryUsage()
+ * Message.log("C++ documents: " + usage.Cpp + " bytes")
+ * ```
+ */
+QVariantMap Project::memoryUsage() const
+{
+    LOG();
+
+    std::map<Document::Type, qint64> usage;
+    for (auto document : m_openedDocuments)
+        usage[document->type()] += document->memoryUsage();
+
+    QVariantMap result;
+    for (const auto &[type, size] : usage)
+        result.insert(QMetaEnum::fromType<Document::Type>().key(static_cast<int>(type)), size);
+    return result;
+}
+
 /*!
  * \qmlmethod array<object> Project::findInFiles(const QString &pattern)
- * Search for a regex pattern in all files of the current project using ripgrep.
- * Returns a list of results (QVariantMaps) with the document name and position ("file", "line", "column").
+ * Search for a regex pattern in all files of the current project.
+ * Returns a list of results (QVariantMaps) with the document name and position ("file", "line", "column"), and the
+ * text of the line ("text").
  *
  * Example usage in QML:
  *
@@ -407,86 +538,171 @@ Document *Project::openPrevious(int index)
  * }
  * ```
  *
- * Note: The method uses ripgrep (rg) for searching, which must be installed and accessible in PATH.
- * The `pattern` parameter should be a valid regular expression.
+ * The `pattern` parameter should be a valid regular expression, `.` matches any character including newlines.
+ * The files are searched in parallel, without opening them in Knut. Files already opened and changed are searched
+ * using their current text. Binary files and files ignored by the project (see `Project.allFiles`) are skipped.
  */
 QVariantList Project::findInFiles(const QString &pattern) const
 {
     LOG(pattern);
 
-    QVariantList result;
+    if (pattern.trimmed().isEmpty() || m_root.isEmpty())
+        return {};
 
-    const QString path = QStandardPaths::findExecutable("rg");
-    if (path.isEmpty()) {
-        spdlog::error("Ripgrep (rg) executable not found. Please ensure that ripgrep is installed and its location is "
-                      "included in the PATH environment variable.");
-        return result;
-    }
+    const auto matches = searchInFiles(allFiles(FullPath), pattern, changedTexts());
 
-    if (pattern.trimmed().isEmpty()) {
-        return result;
-    }
-    if (m_root.isEmpty()) {
-        return result;
+    QVariantList result;
+    result.reserve(matches.size());
+    for (const auto &match : matches) {
+        result.append(QVariantMap {{"file", match.fileName},
+                                   {"line", match.line},
+                                   {"column", match.column},
+                                   {"text", match.lineText}});
     }
+    return result;
+}
 
-    QProcess process;
-
-    const QStringList arguments {"--vimgrep", "-U", "--multiline-dotall", pattern, m_root};
+/*!
+ * \qmlmethod bool Project::isFindInFilesAvailable()
+ * Checks if find in files is available on the system.
+ *
+ * Find in files doesn't depend on any external tool anymore, so it's always available.
+ */
+bool Project::isFindInFilesAvailable() const
+{
+    return true;
+}
 
-    process.start(path, arguments);
-    if (!process.waitForFinished()) {
-        spdlog::error("The ripgrep process failed: {}", process.errorString());
-        return result;
+/**
+ * \brief Returns the text of all opened documents with unsaved changes, by file name.
+ */
+QHash<QString, QString> Project::changedTexts() const
+{
+    QHash<QString, QString> texts;
+    for (auto document : m_openedDocuments) {
+        auto textDocument = qobject_cast<TextDocument *>(document);
+        if (textDocument && textDocument->hasChanged())
+            texts.insert(textDocument->fileName(), textDocument->text());
     }
+    return texts;
+}
 
-    const QString output = process.readAllStandardOutput();
-
-    const QString errorOutput = process.readAllStandardError();
-    if (!errorOutput.isEmpty()) {
-        spdlog::error("Ripgrep error: {}", errorOutput);
-    }
+/*!
+ * \qmlmethod array<object> Project::queryInFiles(array<string> extensions, string query)
+ * Runs the Tree-sitter `query` on all files with an extension from `extensions` in the current project.
+ * Returns a list of matches (QVariantMaps) with the file name ("file") and the captures ("captures").
+ * Each capture has a "name", a "start" and "end" position, a "line" and "column" (1-based) and a "text".
+ *
+ * The files are parsed and queried in parallel, without opening them in Knut, which makes it a lot faster than
+ * opening each file to query it. Files already opened and changed are queried using their current text.
+ *
+ * ```js
+ * let matches = Project.queryInFiles(["cpp", "h"], "(function_definition declarator: (_) @name)");
+ * for (let match of matches) {
+ *     for (let capture of match.captures)
+ *         Message.log(match.file + ":" + capture.line + " " + capture.text);
+ * }
+ * ```
+ *
+ * Also see: [Tree-sitter in Knut](../../getting-started/treesitter.md)
+ */
+QVariantList Project::queryInFiles(const QStringList &extensions, const QString &query)
+{
+    LOG(extensions, LOG_ARG("query", query));
 
-    const auto lines = output.split('\n', Qt::SkipEmptyParts);
-    result.reserve(lines.count() * 3);
-    for (const QString &line : lines) {
-        QString currentLine = line;
-        currentLine.replace('\\', '/');
-        const auto parts = currentLine.split(':');
-
-        QString filePath;
-        int offset = 0;
-        if (parts.size() > 2 && parts[0].length() == 1 && parts[1].startsWith('/')) {
-            filePath = parts[0] + ':' + parts[1];
-            offset = 2;
-        } else {
-            filePath = parts[0];
-            offset = 1;
-        }
+    const auto matches = Core::queryInFiles(allFilesWithExtensions(extensions, FullPath), query, changedTexts());
 
-        if (parts.size() > offset + 1) {
-            QVariantMap matchResult;
-            matchResult.insert("file", filePath);
-            matchResult.insert("line", parts[offset].toInt());
-            matchResult.insert("column", parts[offset + 1].toInt());
-            result.append(matchResult);
+    QVariantList result;
+    result.reserve(matches.size());
+    for (const auto &match : matches) {
+        QVariantList captures;
+        captures.reserve(match.captures.size());
+        for (const auto &capture : match.captures) {
+            captures.append(QVariantMap {{"name", capture.name},
+                                         {"start", capture.start},
+                                         {"end", capture.end},
+                                         {"line", capture.line},
+                                         {"column", capture.column},
+                                         {"text", capture.text}});
         }
+        result.append(QVariantMap {{"file", match.fileName}, {"captures", captures}});
     }
     return result;
 }
 
 /*!
- * \qmlmethod bool Project::isFindInFilesAvailable()
- * Checks if the ripgrep (rg) command-line tool is available on the system.
+ * \qmlmethod array<object> Project::findSymbol(string name)
+ * Finds the C++ symbols (classes, functions, members and enums) named `name` in all files of the current project.
+ * Returns a list of results (QVariantMaps) with the file name ("file"), the fully qualified name ("name"), the kind
+ * ("kind", see `Symbol.kind`), the range of the symbol ("start", "end"), its selection range ("selectionStart",
+ * "selectionEnd"), and the position of the selection range ("line", "column").
+ *
+ * `name` can be partially qualified: both `InitInstance` and `CTutorialApp::InitInstance` find
+ * `CTutorialApp::InitInstance`. The search is case sensitive.
+ *
+ * ```js
+ * for (let result of Project.findSymbol("CTutorialApp::InitInstance"))
+ *     Message.log(result.file + ":" + result.line + " " + result.name);
+ * ```
+ *
+ * The symbols are the same as `CodeDocument.symbols()`, found without opening any document. They are stored in an
+ * index on disk, in the `.knut` directory of the project: the first call parses all C++ files in parallel, the next
+ * ones only parse the files changed since. Changes not saved are not taken into account, and files changed outside of
+ * Knut are only parsed again when they are added or removed, or when the project is opened again.
  */
-bool Project::isFindInFilesAvailable() const
+QVariantList Project::findSymbol(const QString &name)
 {
-    QString rgPath = QStandardPaths::findExecutable("rg");
-    if (rgPath.isEmpty()) {
-        return false;
-    } else {
-        return true;
+    LOG(name);
+
+    if (m_root.isEmpty())
+        return {};
+
+    updateSymbolIndex();
+
+    QVariantList result;
+    const auto locations = m_symbolIndex->find(name);
+    result.reserve(locations.size());
+    for (const auto &location : locations) {
+        result.append(QVariantMap {{"file", location.fileName},
+                                   {"name", location.name},
+                                   {"kind", location.kind},
+                                   {"start", location.start},
+                                   {"end", location.end},
+                                   {"selectionStart", location.selectionStart},
+                                   {"selectionEnd", location.selectionEnd},
+                                   {"line", location.line},
+                                   {"column", location.column}});
+    }
+    return result;
+}
+
+void Project::updateSymbolIndex()
+{
+    const auto savedFiles = std::exchange(m_symbolIndexSavedFiles, {});
+    if (m_symbolIndex && !m_symbolIndexOutdated) {
+        const QDir root(m_root);
+        QStringList fileNames;
+        for (const auto &fileName : savedFiles) {
+            const auto relativePath = root.relativeFilePath(fileName);
+            if (!relativePath.startsWith(".."))
+                fileNames.push_back(relativePath);
+        }
+        if (!fileNames.isEmpty())
+            m_symbolIndex->updateFiles(fileNames);
+        return;
+    }
+
+    if (!m_symbolIndex)
+        m_symbolIndex = std::make_unique<SymbolIndex>(m_root, Settings::instance()->symbolIndexFilePath());
+    m_symbolIndexOutdated = false;
+
+    const auto mimeTypes = Settings::instance()->value<std::map<std::string, Document::Type>>(Settings::MimeTypes);
+    QStringList extensions;
+    for (const auto &[extension, type] : mimeTypes) {
+        if (type == Document::Type::Cpp)
+            extensions.push_back(QString::fromStdString(extension));
     }
+    m_symbolIndex->update(m_fileIndex->filesWithExtensions(extensions));
 }
 
 } // namespace Core
@@ -12,7 +12,11 @@
 
 #include "document.h"
 
+#include <QHash>
 #include <QObject>
+#include <QSet>
+#include <list>
+#include <memory>
 #include <unordered_map>
 
 namespace Lsp {
@@ -21,6 +25,9 @@ class Client;
 
 namespace Core {
 
+class FileIndex;
+class SymbolIndex;
+
 class Project : public QObject
 {
     Q_OBJECT
@@ -55,6 +62,11 @@ public:
                                                    Core::Project::PathType type = RelativeToRoot);
     Q_INVOKABLE QVariantList findInFiles(const QString &pattern) const;
     Q_INVOKABLE bool isFindInFilesAvailable() const;
+    Q_INVOKABLE QVariantList queryInFiles(const QStringList &extensions, const QString &query);
+    Q_INVOKABLE QVariantList findSymbol(const QString &name);
+    Q_INVOKABLE QVariantMap memoryUsage() const;
+
+    QHash<QString, QString> changedTexts() const;
 
 public slots:
     Core::Document *get(const QString &fileName);
@@ -74,12 +86,43 @@ private:
 
     Core::Document *getDocument(QString fileName, bool moveToBack = false);
     Lsp::Client *getClient(Document::Type type);
+    void addDocument(Document *document);
+    void markDocumentUsed(Document *document);
+    void applyMemoryBudget();
+    QStringList toPathType(QStringList files, PathType type) const;
+    void updateSymbolIndex();
 
 private:
     inline static Project *m_instance = nullptr;
 
     QString m_root;
-    QList<Document *> m_documents;
+    FileIndex *const m_fileIndex;
+    // Created on first use, updated when files are added, removed or saved
+    std::unique_ptr<SymbolIndex> m_symbolIndex;
+    bool m_symbolIndexOutdated = true;
+    // C++ documents saved since the last update, only those are indexed again
+    QSet<QString> m_symbolIndexSavedFiles;
+    // Documents are kept in two lists, the least recent first: in the order they have been opened (see openPrevious),
+    // and in the order they have been last requested (see applyMemoryBudget). They are indexed by canonical file name.
+    // Documents whose memory has been released are moved out of the second list, until used again: their memory
+    // usage is kept, so applyMemoryBudget only goes through the documents not released yet.
+    struct DocumentEntry
+    {
+        std::list<Document *>::iterator openedIt;
+        std::list<Document *>::iterator usedIt;
+        QString fileName;
+        bool released = false;
+        qint64 releasedMemory = 0;
+    };
+    std::list<Document *> m_openedDocuments;
+    std::list<Document *> m_usedDocuments;
+    std::list<Document *> m_releasedDocuments;
+    qint64 m_releasedMemory = 0;
+    std::unordered_map<Document *, DocumentEntry> m_documentEntries;
+    std::unordered_map<QString, Document *> m_documentsByName;
+    // Cache for documents(), updated when the order of the documents changes
+    mutable QList<Document *> m_documents;
+    mutable bool m_documentsChanged = false;
     Core::Document *m_current = nullptr;
     std::unordered_map<Core::Document::Type, Lsp::Client *> m_lspClients;
 };
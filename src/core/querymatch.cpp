@@ -10,6 +10,7 @@
 
 #include "querymatch.h"
 #include "codedocument.h"
+#include "querymatch_p.h"
 #include "rangemark.h"
 #include "textdocument.h"
 #include "utils/log.h"
@@ -83,26 +84,37 @@ QString QueryCapture::toString() const
  */
 
 QueryMatch::QueryMatch(TextDocument &document, const treesitter::QueryMatch &match)
+    : m_patternIndex(static_cast<int>(match.patternIndex()))
 {
     const auto captures = match.captures();
+    QList<QueryMatchPrivate::RawCapture> rawCaptures;
+    rawCaptures.reserve(captures.size());
     for (const auto &capture : captures) {
-        const auto name = match.query()->captureAt(capture.id).name;
-
         const auto &node = capture.node;
-        const auto range = document.createRangeMark(node.startPosition(), node.endPosition());
-
-        m_captures.emplace_back(QueryCapture {.name = name, .range = range});
+        rawCaptures.emplace_back(QueryMatchPrivate::RawCapture {.name = match.query()->captureAt(capture.id).name,
+                                                                .start = static_cast<int>(node.startPosition()),
+                                                                .end = static_cast<int>(node.endPosition())});
     }
+    d = QueryMatchPrivate::create(&document, std::move(rawCaptures));
 }
 
 const QList<QueryCapture> &QueryMatch::captures() const
 {
-    return m_captures;
+    static const QList<QueryCapture> empty;
+    return d ? d->captures() : empty;
+}
+
+/**
+ * \brief Returns the index of the pattern of the query matched, -1 for an empty match.
+ */
+int QueryMatch::patternIndex() const
+{
+    return m_patternIndex;
 }
 
 bool QueryMatch::isEmpty() const
 {
-    return m_captures.isEmpty();
+    return !d || d->size() == 0;
 }
 
 /*!
@@ -113,7 +125,7 @@ Core::RangeMarkList QueryMatch::getAll(const QString &name) const
 {
     Core::RangeMarkList result;
 
-    for (const auto &capture : m_captures) {
+    for (const auto &capture : captures()) {
         if (capture.name == name)
             result.emplace_back(capture.range);
     }
@@ -133,7 +145,7 @@ Core::RangeMarkList QueryMatch::getAllInRange(const QString &name, const Core::R
     auto toRange = [](const QueryCapture &capture) {
         return capture.range;
     };
-    return kdalgorithms::filtered_transformed(m_captures, toRange, captureMatch);
+    return kdalgorithms::filtered_transformed(captures(), toRange, captureMatch);
 }
 
 /*!
@@ -154,7 +166,7 @@ Core::RangeMarkList QueryMatch::getAllInRange(const QString &name, const Core::R
  */
 RangeMark QueryMatch::get(const QString &name) const
 {
-    for (const auto &capture : m_captures) {
+    for (const auto &capture : captures()) {
         if (capture.name == name)
             return capture.range;
     }
@@ -171,7 +183,7 @@ Core::RangeMark QueryMatch::getInRange(const QString &name, const Core::RangeMar
     auto captureMatch = [&name, &range](const QueryCapture &capture) {
         return capture.name == name && range.contains(capture.range);
     };
-    auto result = kdalgorithms::find_if(m_captures, captureMatch);
+    auto result = kdalgorithms::find_if(captures(), captureMatch);
     if (result)
         return result->range;
     return {};
@@ -232,7 +244,53 @@ Core::QueryMatchList QueryMatch::queryIn(const QString &capture, const QString &
 
 QString QueryMatch::toString() const
 {
-    return QString("QueryMatch{%1}").arg(m_captures.size());
+    return QString("QueryMatch{%1}").arg(d ? d->size() : 0);
+}
+
+QueryMatchPrivate::QueryMatchPrivate(TextDocument *document, QList<RawCapture> rawCaptures)
+    : m_document(document)
+    , m_revision(document->m_textRevision)
+    , m_rawCaptures(std::move(rawCaptures))
+{
+}
+
+std::shared_ptr<QueryMatchPrivate> QueryMatchPrivate::create(TextDocument *document, QList<RawCapture> rawCaptures)
+{
+    auto d = std::make_shared<QueryMatchPrivate>(document, std::move(rawCaptures));
+    if (!d->m_rawCaptures.isEmpty())
+        document->m_marks->addUntracked(d);
+    return d;
+}
+
+qsizetype QueryMatchPrivate::size() const
+{
+    return m_rawCaptures.size();
+}
+
+const QList<QueryCapture> &QueryMatchPrivate::captures()
+{
+    track();
+    return m_captures;
+}
+
+void QueryMatchPrivate::track()
+{
+    if (m_tracked)
+        return;
+    m_tracked = true;
+
+    // The raw ranges are only valid for the revision of the document they were found in
+    const bool isValid = m_document && m_document->m_textRevision == m_revision;
+    if (m_document && !isValid)
+        spdlog::error("{}: the document changed since the query was run", FUNCTION_NAME);
+
+    m_captures.reserve(m_rawCaptures.size());
+    for (const auto &capture : std::as_const(m_rawCaptures)) {
+        m_captures.emplace_back(QueryCapture {
+            .name = capture.name,
+            .range = isValid ? RangeMark(m_document, capture.start, capture.end) : RangeMark(),
+        });
+    }
 }
 
 } // namespace Core
@@ -14,6 +14,8 @@
 
 #include <QObject>
 
+#include <memory>
+
 namespace treesitter {
 class QueryMatch;
 }
@@ -50,6 +52,7 @@ public:
 
     const QList<QueryCapture> &captures() const;
     bool isEmpty() const;
+    int patternIndex() const;
 
     // Access to captures
     Q_INVOKABLE Core::RangeMark get(const QString &name) const;
@@ -75,7 +78,9 @@ public:
     Q_INVOKABLE QString toString() const;
 
 private:
-    QList<QueryCapture> m_captures;
+    // QueryMatch is a shared_ptr to a QueryMatchPrivate, the captures are created lazily.
+    std::shared_ptr<class QueryMatchPrivate> d = nullptr;
+    int m_patternIndex = -1;
 };
 
 using QueryMatchList = QList<Core::QueryMatch>;
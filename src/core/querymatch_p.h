@@ -0,0 +1,59 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#pragma once
+
+#include "mark_p.h"
+#include "querymatch.h"
+
+#include <QList>
+#include <QPointer>
+#include <QString>
+
+namespace Core {
+
+class TextDocument;
+
+/**
+ * Captures of a QueryMatch, materialized lazily.
+ *
+ * Creating the RangeMarks of all the captures is expensive for queries with a lot of matches, and most of them are
+ * usually never used. The captures are kept as raw ranges, valid for the revision of the document they were found in:
+ * the RangeMarks are only created when the captures are accessed, or before the document is changed.
+ */
+class QueryMatchPrivate : public UntrackedMarks
+{
+public:
+    struct RawCapture
+    {
+        QString name;
+        int start;
+        int end;
+    };
+
+    // Unfortunately this needs to be public, as otherwise std::make_shared can't access it
+    QueryMatchPrivate(TextDocument *document, QList<RawCapture> rawCaptures);
+
+    static std::shared_ptr<QueryMatchPrivate> create(TextDocument *document, QList<RawCapture> rawCaptures);
+
+    qsizetype size() const;
+    const QList<QueryCapture> &captures();
+
+    void track() override;
+
+private:
+    QPointer<TextDocument> m_document;
+    int m_revision = 0;
+    QList<RawCapture> m_rawCaptures;
+    QList<QueryCapture> m_captures;
+    bool m_tracked = false;
+};
+
+} // namespace Core
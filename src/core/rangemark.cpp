@@ -51,16 +51,13 @@ namespace Core {
 
 RangeMarkPrivate::RangeMarkPrivate(TextDocument *editor, int start, int end)
     : m_editor(editor)
-    , m_start(start)
-    , m_end(end)
+    , m_start(editor->m_marks.get(), std::min(start, end))
+    , m_end(editor->m_marks.get(), std::max(start, end))
 {
-    ensureInvariant();
+    if (start > end)
+        spdlog::warn("{}: invariant violated: start > end ({} > {})", FUNCTION_NAME, start, end);
 
-    Q_ASSERT(editor);
     Q_ASSERT(isValid());
-
-    auto document = editor->textEdit()->document();
-    connect(document, &QTextDocument::contentsChange, this, &RangeMarkPrivate::update);
 }
 
 bool RangeMarkPrivate::checkEditor() const
@@ -72,24 +69,9 @@ bool RangeMarkPrivate::checkEditor() const
     return true;
 }
 
-void RangeMarkPrivate::ensureInvariant()
-{
-    if (m_start > m_end) {
-        spdlog::warn("{}: invariant violated: m_start > m_end ({} > {})", FUNCTION_NAME, m_start, m_end);
-        std::swap(m_start, m_end);
-    }
-}
-
-void RangeMarkPrivate::update(int from, int charsRemoved, int charsAdded)
-{
-    Mark::updateMark(m_start, from, charsRemoved, charsAdded);
-    Mark::updateMark(m_end, from, charsRemoved, charsAdded);
-    ensureInvariant();
-}
-
 bool RangeMarkPrivate::isValid() const
 {
-    return checkEditor() && m_start >= 0 && m_end >= 0;
+    return checkEditor() && m_start.value() >= 0 && m_end.value() >= 0;
 }
 
 RangeMark::RangeMark(TextDocument *editor, int start, int end)
@@ -104,12 +86,12 @@ bool RangeMark::isValid() const
 
 int RangeMark::start() const
 {
-    return d ? d->m_start : -1;
+    return d ? d->m_start.value() : -1;
 }
 
 int RangeMark::end() const
 {
-    return d ? d->m_end : -1;
+    return d ? d->m_end.value() : -1;
 }
 
 int RangeMark::length() const
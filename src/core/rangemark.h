@@ -19,8 +19,8 @@ class TextDocument;
 
 // RangeMark is shared_ptr to a RangeMarkPrivate.
 // This way we can ensure that a RangeMark is easy to copy and move
-// around, whilst still ensuring the QObject that listens to the
-// changes of the TextDocument is correctly deleted both from QML and C++.
+// around, whilst still ensuring the position is removed from the
+// document's MarkRegistry once the last copy is deleted, both from QML and C++.
 class RangeMark
 {
     Q_GADGET
@@ -14,6 +14,7 @@
 #include "scriptprogressdialog.h"
 #include "scriptrunner.h"
 #include "settings.h"
+#include "treesitter/query.h"
 #include "utils/log.h"
 
 #include <definition.h>
@@ -29,14 +30,18 @@
 #include <QCoreApplication>
 #include <QDialogButtonBox>
 #include <QDoubleSpinBox>
+#include <QElapsedTimer>
+#include <QEvent>
 #include <QFile>
 #include <QFileInfo>
+#include <QJSEngine>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonValue>
 #include <QLineEdit>
 #include <QMessageBox>
 #include <QPlainTextEdit>
+#include <QPointer>
 #include <QPushButton>
 #include <QQmlContext>
 #include <QRadioButton>
@@ -45,6 +50,10 @@
 #include <QToolButton>
 #include <QUiLoader>
 #include <QVBoxLayout>
+#include <QWindow>
+#include <algorithm>
+#include <memory>
+#include <utility>
 #include <spdlog/sinks/qt_sinks.h>
 
 namespace Core {
@@ -243,7 +252,7 @@ void ScriptDialogItem::firstStep(const QString &firstStep)
     showProgressDialog();
     m_currentStep = 0;
     nextStep(firstStep);
-    updateProgress();
+    processProgressEvents();
 }
 
 /**
@@ -313,6 +322,12 @@ void ScriptDialogItem::runNextStep()
     const auto done = result.property("done").toBool();
     m_nextStepTitle = result.property("value").toString();
 
+    if (m_cancelled) {
+        spdlog::warn("{}: {} cancelled, the script is stopped.", FUNCTION_NAME, m_currentStepTitle);
+        finishScript();
+        return;
+    }
+
     spdlog::info("{}: {} done.", FUNCTION_NAME, m_currentStepTitle);
 
     if (done) {
@@ -487,10 +502,11 @@ void ScriptDialogItem::showProgressDialog()
 
     connect(m_progressDialog, &ScriptProgressDialog::apply, this, &ScriptDialogItem::continueScript);
     connect(m_progressDialog, &ScriptProgressDialog::abort, this, &ScriptDialogItem::abortScript);
+    connect(m_progressDialog, &ScriptProgressDialog::cancel, this, &ScriptDialogItem::cancelScript);
 
     m_progressDialogs.push_back(m_progressDialog);
     m_progressDialog->show();
-    updateProgress();
+    processProgressEvents();
 }
 
 void ScriptDialogItem::cleanupProgressDialog()
@@ -500,16 +516,131 @@ void ScriptDialogItem::cleanupProgressDialog()
         m_progressDialog->deleteLater();
         m_progressDialogs.removeAll(m_progressDialog);
         m_progressDialog = nullptr;
+        if (m_progressDialogs.empty())
+            postDeferredInputEvents();
     }
 }
 
 void ScriptDialogItem::updateProgress()
+{
+    if (m_progressDialogs.empty())
+        return;
+
+    // Processing the events is expensive compared to most of the work done between two calls (a query match, a log...)
+    // Only do it often enough to keep the UI responsive, the clock is monotonic and cheap to read.
+    static QElapsedTimer timer;
+    if (timer.isValid() && timer.elapsed() < ProgressInterval)
+        return;
+    processProgressEvents();
+    timer.start();
+}
+
+// User input received while a script is running, delivered once the script is finished
+struct DeferredInputEvent
+{
+    QPointer<QObject> receiver;
+    std::unique_ptr<QEvent> event;
+};
+
+static std::vector<DeferredInputEvent> &deferredInputEvents()
+{
+    static std::vector<DeferredInputEvent> events;
+    return events;
+}
+
+static void postDeferredInputEvents()
+{
+    for (auto &deferred : std::exchange(deferredInputEvents(), {})) {
+        if (deferred.receiver)
+            QCoreApplication::postEvent(deferred.receiver, deferred.event.release());
+    }
+}
+
+/**
+ * Filters the user input while a script is running: only the mouse events of the progress dialogs are accepted, so
+ * the cancel button can be clicked. The other input events are deferred until the script is finished, like they were
+ * when processing the events with QEventLoop::ExcludeUserInputEvents.
+ */
+class ProgressInputFilter : public QObject
+{
+public:
+    explicit ProgressInputFilter(const QList<ScriptProgressDialog *> &dialogs)
+        : m_dialogs(dialogs)
+    {
+    }
+
+    bool eventFilter(QObject *watched, QEvent *event) override
+    {
+        switch (event->type()) {
+        case QEvent::MouseButtonPress:
+        case QEvent::MouseButtonRelease:
+        case QEvent::MouseButtonDblClick:
+        case QEvent::MouseMove:
+            return !isInProgressDialog(watched) && defer(watched, event);
+        default:
+            return event->isInputEvent() && defer(watched, event);
+        }
+    }
+
+private:
+    bool isInProgressDialog(QObject *object) const
+    {
+        // Mouse events are sent to the window first, then to the widget
+        const auto widget = qobject_cast<QWidget *>(object);
+        return std::ranges::any_of(m_dialogs, [&](ScriptProgressDialog *dialog) {
+            return object == dialog->windowHandle() || (widget && widget->window() == dialog);
+        });
+    }
+
+    static bool defer(QObject *watched, QEvent *event)
+    {
+        // Input events are sent to the window first, which forwards them to its widgets: only the ones for the window
+        // are kept, the forwarded ones are sent again when the window gets the deferred event. Mouse moves are
+        // outdated by then, and are dropped.
+        if (event->type() != QEvent::MouseMove && qobject_cast<QWindow *>(watched))
+            deferredInputEvents().push_back({.receiver = watched, .event = std::unique_ptr<QEvent>(event->clone())});
+        return true;
+    }
+
+    const QList<ScriptProgressDialog *> &m_dialogs;
+};
+
+void ScriptDialogItem::processProgressEvents()
 {
     if (!m_progressDialogs.empty()) {
-        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
+        ProgressInputFilter filter(m_progressDialogs);
+        qApp->installEventFilter(&filter);
+        QCoreApplication::processEvents();
+        qApp->removeEventFilter(&filter);
     }
 }
 
+static treesitter::CancellationToken &currentCancellationToken()
+{
+    static treesitter::CancellationToken token;
+    return token;
+}
+
+treesitter::CancellationToken ScriptDialogItem::cancellationToken()
+{
+    return currentCancellationToken();
+}
+
+void ScriptDialogItem::cancelScript()
+{
+    spdlog::warn("{}: Script cancelled.", FUNCTION_NAME);
+    m_cancelled = true;
+
+    // The running queries return early: interrupt the JavaScript engine too, so the script stops as soon as it
+    // resumes, instead of going on with incomplete results.
+    auto &token = currentCancellationToken();
+    token.cancel();
+    // Only the operations running now are cancelled, the next ones use a new token
+    token = treesitter::CancellationToken();
+    if (auto engine = qjsEngine(this))
+        engine->setInterrupted(true);
+}
+
 QObject *ScriptDialogItem::data() const
 {
     return m_data;
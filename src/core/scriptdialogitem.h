@@ -17,6 +17,10 @@
 #include <nlohmann/json_fwd.hpp>
 #include <vector>
 
+namespace treesitter {
+class CancellationToken;
+}
+
 class ScriptProgressDialog;
 class QTextDocument;
 
@@ -48,7 +52,13 @@ public:
     // This method is used to redraw the application while a script is running
     // Long-running scripts will otherwise block the GUI, which may look like Knut is hung up.
     // This method should be called in regular intervals to ensure visual progress.
+    // It can be called very often: the events are processed at most once every ProgressInterval milliseconds.
     static void updateProgress();
+    static constexpr int ProgressInterval = 16;
+
+    // Token cancelled by the cancel button of the progress dialog, for the operations (queries) running at that time.
+    // The script itself is stopped too, its JavaScript engine is interrupted.
+    static treesitter::CancellationToken cancellationToken();
 
     bool isInteractive() const;
     void setInteractive(bool interactive);
@@ -82,6 +92,8 @@ private:
     void runNextStep();
     void showProgressDialog();
     void cleanupProgressDialog();
+    static void processProgressEvents();
+    void cancelScript();
     void setUiFile(const QString &fileName);
     void createProperties(QWidget *dialogWidget);
     void changeValue(const QString &key, const QVariant &value);
@@ -109,6 +121,7 @@ private:
 
     std::optional<QJSValue> m_stepGenerator;
     bool m_interactive = true;
+    bool m_cancelled = false;
 };
 
 } // namespace Core
@@ -9,6 +9,7 @@
 */
 
 #include "scriptmanager.h"
+#include "directorywalker.h"
 #include "logger.h"
 #include "scriptmodel.h"
 #include "scriptrunner.h"
@@ -16,7 +17,6 @@
 #include "utils/log.h"
 
 #include <QDir>
-#include <QDirIterator>
 #include <QFile>
 #include <QFileInfo>
 #include <QFileSystemWatcher>
@@ -115,12 +115,10 @@ void ScriptManager::addScript(const QString &fileName)
 
 static QStringList scriptListFromDir(const QString &path)
 {
-    const QStringList filter {"*.js", "*.qml"};
-    QDirIterator it(path, filter, QDir::Files);
-    QStringList files;
-    files.reserve(filter.count());
-    while (it.hasNext())
-        files << it.next();
+    const DirectoryWalker walker(path, {.nameFilters = {"*.js", "*.qml"}, .recursive = false, .useGitIgnore = false});
+    QStringList files = walker.files();
+    for (auto &file : files)
+        file = path + '/' + file;
     return files;
 }
 
@@ -24,6 +24,7 @@ ScriptProgressDialog::ScriptProgressDialog(QWidget *parent)
     ui->logsWidget->hide();
     connect(ui->buttonBox, &QDialogButtonBox::accepted, this, &ScriptProgressDialog::apply);
     connect(ui->buttonBox, &QDialogButtonBox::rejected, this, &ScriptProgressDialog::abort);
+    connect(ui->cancelButton, &QPushButton::clicked, this, &ScriptProgressDialog::cancel);
 }
 
 ScriptProgressDialog::~ScriptProgressDialog() = default;
@@ -63,6 +64,8 @@ int ScriptProgressDialog::value() const
 void ScriptProgressDialog::setReadOnly(bool readOnly)
 {
     ui->buttonBox->setEnabled(!readOnly);
+    // The running operations can only be cancelled while the script is running
+    ui->cancelButton->setEnabled(readOnly);
 }
 
 QPlainTextEdit *ScriptProgressDialog::logsWidget()
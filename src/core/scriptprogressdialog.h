@@ -40,6 +40,7 @@ public:
 signals:
     void apply();
     void abort();
+    void cancel();
 
 private:
     std::unique_ptr<Ui::ScriptProgressDialog> ui;
@@ -171,6 +171,16 @@ ScriptRunner::ScriptRunner(QObject *parent)
 
 ScriptRunner::~ScriptRunner() = default;
 
+static void closeEditTransactions()
+{
+    if (auto project = Project::instance()) {
+        for (auto document : project->documents()) {
+            if (auto textDocument = qobject_cast<TextDocument *>(document))
+                textDocument->closeEditTransactions();
+        }
+    }
+}
+
 QVariant ScriptRunner::runScript(const QString &fileName, nlohmann::json &&data,
                                  const std::function<void()> &endCallback)
 {
@@ -186,6 +196,8 @@ QVariant ScriptRunner::runScript(const QString &fileName, nlohmann::json &&data,
 
         // Run the script
         auto engine = getEngine(fullName);
+        // A script may end in the middle of an edit transaction, e.g. after an exception
+        connect(engine, &QObject::destroyed, this, closeEditTransactions);
         if (endCallback)
             connect(engine, &QObject::destroyed, this, endCallback);
 
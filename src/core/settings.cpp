@@ -13,6 +13,7 @@
 #include "rcdocument.h"
 #include "scriptmanager.h"
 
+#include <QCryptographicHash>
 #include <QDir>
 #include <QFile>
 #include <QStandardPaths>
@@ -103,8 +104,9 @@ void Settings::loadProjectSettings(const QString &rootDir)
     if (loadJsonDataStatus.jsonData) {
         m_projectSettings = loadJsonDataStatus.jsonData.value();
         m_settings.merge_patch(m_projectSettings);
-        emit settingsLoaded();
     }
+    // The base settings are loaded again, the settings may have changed even without project settings
+    emit settingsLoaded();
 }
 
 void Settings::triggerLog(const Utils::LoadJsonStatus &loadJsonStatus, const QString &fileName, const QString &caller)
@@ -211,6 +213,18 @@ QString Settings::projectFilePath() const
     return m_projectPath + '/' + SettingsName;
 }
 
+QString Settings::symbolIndexFilePath() const
+{
+    if (isTesting()) {
+        // Don't write into the test data, use a different file for each project. qHash is seeded per process, the
+        // file name needs to be the same from one run to the next.
+        const auto hash = QCryptographicHash::hash(m_projectPath.toUtf8(), QCryptographicHash::Sha1).toHex();
+        return QDir::tempPath() + QString("/knut-%1/symbols.idx").arg(QString::fromLatin1(hash));
+    }
+    // Hidden directory, so it's not part of the project files
+    return m_projectPath + "/.knut/symbols.idx";
+}
+
 QString Settings::logFilePath() const
 {
     // Create QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) directory if it does not exist.
@@ -54,6 +54,10 @@ public:
     static inline constexpr char ScriptPaths[] = "/script_paths";
     static inline constexpr char Tab[] = "/text_editor/tab";
     static inline constexpr char ToggleSection[] = "/toggle_section";
+    static inline constexpr char MemoryBudget[] = "/project/memory_budget";
+    static inline constexpr char ProjectExcludes[] = "/project/excludes";
+    static inline constexpr char TreeSitterProfileQueries[] = "/treesitter/profile_queries";
+    static inline constexpr char TreeSitterProfileFile[] = "/treesitter/profile_file";
 
 public:
     ~Settings() override;
@@ -106,6 +110,7 @@ public:
 
     QString userFilePath() const;
     QString projectFilePath() const;
+    QString symbolIndexFilePath() const;
     QString logFilePath() const;
 
     bool isTesting() const;
@@ -89,6 +89,8 @@ Symbol::Symbol(QObject *parent, const QueryMatch &match, Kind kind)
     , m_range {match.get("range")}
     , m_selectionRange {match.get("selectionRange")}
     , m_queryMatch {match}
+    , m_queryName {m_name}
+    , m_queryKind {kind}
 {
 }
 
@@ -107,15 +109,19 @@ Symbol *Symbol::makeSymbol(QObject *parent, const QueryMatch &match, Kind kind)
     return new Symbol(parent, match, kind);
 }
 
+// The context is always assigned from the name and kind found by the query, so it can be assigned again after the
+// surrounding symbols changed.
 void Symbol::assignContext(const QList<Symbol *> &contexts)
 {
-    auto names = kdalgorithms::transformed<QStringList>(contexts, &Symbol::name);
-    if (!names.isEmpty()) {
-        m_name = names.join("::") + "::" + m_name;
-    }
+    auto names = kdalgorithms::transformed<QStringList>(contexts, [](const Symbol *symbol) {
+        return symbol->m_queryName;
+    });
+    m_name = names.isEmpty() ? m_queryName : names.join("::") + "::" + m_queryName;
+
     auto is_class = [](const auto &symbol) {
-        return symbol->kind() == Kind::Class;
+        return symbol->m_queryKind == Kind::Class;
     };
+    m_kind = m_queryKind;
     if (m_kind == Kind::Function && kdalgorithms::any_of(contexts, is_class)) {
         m_kind = Kind::Method;
     }
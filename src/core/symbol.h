@@ -100,6 +100,10 @@ public:
 private:
     void assignContext(const QList<Symbol *> &contexts);
 
+    // Name and kind as found by the query, before assigning the context
+    QString m_queryName;
+    Kind m_queryKind;
+
     friend class CodeDocument;
     friend class TreeSitterHelper;
 };
@@ -0,0 +1,555 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "symbolindex.h"
+#include "codedocument_p.h"
+#include "cppdocument_p.h"
+#include "filequery.h"
+#include "utils/log.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QSet>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace Core {
+
+namespace {
+
+    constexpr char Magic[4] = {'K', 'S', 'Y', 'M'};
+    constexpr quint32 Version = 1;
+
+    // The index file is made of the header, followed by the files, the symbols (grouped by file), the symbols sorted
+    // by their unqualified name, and the strings (UTF-16) used by the files and the symbols.
+    struct Header
+    {
+        char magic[4];
+        quint32 version;
+        quint32 fileCount;
+        quint32 symbolCount;
+        quint32 stringSize;
+        quint32 padding[3];
+    };
+
+    struct FileRecord
+    {
+        quint32 pathOffset;
+        quint32 pathSize;
+        qint64 modified;
+        qint64 size;
+        quint32 firstSymbol;
+        quint32 symbolCount;
+    };
+
+    struct SymbolRecord
+    {
+        quint32 nameOffset;
+        quint32 nameSize;
+        // Position of the unqualified name in the name
+        quint32 shortNameStart;
+        quint32 file;
+        qint32 kind;
+        qint32 start;
+        qint32 end;
+        qint32 selectionStart;
+        qint32 selectionEnd;
+        qint32 line;
+        qint32 column;
+    };
+
+    static_assert(sizeof(Header) == 32 && sizeof(FileRecord) == 32 && sizeof(SymbolRecord) == 44);
+
+    // View on the data of an index file, which must be valid
+    class IndexView
+    {
+    public:
+        explicit IndexView(const uchar *data)
+            : m_data(data)
+        {
+        }
+
+        const Header &header() const { return *reinterpret_cast<const Header *>(m_data); }
+        std::span<const FileRecord> files() const
+        {
+            return {reinterpret_cast<const FileRecord *>(m_data + sizeof(Header)), header().fileCount};
+        }
+        std::span<const SymbolRecord> symbols() const
+        {
+            return {reinterpret_cast<const SymbolRecord *>(files().data() + files().size()), header().symbolCount};
+        }
+        std::span<const quint32> byShortName() const
+        {
+            return {reinterpret_cast<const quint32 *>(symbols().data() + symbols().size()), header().symbolCount};
+        }
+        QStringView string(quint32 offset, quint32 size) const
+        {
+            const auto *strings = reinterpret_cast<const char16_t *>(byShortName().data() + byShortName().size());
+            return QStringView(strings + offset, size);
+        }
+
+        QStringView path(const FileRecord &file) const { return string(file.pathOffset, file.pathSize); }
+        QStringView name(const SymbolRecord &symbol) const { return string(symbol.nameOffset, symbol.nameSize); }
+        QStringView shortName(quint32 index) const
+        {
+            const auto &symbol = symbols()[index];
+            return string(symbol.nameOffset + symbol.shortNameStart, symbol.nameSize - symbol.shortNameStart);
+        }
+
+        static qint64 dataSize(const Header &header)
+        {
+            return sizeof(Header) + qint64(header.fileCount) * sizeof(FileRecord)
+                + qint64(header.symbolCount) * (sizeof(SymbolRecord) + sizeof(quint32))
+                + qint64(header.stringSize) * sizeof(char16_t);
+        }
+
+        static bool isValid(const uchar *data, qint64 size)
+        {
+            if (size < static_cast<qint64>(sizeof(Header)))
+                return false;
+            const IndexView view(data);
+            const auto &header = view.header();
+            if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version
+                || dataSize(header) != size)
+                return false;
+
+            auto inStrings = [&header](quint32 offset, quint32 size) {
+                return qint64(offset) + size <= header.stringSize;
+            };
+            for (const auto &file : view.files()) {
+                if (!inStrings(file.pathOffset, file.pathSize)
+                    || qint64(file.firstSymbol) + file.symbolCount > header.symbolCount)
+                    return false;
+            }
+            for (const auto &symbol : view.symbols()) {
+                if (!inStrings(symbol.nameOffset, symbol.nameSize) || symbol.shortNameStart > symbol.nameSize
+                    || symbol.file >= header.fileCount)
+                    return false;
+            }
+            return std::ranges::all_of(view.byShortName(), [&header](quint32 index) {
+                return index < header.symbolCount;
+            });
+        }
+
+    private:
+        const uchar *m_data;
+    };
+
+    struct IndexedSymbol
+    {
+        QString name;
+        Symbol::Kind kind;
+        int start;
+        int end;
+        int selectionStart;
+        int selectionEnd;
+        int line;
+        int column;
+    };
+
+    struct IndexedFile
+    {
+        QString path;
+        qint64 modified = 0;
+        qint64 size = 0;
+        std::vector<IndexedSymbol> symbols;
+    };
+
+}
+
+static std::optional<IndexedSymbol> toIndexedSymbol(const FileQueryMatch &match, Symbol::Kind kind)
+{
+    // Same as QueryMatch::get, the first capture is used
+    auto capture = [&match](const QString &name) -> const FileQueryCapture * {
+        auto it = std::ranges::find(match.captures, name, &FileQueryCapture::name);
+        return it != match.captures.cend() ? &*it : nullptr;
+    };
+
+    const auto *name = capture("name");
+    const auto *range = capture("range");
+    if (!name || !range)
+        return {};
+    const auto *selection = capture("selectionRange");
+    if (!selection)
+        selection = range;
+
+    if (kind == Symbol::Kind::Function)
+        kind = cppFunctionKind(capture("return") != nullptr, name->text);
+    return IndexedSymbol {.name = name->text,
+                          .kind = kind,
+                          .start = range->start,
+                          .end = range->end,
+                          .selectionStart = selection->start,
+                          .selectionEnd = selection->end,
+                          .line = selection->line,
+                          .column = selection->column};
+}
+
+// Same as TreeSitterHelper::assignSymbolContexts: the names of the symbols surrounding a symbol, from the outermost
+// one, are prepended to its name.
+static void assignContexts(std::vector<IndexedSymbol> &symbols)
+{
+    std::ranges::stable_sort(symbols, {}, &IndexedSymbol::start);
+
+    std::vector<IndexedSymbol> result = symbols;
+    assignSymbolContexts(
+        symbols, std::mem_fn(&IndexedSymbol::start), std::mem_fn(&IndexedSymbol::end),
+        [&](qsizetype index, const std::vector<qsizetype> &contexts) {
+            if (contexts.empty())
+                return;
+
+            QStringList names;
+            for (auto context : contexts)
+                names.push_back(symbols[context].name);
+            result[index].name = names.join("::") + "::" + symbols[index].name;
+            if (symbols[index].kind == Symbol::Kind::Function && std::ranges::any_of(contexts, [&](qsizetype context) {
+                    return symbols[context].kind == Symbol::Kind::Class;
+                }))
+                result[index].kind = Symbol::Kind::Method;
+        });
+    symbols = std::move(result);
+}
+
+static QByteArray serialize(const std::vector<IndexedFile> &files)
+{
+    QString strings;
+    QHash<QString, quint32> stringOffsets;
+    auto addString = [&](const QString &string) {
+        auto it = stringOffsets.constFind(string);
+        if (it == stringOffsets.cend()) {
+            it = stringOffsets.insert(string, static_cast<quint32>(strings.size()));
+            strings += string;
+        }
+        return *it;
+    };
+
+    std::vector<FileRecord> fileRecords;
+    fileRecords.reserve(files.size());
+    std::vector<SymbolRecord> symbolRecords;
+    for (const auto &file : files) {
+        fileRecords.push_back({.pathOffset = addString(file.path),
+                               .pathSize = static_cast<quint32>(file.path.size()),
+                               .modified = file.modified,
+                               .size = file.size,
+                               .firstSymbol = static_cast<quint32>(symbolRecords.size()),
+                               .symbolCount = static_cast<quint32>(file.symbols.size())});
+        for (const auto &symbol : file.symbols) {
+            const auto separator = symbol.name.lastIndexOf("::");
+            symbolRecords.push_back({.nameOffset = addString(symbol.name),
+                                     .nameSize = static_cast<quint32>(symbol.name.size()),
+                                     .shortNameStart = separator == -1 ? 0u : static_cast<quint32>(separator + 2),
+                                     .file = static_cast<quint32>(fileRecords.size() - 1),
+                                     .kind = symbol.kind,
+                                     .start = symbol.start,
+                                     .end = symbol.end,
+                                     .selectionStart = symbol.selectionStart,
+                                     .selectionEnd = symbol.selectionEnd,
+                                     .line = symbol.line,
+                                     .column = symbol.column});
+        }
+    }
+
+    // Stable sort, so symbols with the same name stay in the order of the files
+    std::vector<quint32> byShortName(symbolRecords.size());
+    std::iota(byShortName.begin(), byShortName.end(), 0);
+    auto shortName = [&](quint32 index) {
+        const auto &symbol = symbolRecords[index];
+        return QStringView(strings).mid(symbol.nameOffset + symbol.shortNameStart,
+                                        symbol.nameSize - symbol.shortNameStart);
+    };
+    std::ranges::stable_sort(byShortName, [&](quint32 left, quint32 right) {
+        return shortName(left).compare(shortName(right)) < 0;
+    });
+
+    Header header {.magic = {},
+                   .version = Version,
+                   .fileCount = static_cast<quint32>(fileRecords.size()),
+                   .symbolCount = static_cast<quint32>(symbolRecords.size()),
+                   .stringSize = static_cast<quint32>(strings.size()),
+                   .padding = {}};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+
+    QByteArray data;
+    data.reserve(IndexView::dataSize(header));
+    auto append = [&data](const auto *items, size_t count) {
+        data.append(reinterpret_cast<const char *>(items), count * sizeof(*items));
+    };
+    append(&header, 1);
+    append(fileRecords.data(), fileRecords.size());
+    append(symbolRecords.data(), symbolRecords.size());
+    append(byShortName.data(), byShortName.size());
+    append(strings.constData(), strings.size());
+    return data;
+}
+
+//=============================================================================
+// SymbolIndex
+//=============================================================================
+/**
+ * \brief Creates the index of the project in `root`, stored in `indexFileName`.
+ *
+ * The existing index file is loaded, if valid. Use `update` to index the files of the project.
+ */
+SymbolIndex::SymbolIndex(QString root, QString indexFileName)
+    : m_root(std::move(root))
+    , m_indexFileName(std::move(indexFileName))
+{
+    load();
+}
+
+SymbolIndex::~SymbolIndex() = default;
+
+const QString &SymbolIndex::root() const
+{
+    return m_root;
+}
+
+const QString &SymbolIndex::indexFileName() const
+{
+    return m_indexFileName;
+}
+
+bool SymbolIndex::load()
+{
+    m_file.setFileName(m_indexFileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    const auto size = m_file.size();
+    const auto *data = size > 0 ? m_file.map(0, size) : nullptr;
+    if (!data || !IndexView::isValid(data, size)) {
+        spdlog::debug("{}: invalid symbol index {}, it will be rebuilt", FUNCTION_NAME, m_indexFileName);
+        m_file.close();
+        return false;
+    }
+    m_data = data;
+    return true;
+}
+
+void SymbolIndex::setData(QByteArray data)
+{
+    // The file can't be replaced while it's mapped on some platforms
+    m_data = nullptr;
+    m_buffer.clear();
+    m_file.close();
+
+    QDir().mkpath(QFileInfo(m_indexFileName).absolutePath());
+    QSaveFile file(m_indexFileName);
+    if (file.open(QIODevice::WriteOnly) && file.write(data) == data.size() && file.commit() && load())
+        return;
+
+    spdlog::warn("{}: can't save the symbol index in {}", FUNCTION_NAME, m_indexFileName);
+    m_buffer = std::move(data);
+    m_data = reinterpret_cast<const uchar *>(m_buffer.constData());
+}
+
+// Copies the symbols of `record` from the index
+static void readSymbols(const IndexView &view, const FileRecord &record, IndexedFile &file)
+{
+    const auto symbols = view.symbols().subspan(record.firstSymbol, record.symbolCount);
+    file.symbols.reserve(symbols.size());
+    for (const auto &symbol : symbols) {
+        file.symbols.push_back({.name = view.name(symbol).toString(),
+                                .kind = static_cast<Symbol::Kind>(symbol.kind),
+                                .start = symbol.start,
+                                .end = symbol.end,
+                                .selectionStart = symbol.selectionStart,
+                                .selectionEnd = symbol.selectionEnd,
+                                .line = symbol.line,
+                                .column = symbol.column});
+    }
+}
+
+// Parses `fileNames` (full paths) in parallel, and adds their symbols to `files`
+static void parseFiles(const QStringList &fileNames, const std::unordered_map<QString, IndexedFile *> &files)
+{
+    if (fileNames.isEmpty())
+        return;
+
+    const auto &symbolQueries = cppSymbolQueries();
+    QStringList queries;
+    for (const auto &symbolQuery : symbolQueries)
+        queries.push_back(symbolQuery.query);
+
+    const auto matches = queryInFiles(fileNames, queries);
+    for (const auto &match : matches) {
+        if (auto symbol = toIndexedSymbol(match, symbolQueries[match.queryIndex].kind))
+            files.at(match.fileName)->symbols.push_back(std::move(*symbol));
+    }
+    for (auto file : files | std::views::values)
+        assignContexts(file->symbols);
+}
+
+/**
+ * \brief Updates the index with `fileNames`, relative to the root, and returns the number of files parsed.
+ *
+ * Only the files added, or with a different modification time or size than when last indexed, are parsed. The files
+ * are parsed in parallel. Files not in `fileNames` are removed from the index.
+ */
+int SymbolIndex::update(const QStringList &fileNames)
+{
+    const IndexView view(m_data);
+    std::unordered_map<QString, const FileRecord *> indexedFiles;
+    if (m_data) {
+        for (const auto &file : view.files())
+            indexedFiles.emplace(view.path(file).toString(), &file);
+    }
+
+    std::vector<IndexedFile> files(fileNames.size());
+    QStringList parsedFileNames;
+    std::unordered_map<QString, IndexedFile *> parsedFiles;
+    for (int i = 0; i < fileNames.size(); ++i) {
+        auto &file = files[i];
+        const QFileInfo fi(m_root + '/' + fileNames[i]);
+        file.path = fileNames[i];
+        file.modified = fi.lastModified().toMSecsSinceEpoch();
+        file.size = fi.size();
+
+        auto it = indexedFiles.find(file.path);
+        if (it != indexedFiles.end() && it->second->modified == file.modified && it->second->size == file.size) {
+            readSymbols(view, *it->second, file);
+        } else {
+            parsedFileNames.push_back(fi.filePath());
+            parsedFiles.emplace(fi.filePath(), &file);
+        }
+    }
+
+    // Nothing added, changed or removed
+    if (m_data && parsedFileNames.isEmpty() && files.size() == view.header().fileCount)
+        return 0;
+
+    parseFiles(parsedFileNames, parsedFiles);
+    setData(serialize(files));
+    spdlog::debug("{}: {} files parsed, {} symbols indexed", FUNCTION_NAME, parsedFileNames.size(), symbolCount());
+    return static_cast<int>(parsedFileNames.size());
+}
+
+/**
+ * \brief Updates only `fileNames`, relative to the root, and returns the number of files parsed.
+ *
+ * This is `update` for a few files, when they are known to have changed (saved, for example): the other files of the
+ * index are kept as they are, without checking them. The files given are parsed again if changed, added if new, and
+ * removed from the index if they don't exist anymore.
+ */
+int SymbolIndex::updateFiles(const QStringList &fileNames)
+{
+    const IndexView view(m_data);
+    const auto indexedFiles = m_data ? view.files() : std::span<const FileRecord>();
+    QSet<QString> updatedFiles(fileNames.cbegin(), fileNames.cend());
+
+    std::vector<IndexedFile> files;
+    files.reserve(indexedFiles.size() + updatedFiles.size());
+    QStringList parsedFileNames;
+    std::unordered_map<QString, IndexedFile *> parsedFiles;
+    bool changed = false;
+    auto addFile = [&](const QString &path, const FileRecord *record) {
+        const QFileInfo fi(m_root + '/' + path);
+        if (!fi.exists()) {
+            changed |= record != nullptr;
+            return;
+        }
+        auto &file = files.emplace_back(IndexedFile {.path = path,
+                                                     .modified = fi.lastModified().toMSecsSinceEpoch(),
+                                                     .size = fi.size(),
+                                                     .symbols = {}});
+        if (record && record->modified == file.modified && record->size == file.size) {
+            readSymbols(view, *record, file);
+        } else {
+            parsedFileNames.push_back(fi.filePath());
+            parsedFiles.emplace(fi.filePath(), &file);
+        }
+    };
+
+    // Keep the order of the files, new ones go at the end
+    for (const auto &record : indexedFiles) {
+        auto path = view.path(record).toString();
+        if (updatedFiles.remove(path)) {
+            addFile(path, &record);
+        } else {
+            auto &file = files.emplace_back(
+                IndexedFile {.path = std::move(path), .modified = record.modified, .size = record.size, .symbols = {}});
+            readSymbols(view, record, file);
+        }
+    }
+    for (const auto &path : fileNames) {
+        if (updatedFiles.remove(path))
+            addFile(path, nullptr);
+    }
+
+    if (m_data && parsedFileNames.isEmpty() && !changed)
+        return 0;
+
+    parseFiles(parsedFileNames, parsedFiles);
+    setData(serialize(files));
+    spdlog::debug("{}: {} files parsed, {} symbols indexed", FUNCTION_NAME, parsedFileNames.size(), symbolCount());
+    return static_cast<int>(parsedFileNames.size());
+}
+
+/**
+ * \brief Returns the location of all the symbols named `name`.
+ *
+ * The name can be partially qualified: `bar` and `Foo::bar` both find `Foo::bar`, but `oo::bar` doesn't. The lookup is
+ * a binary search on the unqualified names, directly on the mapped file.
+ */
+SymbolLocationList SymbolIndex::find(const QString &name) const
+{
+    if (!m_data || name.isEmpty())
+        return {};
+
+    const IndexView view(m_data);
+    const auto separator = name.lastIndexOf("::");
+    const auto shortName = separator == -1 ? QStringView(name) : QStringView(name).mid(separator + 2);
+    const auto range = std::ranges::equal_range(
+        view.byShortName(), shortName,
+        [](QStringView left, QStringView right) {
+            return left.compare(right) < 0;
+        },
+        [&view](quint32 index) {
+            return view.shortName(index);
+        });
+
+    SymbolLocationList result;
+    for (const auto index : range) {
+        const auto &symbol = view.symbols()[index];
+        const auto qualifiedName = view.name(symbol);
+        // The scopes given need to match the end of the qualified name
+        if (separator != -1 && qualifiedName != name
+            && !(qualifiedName.endsWith(name) && qualifiedName.at(qualifiedName.size() - name.size() - 1) == ':'))
+            continue;
+
+        result.push_back({.fileName = m_root + '/' + view.path(view.files()[symbol.file]),
+                          .name = qualifiedName.toString(),
+                          .kind = static_cast<Symbol::Kind>(symbol.kind),
+                          .start = symbol.start,
+                          .end = symbol.end,
+                          .selectionStart = symbol.selectionStart,
+                          .selectionEnd = symbol.selectionEnd,
+                          .line = symbol.line,
+                          .column = symbol.column});
+    }
+    return result;
+}
+
+int SymbolIndex::symbolCount() const
+{
+    return m_data ? static_cast<int>(IndexView(m_data).header().symbolCount) : 0;
+}
+
+} // namespace Core
@@ -0,0 +1,77 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#pragma once
+
+#include "symbol.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+namespace Core {
+
+/**
+ * Location of a symbol found in a SymbolIndex.
+ * Positions are in characters, `line` and `column` are the 1-based position of the selection range.
+ */
+struct SymbolLocation
+{
+    QString fileName;
+    QString name;
+    Symbol::Kind kind = Symbol::Kind::File;
+    int start = -1;
+    int end = -1;
+    int selectionStart = -1;
+    int selectionEnd = -1;
+    int line = -1;
+    int column = -1;
+};
+
+using SymbolLocationList = QList<SymbolLocation>;
+
+/**
+ * \brief Index of the C++ symbols (classes, functions, members and enums) of all the files of a project
+ *
+ * The symbols are the same as the ones of CppDocument::symbols, found without creating any document. The index is
+ * stored in a compact binary file, memory-mapped when loaded, so looking up a symbol doesn't need to load anything.
+ * Each file is stored with its modification time and size: when updating the index, only the files changed since are
+ * parsed again.
+ */
+class SymbolIndex
+{
+public:
+    SymbolIndex(QString root, QString indexFileName);
+    ~SymbolIndex();
+
+    const QString &root() const;
+    const QString &indexFileName() const;
+
+    int update(const QStringList &fileNames);
+    int updateFiles(const QStringList &fileNames);
+
+    SymbolLocationList find(const QString &name) const;
+    int symbolCount() const;
+
+private:
+    bool load();
+    void setData(QByteArray data);
+
+    QString m_root;
+    QString m_indexFileName;
+    QFile m_file;
+    // Only used if the index can't be saved
+    QByteArray m_buffer;
+    const uchar *m_data = nullptr;
+};
+
+} // namespace Core
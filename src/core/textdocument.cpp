@@ -11,6 +11,7 @@
 #include "textdocument.h"
 #include "logger.h"
 #include "mark.h"
+#include "mark_p.h"
 #include "rangemark.h"
 #include "settings.h"
 #include "textdocument_p.h"
@@ -18,13 +19,19 @@
 #include "utils/log.h"
 #include "utils/string_helper.h"
 
+#include <QClipboard>
 #include <QFile>
+#include <QGuiApplication>
+#include <QJSEngine>
 #include <QKeyEvent>
+#include <QPlainTextDocumentLayout>
 #include <QPlainTextEdit>
 #include <QRegularExpression>
 #include <QSignalBlocker>
 #include <QTextBlock>
 #include <QTextStream>
+#include <QtQml/private/qjsvalue_p.h>
+#include <QtQml/private/qv4engine_p.h>
 #include <private/qwidgettextcontrol_p.h>
 
 namespace Core {
@@ -63,6 +70,33 @@ matchInBlock(const QTextBlock &block, const QRegularExpression &expr, int offset
     return {};
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// TextSnapshot
+///////////////////////////////////////////////////////////////////////////////
+TextSnapshot::TextSnapshot(QString text, int revision)
+    : m_text(std::move(text))
+    , m_revision(revision)
+{
+}
+
+const QString &TextSnapshot::text() const
+{
+    return m_text;
+}
+
+int TextSnapshot::revision() const
+{
+    return m_revision;
+}
+
+qint64 TextSnapshot::memoryUsage() const
+{
+    return m_text.size() * sizeof(QChar);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// TextDocument
+///////////////////////////////////////////////////////////////////////////////
 /*!
  * \qmltype TextDocument
  * \brief Document object for text files.
@@ -129,26 +163,27 @@ TextDocument::TextDocument(QObject *parent)
 
 TextDocument::~TextDocument()
 {
-    delete m_document;
+    delete m_textEdit;
 }
 
 TextDocument::TextDocument(Type type, QObject *parent)
     : Document(type, parent)
-    , m_document(new TextEditor)
-{
-    m_document->hide();
-    connect(m_document, &QPlainTextEdit::textChanged, this, &TextDocument::textChanged);
-    connect(m_document, &QPlainTextEdit::selectionChanged, this, &TextDocument::selectionChanged);
-    connect(m_document, &QPlainTextEdit::cursorPositionChanged, this, &TextDocument::positionChanged);
-    connect(m_document->document(), &QTextDocument::contentsChange, this, [this]() {
+    , m_document(new QTextDocument(this))
+    , m_marks(std::make_unique<MarkRegistry>(m_document))
+{
+    // Same layout as the one used by QPlainTextEdit, so the document can be shared with the editor
+    m_document->setDocumentLayout(new QPlainTextDocumentLayout(m_document));
+    m_cursor = QTextCursor(m_document);
+    connect(m_document, &QTextDocument::contentsChanged, this, &TextDocument::textChanged);
+    connect(m_document, &QTextDocument::contentsChange, this, [this]() {
+        resetSnapshot();
         setHasChanged(true);
     });
-    m_document->installEventFilter(this);
 }
 
 bool TextDocument::eventFilter(QObject *watched, QEvent *event)
 {
-    Q_ASSERT(watched == m_document);
+    Q_ASSERT(watched == m_textEdit);
 
     if (event->type() == QEvent::KeyPress) {
         auto keyEvent = static_cast<QKeyEvent *>(event);
@@ -208,11 +243,11 @@ bool TextDocument::eventFilter(QObject *watched, QEvent *event)
         else if (keyEvent == QKeySequence::Paste)
             paste();
         else if (keyEvent == QKeySequence::Delete)
-            m_document->textCursor().hasSelection() ? deleteSelection() : deleteNextCharacter();
+            textCursor().hasSelection() ? deleteSelection() : deleteNextCharacter();
         else if (keyEvent == QKeySequence::Backspace
                  || (keyEvent->key() == Qt::Key_Backspace
                      && !(keyEvent->modifiers() & ~Qt::ShiftModifier))) // test is coming from QTextWidgetControl
-            m_document->textCursor().hasSelection() ? deleteSelection() : deletePreviousCharacter();
+            textCursor().hasSelection() ? deleteSelection() : deletePreviousCharacter();
         else if (keyEvent == QKeySequence::InsertParagraphSeparator)
             insert("\n");
         else if (keyEvent == QKeySequence::InsertLineSeparator)
@@ -226,7 +261,7 @@ bool TextDocument::eventFilter(QObject *watched, QEvent *event)
         else if (keyEvent == QKeySequence::SelectAll)
             selectAll();
         else if (!keyEvent->text().isEmpty()) {
-            auto control = m_document->findChild<QWidgetTextControl *>();
+            auto control = m_textEdit->findChild<QWidgetTextControl *>();
             if (control->isAcceptableInput(keyEvent))
                 insert(keyEvent->text());
         }
@@ -250,7 +285,7 @@ bool TextDocument::doSave(const QString &fileName)
     if (m_utf8Bom)
         file.write("\xef\xbb\xbf", 3);
 
-    QString plainText = m_document->toPlainText();
+    QString plainText = document()->toPlainText();
     if (m_lineEnding == CRLFLineEnding)
         plainText.replace('\n', "\r\n");
 
@@ -275,9 +310,14 @@ bool TextDocument::doLoad(const QString &fileName)
     QTextStream stream(data);
     const QString text = stream.readAll();
 
-    QSignalBlocker sb(m_document->document());
+    QSignalBlocker sb(m_document);
+    m_textReleased = false;
     // This will replace '\r\n' with '\n'
     m_document->setPlainText(text);
+    setTextCursor(QTextCursor(m_document));
+    reacquireMemory();
+    // Signals are blocked, the snapshot is not reset automatically
+    resetSnapshot();
     setHasChanged(false);
 
     return true;
@@ -307,39 +347,39 @@ void TextDocument::detectFormat(const QByteArray &data)
 int TextDocument::column() const
 {
     LOG();
-    const QTextCursor cursor = m_document->textCursor();
+    const QTextCursor cursor = textCursor();
     LOG_RETURN("column", cursor.positionInBlock() + 1);
 }
 
 int TextDocument::line() const
 {
     LOG();
-    const QTextCursor cursor = m_document->textCursor();
+    const QTextCursor cursor = textCursor();
     LOG_RETURN("line", cursor.blockNumber() + 1);
 }
 
 int TextDocument::lineCount() const
 {
     LOG();
-    return m_document->document()->lineCount();
+    return document()->lineCount();
 }
 
 int TextDocument::position() const
 {
     LOG();
-    LOG_RETURN("pos", m_document->textCursor().position());
+    LOG_RETURN("pos", textCursor().position());
 }
 
 int TextDocument::selectionStart() const
 {
     LOG();
-    LOG_RETURN("pos", m_document->textCursor().selectionStart());
+    LOG_RETURN("pos", textCursor().selectionStart());
 }
 
 int TextDocument::selectionEnd() const
 {
     LOG();
-    LOG_RETURN("pos", m_document->textCursor().selectionEnd());
+    LOG_RETURN("pos", textCursor().selectionEnd());
 }
 
 void TextDocument::setPosition(int newPosition)
@@ -348,20 +388,20 @@ void TextDocument::setPosition(int newPosition)
 
     if (position() == newPosition)
         return;
-    auto cursor = m_document->textCursor();
+    auto cursor = textCursor();
     cursor.setPosition(newPosition);
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
     emit positionChanged();
 }
 
 void TextDocument::convertPosition(int pos, int *line, int *column) const
 {
     Q_ASSERT(line && column);
-    const QTextBlock block = m_document->document()->findBlock(pos);
-    if (!block.isValid()) {
-        (*line) = -1;
-        (*column) = -1;
-    } else {
+    (*line) = -1;
+    (*column) = -1;
+
+    if (pos >= 0 && pos < document()->characterCount()) {
+        const auto block = document()->findBlock(pos);
         // line and column are both 1-based
         (*line) = block.blockNumber() + 1;
         (*column) = pos - block.position() + 1;
@@ -370,7 +410,7 @@ void TextDocument::convertPosition(int pos, int *line, int *column) const
 
 int TextDocument::position(QTextCursor::MoveOperation operation, int pos) const
 {
-    auto cursor = m_document->textCursor();
+    auto cursor = textCursor();
 
     if (pos != -1)
         cursor.setPosition(pos);
@@ -415,31 +455,36 @@ int TextDocument::columnAtPosition(int position)
 int TextDocument::positionAt(int line, int column)
 {
     LOG(LOG_ARG("line", line), LOG_ARG("column", column));
-    const QTextBlock block = m_document->document()->findBlockByLineNumber(line - 1);
-    if (!block.isValid()) {
+    int lineStart = -1;
+    if (line >= 1 && line <= document()->blockCount())
+        lineStart = document()->findBlockByNumber(line - 1).position();
+    if (lineStart == -1) {
         return -1;
     } else {
-        return block.position() + column - 1;
+        return lineStart + column - 1;
     }
 }
 
 QString TextDocument::text() const
 {
     LOG();
-    LOG_RETURN("text", m_document->toPlainText());
+    if (m_editDepth > 0)
+        LOG_RETURN("text", document()->toPlainText());
+    LOG_RETURN("text", snapshot()->text());
 }
 
 void TextDocument::setText(const QString &newText)
 {
     LOG(LOG_ARG("text", newText));
 
-    m_document->setPlainText(newText);
+    document()->setPlainText(newText);
+    setTextCursor(QTextCursor(document()));
 }
 
 QString TextDocument::currentLine() const
 {
     LOG();
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     cursor.movePosition(QTextCursor::StartOfLine);
     cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
     LOG_RETURN("text", cursor.selectedText());
@@ -448,7 +493,7 @@ QString TextDocument::currentLine() const
 QString TextDocument::currentWord() const
 {
     LOG();
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     cursor.movePosition(QTextCursor::StartOfWord);
     cursor.movePosition(QTextCursor::EndOfWord, QTextCursor::KeepAnchor);
     LOG_RETURN("text", cursor.selectedText());
@@ -458,7 +503,7 @@ QString TextDocument::selectedText() const
 {
     LOG();
     // Replace \u2029 with \n
-    const QString text = m_document->textCursor().selectedText().replace(QChar(8233), "\n");
+    const QString text = textCursor().selectedText().replace(QChar(8233), "\n");
     LOG_RETURN("text", text);
 }
 
@@ -472,11 +517,190 @@ bool TextDocument::hasUtf8Bom() const
     return m_utf8Bom;
 }
 
-QPlainTextEdit *TextDocument::textEdit() const
+/**
+ * \brief Returns the QTextDocument holding the text of the document
+ */
+QTextDocument *TextDocument::document() const
 {
+    ensureTextLoaded();
     return m_document;
 }
 
+/**
+ * \brief Returns a snapshot of the current text of the document
+ *
+ * The snapshot is cached and shared until the document is modified, so it's cheap to call repeatedly. Inside an
+ * edit transaction, the snapshot is recomputed on each call, as the document is only notified of the changes once
+ * the transaction is committed.
+ */
+std::shared_ptr<const TextSnapshot> TextDocument::snapshot() const
+{
+    if (m_editDepth > 0)
+        return std::make_shared<const TextSnapshot>(document()->toPlainText(), -1);
+    if (!m_snapshot)
+        m_snapshot = std::make_shared<const TextSnapshot>(snapshotText(), m_textRevision);
+    return m_snapshot;
+}
+
+/**
+ * \brief Returns the text used for the cached snapshot
+ *
+ * Subclasses already keeping a copy of the text up-to-date can return it here, it's then shared with the snapshot.
+ */
+QString TextDocument::snapshotText() const
+{
+    return document()->toPlainText();
+}
+
+/**
+ * \brief Returns the cached snapshot, if any, without creating it
+ */
+const TextSnapshot *TextDocument::cachedSnapshot() const
+{
+    return m_snapshot.get();
+}
+
+void TextDocument::resetSnapshot()
+{
+    ++m_textRevision;
+    m_snapshot.reset();
+}
+
+/**
+ * \brief Returns an estimate of the memory used by the document, in bytes
+ */
+qint64 TextDocument::memoryUsage() const
+{
+    // Rough size of the data stored for each block (line) of the QTextDocument
+    constexpr qint64 BlockSize = 64;
+
+    qint64 size = m_document->characterCount() * sizeof(QChar) + m_document->blockCount() * BlockSize;
+    if (m_snapshot)
+        size += m_snapshot->memoryUsage();
+    return size;
+}
+
+/**
+ * \brief Releases the text, the snapshot and the editor widget, if it's not displayed
+ *
+ * The text is loaded again from the file the next time the document is used, see ensureTextLoaded. Marks and the
+ * text cursor are kept, but the undo history is lost.
+ */
+void TextDocument::doReleaseMemory()
+{
+    m_snapshot.reset();
+    // The editor is reparented when displayed in a view, only delete it when it's not used
+    if (m_textEdit && !m_textEdit->parentWidget())
+        delete m_textEdit;
+
+    if (m_textEdit || m_textReleased || m_editDepth > 0 || !exists())
+        return;
+
+    m_releasedAnchor = m_cursor.anchor();
+    m_releasedPosition = m_cursor.position();
+    // Nothing is notified, marks keep their positions for when the same text is loaded again
+    QSignalBlocker sb(m_document);
+    m_document->clear();
+    m_textReleased = true;
+}
+
+void TextDocument::ensureTextLoaded() const
+{
+    if (m_textReleased)
+        const_cast<TextDocument *>(this)->restoreText();
+}
+
+void TextDocument::restoreText()
+{
+    m_textReleased = false;
+
+    // The text on disk is not the one released, handle it like any other change on disk
+    if (hasChangedOnDisk()) {
+        spdlog::debug("{}: {} changed on disk, reloading it", FUNCTION_NAME, fileName());
+        reload();
+        return;
+    }
+
+    QFile file(fileName());
+    if (!file.open(QIODevice::ReadOnly)) {
+        spdlog::error("{} - Can't load file {} again: {}", FUNCTION_NAME, fileName(), file.errorString());
+        return;
+    }
+    QTextStream stream(file.readAll());
+    const QString text = stream.readAll();
+
+    QSignalBlocker sb(m_document);
+    m_document->setPlainText(text);
+    m_cursor.setPosition(m_releasedAnchor);
+    m_cursor.setPosition(m_releasedPosition, QTextCursor::KeepAnchor);
+    reacquireMemory();
+}
+
+/**
+ * \brief Returns the text cursor, with the current position and selection
+ */
+QTextCursor TextDocument::textCursor() const
+{
+    if (m_textEdit)
+        return m_textEdit->textCursor();
+    ensureTextLoaded();
+    return m_cursor;
+}
+
+/**
+ * \brief Sets the current position and selection of the document to `cursor`
+ */
+void TextDocument::setTextCursor(const QTextCursor &cursor)
+{
+    if (m_textEdit) {
+        // The editor signals are forwarded in createTextEdit
+        m_textEdit->setTextCursor(cursor);
+        return;
+    }
+
+    const bool positionChanged = cursor.position() != m_cursor.position();
+    const bool selectionChanged = cursor.anchor() != m_cursor.anchor() || positionChanged;
+    const bool hadSelection = m_cursor.hasSelection();
+    m_cursor = cursor;
+    if (positionChanged)
+        emit this->positionChanged();
+    if (selectionChanged && (hadSelection || cursor.hasSelection()))
+        emit this->selectionChanged();
+}
+
+/**
+ * \brief Returns the editor widget for this document
+ *
+ * The widget is created on first use, documents only used from scripts or the command line never create one.
+ */
+QPlainTextEdit *TextDocument::textEdit() const
+{
+    if (m_textEdit)
+        return m_textEdit;
+    return const_cast<TextDocument *>(this)->createTextEdit();
+}
+
+QPlainTextEdit *TextDocument::createTextEdit()
+{
+    ensureTextLoaded();
+    m_textEdit = new TextEditor;
+    m_textEdit->hide();
+    m_textEdit->setDocument(m_document);
+    m_textEdit->setTextCursor(m_cursor);
+
+    // Keep the headless cursor in sync, it's used again if the editor is deleted before the document
+    connect(m_textEdit, &QPlainTextEdit::selectionChanged, this, [this]() {
+        m_cursor = m_textEdit->textCursor();
+        emit selectionChanged();
+    });
+    connect(m_textEdit, &QPlainTextEdit::cursorPositionChanged, this, [this]() {
+        m_cursor = m_textEdit->textCursor();
+        emit positionChanged();
+    });
+    m_textEdit->installEventFilter(this);
+    return m_textEdit;
+}
+
 /**
  * \brief Returns the string when pressing on the tab key
  */
@@ -495,10 +719,12 @@ QString TextDocument::tab() const
 void TextDocument::undo(int count)
 {
     LOG_AND_MERGE(count);
+    auto cursor = textCursor();
     while (count != 0) {
-        m_document->undo();
+        document()->undo(&cursor);
         --count;
     }
+    setTextCursor(cursor);
 }
 
 /*!
@@ -508,17 +734,119 @@ void TextDocument::undo(int count)
 void TextDocument::redo(int count)
 {
     LOG_AND_MERGE(count);
+    auto cursor = textCursor();
     while (count != 0) {
-        m_document->redo();
+        document()->redo(&cursor);
         --count;
     }
+    setTextCursor(cursor);
+}
+
+/*!
+ * \qmlmethod TextDocument::beginEdit()
+ * Starts an edit transaction.
+ *
+ * All the edits done until the matching `commitEdit()` are applied as one unit: they are undone in one step, and the
+ * syntax tree, the language server and the marks are updated only once, when the transaction is committed.
+ * Transactions can be nested, only the outermost `commitEdit()` commits the changes.
+ *
+ * Until then, marks, symbols and queries still reflect the document as it was when the transaction started. Marks
+ * located between the first and the last edit of the transaction are moved as if the whole span had been replaced.
+ *
+ * ```js
+ * document.beginEdit()
+ * for (const range of ranges.reverse())
+ *     document.replace(range, "")
+ * document.commitEdit()
+ * ```
+ *
+ * If the script throws an exception before calling `commitEdit()`, the transaction stays open until the script ends.
+ * Prefer `edit()`, which always commits the transaction.
+ * \sa TextDocument::commitEdit, TextDocument::edit
+ */
+void TextDocument::beginEdit()
+{
+    LOG();
+    if (m_editDepth++ == 0) {
+        m_editCursor = QTextCursor(document());
+        m_editCursor.beginEditBlock();
+    }
+}
+
+/*!
+ * \qmlmethod TextDocument::commitEdit()
+ * Commits the edit transaction started with `beginEdit()`.
+ * \sa TextDocument::beginEdit
+ */
+void TextDocument::commitEdit()
+{
+    LOG();
+    if (m_editDepth == 0) {
+        spdlog::warn("{}: no edit transaction in progress", FUNCTION_NAME);
+        return;
+    }
+    if (--m_editDepth == 0) {
+        m_editCursor.endEditBlock();
+        m_editCursor = {};
+    }
+}
+
+/*!
+ * \qmlmethod TextDocument::edit(function callback)
+ * Calls `callback` inside an edit transaction, see `beginEdit()`.
+ *
+ * The transaction is committed when the callback returns, or if it throws an exception: the exception is then thrown
+ * again, once the transaction is committed.
+ *
+ * ```js
+ * document.edit(() => {
+ *     for (const range of ranges.reverse())
+ *         document.replace(range, "")
+ * })
+ * ```
+ * \sa TextDocument::beginEdit
+ */
+void TextDocument::edit(const QJSValue &callback)
+{
+    LOG();
+
+    auto engine = QJSValuePrivate::engine(&callback);
+    if (!callback.isCallable() || !engine) {
+        spdlog::error("{}: the callback is not a function", FUNCTION_NAME);
+        return;
+    }
+
+    QJSValue result;
+    {
+        EditTransaction transaction(this);
+        result = callback.call();
+    }
+    if (result.isError())
+        engine->jsEngine()->throwError(result);
+}
+
+/**
+ * \brief Commits the edit transactions still open
+ *
+ * Called when a script ends, so a script failing in the middle of a transaction doesn't leave the document in it.
+ * Returns true if there was any transaction open.
+ */
+bool TextDocument::closeEditTransactions()
+{
+    if (m_editDepth == 0)
+        return false;
+
+    spdlog::warn("{}: {} edit transaction(s) not committed in {}", FUNCTION_NAME, m_editDepth, fileName());
+    m_editDepth = 1;
+    commitEdit();
+    return true;
 }
 
 void TextDocument::movePosition(QTextCursor::MoveOperation operation, QTextCursor::MoveMode mode, int count)
 {
-    auto cursor = m_document->textCursor();
+    auto cursor = textCursor();
     cursor.movePosition(operation, mode, count);
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -531,21 +859,16 @@ void TextDocument::gotoLine(int line, int column)
 {
     LOG(LOG_ARG("line", line), LOG_ARG("column", column));
 
-    gotoLineInTextEdit(m_document, line, column);
-}
-
-void gotoLineInTextEdit(QPlainTextEdit *textEdit, int line, int column)
-{
     // Internally, columns are 0-based, while 1-based on the API
     column = column - 1;
-    const int blockNumber = qMin(line, textEdit->document()->blockCount()) - 1;
-    const QTextBlock &block = textEdit->document()->findBlockByNumber(blockNumber);
+    const int blockNumber = qMin(line, document()->blockCount()) - 1;
+    const QTextBlock &block = document()->findBlockByNumber(blockNumber);
     if (block.isValid()) {
         QTextCursor cursor(block);
         if (column > 0)
             cursor.movePosition(QTextCursor::Right, QTextCursor::MoveAnchor, column);
 
-        textEdit->setTextCursor(cursor);
+        setTextCursor(cursor);
     }
 }
 
@@ -676,9 +999,9 @@ void TextDocument::gotoEndOfDocument()
 void TextDocument::unselect()
 {
     LOG();
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     cursor.clearSelection();
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -688,7 +1011,7 @@ void TextDocument::unselect()
 bool TextDocument::hasSelection()
 {
     LOG();
-    return m_document->textCursor().hasSelection();
+    return textCursor().hasSelection();
 }
 
 /*!
@@ -698,7 +1021,9 @@ bool TextDocument::hasSelection()
 void TextDocument::selectAll()
 {
     LOG();
-    m_document->selectAll();
+    QTextCursor cursor(document());
+    cursor.select(QTextCursor::Document);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -708,9 +1033,9 @@ void TextDocument::selectAll()
 void TextDocument::selectTo(int pos)
 {
     LOG(LOG_ARG("pos", pos));
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     cursor.setPosition(pos, QTextCursor::KeepAnchor);
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -820,10 +1145,10 @@ void TextDocument::selectNextWord(int count)
 void TextDocument::selectRegion(int from, int to)
 {
     LOG(from, to);
-    QTextCursor cursor(m_document->document());
+    QTextCursor cursor(document());
     cursor.setPosition(from, QTextCursor::MoveAnchor);
     cursor.setPosition(to, QTextCursor::KeepAnchor);
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -847,7 +1172,9 @@ void TextDocument::selectRange(const RangeMark &range)
 void TextDocument::copy()
 {
     LOG();
-    m_document->copy();
+    const QTextCursor cursor = textCursor();
+    if (cursor.hasSelection())
+        QGuiApplication::clipboard()->setText(cursor.selection().toPlainText());
 }
 
 /*!
@@ -857,7 +1184,9 @@ void TextDocument::copy()
 void TextDocument::paste()
 {
     LOG();
-    m_document->paste();
+    auto cursor = textCursor();
+    cursor.insertText(QGuiApplication::clipboard()->text());
+    setTextCursor(cursor);
 }
 
 /*!
@@ -867,7 +1196,12 @@ void TextDocument::paste()
 void TextDocument::cut()
 {
     LOG();
-    m_document->cut();
+    auto cursor = textCursor();
+    if (!cursor.hasSelection())
+        return;
+    QGuiApplication::clipboard()->setText(cursor.selection().toPlainText());
+    cursor.removeSelectedText();
+    setTextCursor(cursor);
 }
 
 /*!
@@ -877,10 +1211,10 @@ void TextDocument::cut()
 void TextDocument::remove(int length)
 {
     LOG(length);
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     cursor.setPosition(cursor.position() + length, QTextCursor::KeepAnchor);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -890,7 +1224,9 @@ void TextDocument::remove(int length)
 void TextDocument::insert(const QString &text)
 {
     LOG_AND_MERGE(LOG_ARG("text", text));
-    m_document->insertPlainText(text);
+    auto cursor = textCursor();
+    cursor.insertText(text);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -904,10 +1240,10 @@ void TextDocument::insertAtLine(const QString &text, int line)
     else
         LOG(LOG_ARG("text", text), LOG_ARG("line", line));
 
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     if (line > 0) {
-        const int blockNumber = qMin(line, m_document->document()->blockCount()) - 1;
-        const QTextBlock &block = m_document->document()->findBlockByNumber(blockNumber);
+        const int blockNumber = qMin(line, document()->blockCount()) - 1;
+        const QTextBlock &block = document()->findBlockByNumber(blockNumber);
         if (block.isValid())
             cursor = QTextCursor(block);
     }
@@ -921,7 +1257,7 @@ void TextDocument::insertAtLine(const QString &text, int line)
 void TextDocument::insertAtPosition(const QString &text, int pos)
 {
     LOG(text, pos);
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     cursor.setPosition(pos);
     cursor.beginEditBlock();
     cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
@@ -936,10 +1272,10 @@ void TextDocument::insertAtPosition(const QString &text, int pos)
 void TextDocument::replace(int length, const QString &text)
 {
     LOG(length, text);
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     cursor.setPosition(cursor.position() + length, QTextCursor::KeepAnchor);
     cursor.insertText(text);
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -949,11 +1285,11 @@ void TextDocument::replace(int length, const QString &text)
 void TextDocument::replace(int from, int to, const QString &text)
 {
     LOG(from, to, text);
-    QTextCursor cursor(m_document->document());
+    QTextCursor cursor(document());
     cursor.setPosition(from);
     cursor.setPosition(to, QTextCursor::KeepAnchor);
     cursor.insertText(text);
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -977,10 +1313,10 @@ void TextDocument::deleteLine(int line)
     else
         LOG(LOG_ARG("line", line));
 
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     if (line > 0) {
-        const int blockNumber = qMin(line, m_document->document()->blockCount()) - 1;
-        const QTextBlock &block = m_document->document()->findBlockByNumber(blockNumber);
+        const int blockNumber = qMin(line, document()->blockCount()) - 1;
+        const QTextBlock &block = document()->findBlockByNumber(blockNumber);
         if (block.isValid())
             cursor = QTextCursor(block);
     } else {
@@ -997,7 +1333,7 @@ void TextDocument::deleteLine(int line)
 void TextDocument::deleteSelection()
 {
     LOG();
-    m_document->textCursor().removeSelectedText();
+    textCursor().removeSelectedText();
 }
 
 /*!
@@ -1007,11 +1343,11 @@ void TextDocument::deleteSelection()
 void TextDocument::deleteRegion(int from, int to)
 {
     LOG(from, to);
-    QTextCursor cursor(m_document->document());
+    QTextCursor cursor(document());
     cursor.setPosition(from);
     cursor.setPosition(to, QTextCursor::KeepAnchor);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -1035,10 +1371,10 @@ void TextDocument::deleteRange(const RangeMark &range)
 void TextDocument::deleteEndOfLine()
 {
     LOG();
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -1048,10 +1384,10 @@ void TextDocument::deleteEndOfLine()
 void TextDocument::deleteStartOfLine()
 {
     LOG();
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     cursor.movePosition(QTextCursor::StartOfLine, QTextCursor::KeepAnchor);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -1061,11 +1397,11 @@ void TextDocument::deleteStartOfLine()
 void TextDocument::deleteEndOfWord()
 {
     LOG();
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     if (!cursor.hasSelection())
         cursor.movePosition(QTextCursor::NextWord, QTextCursor::KeepAnchor);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -1075,11 +1411,11 @@ void TextDocument::deleteEndOfWord()
 void TextDocument::deleteStartOfWord()
 {
     LOG();
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     if (!cursor.hasSelection())
         cursor.movePosition(QTextCursor::PreviousWord, QTextCursor::KeepAnchor);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -1089,10 +1425,10 @@ void TextDocument::deleteStartOfWord()
 void TextDocument::deletePreviousCharacter(int count)
 {
     LOG_AND_MERGE(count);
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     cursor.movePosition(QTextCursor::PreviousCharacter, QTextCursor::KeepAnchor, count);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -1102,10 +1438,10 @@ void TextDocument::deletePreviousCharacter(int count)
 void TextDocument::deleteNextCharacter(int count)
 {
     LOG_AND_MERGE(count);
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     cursor.movePosition(QTextCursor::NextCharacter, QTextCursor::KeepAnchor, count);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -1134,9 +1470,9 @@ void TextDocument::gotoMark(const Mark &mark)
         return;
     }
 
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     cursor.setPosition(mark.position());
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -1151,9 +1487,9 @@ void TextDocument::selectToMark(const Mark &mark)
         return;
     }
 
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textCursor();
     cursor.setPosition(mark.position(), QTextCursor::KeepAnchor);
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 }
 
 /**
@@ -1179,7 +1515,7 @@ Core::RangeMark TextDocument::createRangeMark(int from, int to)
 Core::RangeMark TextDocument::createRangeMark()
 {
     LOG();
-    const auto cursor = m_document->textCursor();
+    const auto cursor = textCursor();
     const int start = cursor.selectionStart();
     const int end = cursor.selectionEnd();
 
@@ -1207,8 +1543,14 @@ bool TextDocument::find(const QString &text, FindFlags options)
         return findRegexp(text, options);
     else if (options & FindWholeWords)
         return findRegexp(QRegularExpression::escape(text), options);
-    else
-        return m_document->find(text, static_cast<QTextDocument::FindFlags>(static_cast<int>(options)));
+    else {
+        const auto cursor =
+            document()->find(text, textCursor(), static_cast<QTextDocument::FindFlags>(static_cast<int>(options)));
+        if (cursor.isNull())
+            return false;
+        setTextCursor(cursor);
+        return true;
+    }
 }
 
 /*!
@@ -1249,7 +1591,7 @@ auto TextDocument::selectRegexpMatch(
     else
         expression.setPatternOptions(expression.patternOptions() | QRegularExpression::CaseInsensitiveOption);
 
-    const QTextCursor startCursor = m_document->textCursor();
+    const QTextCursor startCursor = textCursor();
     QTextBlock block = startCursor.block();
     int blockOffset = startCursor.positionInBlock();
 
@@ -1258,7 +1600,7 @@ auto TextDocument::selectRegexpMatch(
         if (found.has_value()) {
             const auto &[match, newCursor] = *found;
             if (selectionFunction(expression, match, newCursor)) {
-                m_document->setTextCursor(newCursor);
+                setTextCursor(newCursor);
                 return found;
             }
 
@@ -1334,9 +1676,9 @@ bool TextDocument::replaceOne(const QString &before, const QString &after, FindF
 {
     LOG(LOG_ARG("text", before), after, options);
 
-    auto cursor = m_document->textCursor();
+    auto cursor = textCursor();
     cursor.movePosition(QTextCursor::Start);
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
 
     const bool usesRegExp = options & FindRegexp;
     const bool preserveCase = options & PreserveCase;
@@ -1344,7 +1686,7 @@ bool TextDocument::replaceOne(const QString &before, const QString &after, FindF
     const auto regexp = Utils::createRegularExpression(before, options, usesRegExp);
     if (find(before, options)) {
         cursor.beginEditBlock();
-        const auto found = m_document->textCursor();
+        const auto found = textCursor();
         cursor.setPosition(found.selectionStart());
         cursor.setPosition(found.selectionEnd(), QTextCursor::KeepAnchor);
         QString afterText = after;
@@ -1427,14 +1769,14 @@ int TextDocument::replaceAll(const QString &before, const QString &after, FindFl
     const bool preserveCase = options & PreserveCase;
 
     int count = 0;
-    auto cursor = m_document->textCursor();
+    auto cursor = textCursor();
     cursor.movePosition(backwards ? QTextCursor::End : QTextCursor::Start);
-    m_document->setTextCursor(cursor);
+    setTextCursor(cursor);
     cursor.beginEditBlock();
 
     const auto regexp = Utils::createRegularExpression(before, options, usesRegExp);
     while (find(before, options)) {
-        const auto found = m_document->textCursor();
+        const auto found = textCursor();
         cursor.setPosition(found.selectionStart());
         cursor.setPosition(found.selectionEnd(), QTextCursor::KeepAnchor);
         if (!filterAcceptsCursor(cursor)) {
@@ -1557,18 +1899,18 @@ static int indentOneLine(QTextCursor &cursor, int tabCount, const TabSettings &s
     return text.size() - oldSize;
 }
 
-static void indentBlocksInTextEdit(QPlainTextEdit *textEdit, int blockStart, int blockEnd, int tabCount, bool relative)
+static void indentBlocks(QTextCursor &cursor, int blockStart, int blockEnd, int tabCount, bool relative)
 {
     const auto settings = Core::Settings::instance()->value<Core::TabSettings>(Core::Settings::Tab);
-    QTextCursor cursor = textEdit->textCursor();
+    const auto document = cursor.document();
 
     // Make sure we don't move the cursor outside the first line it started on.
-    const int minStart = textEdit->document()->findBlock(cursor.selectionStart()).position();
+    const int minStart = document->findBlock(cursor.selectionStart()).position();
     int newStart = cursor.selectionStart();
     int newEnd = cursor.selectionEnd();
 
     // Move the position to the beginning of the first line
-    cursor.setPosition(textEdit->document()->findBlockByNumber(blockStart).position());
+    cursor.setPosition(document->findBlockByNumber(blockStart).position());
 
     cursor.beginEditBlock();
     // Iterate through all line, and change the indentation
@@ -1594,17 +1936,21 @@ static void indentBlocksInTextEdit(QPlainTextEdit *textEdit, int blockStart, int
     // Restore the selection, adjusted for the inserted/removed indentation
     cursor.setPosition(qMax(minStart, newStart));
     cursor.setPosition(qMax(minStart, newEnd), QTextCursor::KeepAnchor);
+}
 
-    textEdit->setTextCursor(cursor);
+static void indentText(QTextCursor &cursor, int tabCount, bool relative)
+{
+    const int blockStart = cursor.document()->findBlock(cursor.selectionStart()).blockNumber();
+    const int blockEnd = cursor.document()->findBlock(cursor.selectionEnd()).blockNumber();
+
+    indentBlocks(cursor, blockStart, blockEnd, tabCount, relative);
 }
 
 void indentTextInTextEdit(QPlainTextEdit *textEdit, int tabCount, bool relative)
 {
     QTextCursor cursor = textEdit->textCursor();
-    const int blockStart = textEdit->document()->findBlock(cursor.selectionStart()).blockNumber();
-    const int blockEnd = textEdit->document()->findBlock(cursor.selectionEnd()).blockNumber();
-
-    indentBlocksInTextEdit(textEdit, blockStart, blockEnd, tabCount, relative);
+    indentText(cursor, tabCount, relative);
+    textEdit->setTextCursor(cursor);
 }
 
 /*!
@@ -1618,7 +1964,9 @@ void indentTextInTextEdit(QPlainTextEdit *textEdit, int tabCount, bool relative)
 void TextDocument::indent(int count)
 {
     LOG_AND_MERGE(count);
-    indentTextInTextEdit(m_document, count);
+    auto cursor = textCursor();
+    indentText(cursor, count, true);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -1631,7 +1979,9 @@ void TextDocument::indentLine(int count, int line)
 {
     LOG(LOG_ARG("count", count), LOG_ARG("line", line));
 
-    indentBlocksInTextEdit(m_document, line - 1, line - 1, count, true);
+    auto cursor = textCursor();
+    indentBlocks(cursor, line - 1, line - 1, count, true);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -1645,7 +1995,9 @@ void TextDocument::setIndentation(int indent)
 {
     LOG(LOG_ARG("indent", indent));
 
-    indentTextInTextEdit(m_document, indent, false);
+    auto cursor = textCursor();
+    indentText(cursor, indent, false);
+    setTextCursor(cursor);
 }
 
 /*!
@@ -1658,7 +2010,9 @@ void TextDocument::setIndentationAtLine(int indent, int line)
 {
     LOG(LOG_ARG("indent", indent), LOG_ARG("line", line));
 
-    indentBlocksInTextEdit(m_document, line - 1, line - 1, indent, false);
+    auto cursor = textCursor();
+    indentBlocks(cursor, line - 1, line - 1, indent, false);
+    setTextCursor(cursor);
 }
 
 void TextDocument::setLineEnding(LineEnding newLineEnding)
@@ -1681,7 +2035,7 @@ QString TextDocument::indentTextAtPosition(int pos) const
 {
     LOG(LOG_ARG("position", pos));
 
-    auto cursor = m_document->textCursor();
+    auto cursor = textCursor();
     cursor.setPosition(pos);
     cursor.movePosition(QTextCursor::StartOfLine);
     const QString line = cursor.block().text();
@@ -1709,7 +2063,7 @@ QString TextDocument::indentTextAtLine(int line /* = -1 */) const
     // API-wise the line numbers are 1-based, but internally they are 0-based
     auto blockNumber = line - 1;
 
-    const QTextBlock &block = m_document->document()->findBlockByNumber(blockNumber);
+    const QTextBlock &block = document()->findBlockByNumber(blockNumber);
     if (block.isValid()) {
         return indentTextAtPosition(block.position());
     }
@@ -1745,4 +2099,19 @@ int TextDocument::indentationAtLine(int line /* = -1 */) const
     return columnAt(indentText, indentText.size(), settings.tabSize) / settings.tabSize;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// EditTransaction
+///////////////////////////////////////////////////////////////////////////////
+EditTransaction::EditTransaction(TextDocument *document)
+    : m_document(document)
+{
+    Q_ASSERT(m_document);
+    m_document->beginEdit();
+}
+
+EditTransaction::~EditTransaction()
+{
+    m_document->commitEdit();
+}
+
 } // namespace Core
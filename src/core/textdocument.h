@@ -14,6 +14,7 @@
 #include "mark.h"
 #include "rangemark.h"
 
+#include <QJSValue>
 #include <QPointer>
 #include <QRegularExpressionMatch>
 #include <QTextCursor>
@@ -23,7 +24,9 @@ class QPlainTextEdit;
 
 namespace Core {
 
+class MarkRegistry;
 class RangeMark;
+class TextSnapshot;
 
 class TextDocument : public Document
 {
@@ -87,10 +90,19 @@ public:
 
     bool hasUtf8Bom() const;
 
+    QTextDocument *document() const;
+    std::shared_ptr<const TextSnapshot> snapshot() const;
+    QTextCursor textCursor() const;
+    void setTextCursor(const QTextCursor &cursor);
+
     QPlainTextEdit *textEdit() const;
 
     QString tab() const;
 
+    qint64 memoryUsage() const override;
+
+    bool closeEditTransactions();
+
 public slots:
     void setPosition(int newPosition);
     void setText(const QString &newText);
@@ -103,6 +115,10 @@ public slots:
     void undo(int count = 1);
     void redo(int count = 1);
 
+    // Edit transactions
+    void beginEdit();
+    void commitEdit();
+
     // Goto methods, to move around the document
     void gotoLine(int line, int column = 1);
     void gotoStartOfLine();
@@ -199,6 +215,8 @@ public:
     Q_INVOKABLE QString indentTextAtPosition(int pos) const;
     Q_INVOKABLE QString indentTextAtLine(int line = -1) const;
 
+    Q_INVOKABLE void edit(const QJSValue &callback);
+
 signals:
     void positionChanged();
     void textChanged();
@@ -210,8 +228,15 @@ protected:
 
     bool doSave(const QString &fileName) override;
     bool doLoad(const QString &fileName) override;
+    void doReleaseMemory() override;
+
+    virtual QString snapshotText() const;
+    const TextSnapshot *cachedSnapshot() const;
+    void resetSnapshot();
 
     friend MarkPrivate;
+    friend RangeMarkPrivate;
+    friend class QueryMatchPrivate;
     void convertPosition(int pos, int *line, int *column) const;
     int position(QTextCursor::MoveOperation operation, int pos) const;
 
@@ -222,6 +247,9 @@ protected:
 
 private:
     void detectFormat(const QByteArray &data);
+    void ensureTextLoaded() const;
+    void restoreText();
+    QPlainTextEdit *createTextEdit();
 
     void movePosition(QTextCursor::MoveOperation operation, QTextCursor::MoveMode mode = QTextCursor::MoveAnchor,
                       int count = 1);
@@ -233,11 +261,38 @@ private:
                 return true;
             }) -> std::optional<std::pair<QRegularExpressionMatch, QTextCursor>>;
 
-    // TODO: use a QTextDocument maybe, to avoid creating a widget
-    // The QPlainTextEdit has a nicer API, so it's slightly easier with that now
-    QPointer<QPlainTextEdit> m_document;
+    // The text is stored in a QTextDocument, the editor widget is only created when needed (see textEdit())
+    QTextDocument *const m_document;
+    QTextCursor m_cursor;
+    QPointer<QPlainTextEdit> m_textEdit;
+    std::unique_ptr<MarkRegistry> m_marks;
+    mutable std::shared_ptr<const TextSnapshot> m_snapshot;
+    int m_textRevision = 0;
     LineEnding m_lineEnding = NativeLineEnding;
     bool m_utf8Bom = false;
+    QTextCursor m_editCursor;
+    int m_editDepth = 0;
+    // Set when the text is released to save memory, it's loaded again on first use (see ensureTextLoaded)
+    bool m_textReleased = false;
+    int m_releasedAnchor = 0;
+    int m_releasedPosition = 0;
+};
+
+/**
+ * \brief Edit transaction of a TextDocument, committed when destroyed
+ *
+ * Use it instead of calling TextDocument::beginEdit and TextDocument::commitEdit directly, so the transaction is
+ * committed on all the code paths, including early returns and exceptions.
+ */
+class EditTransaction
+{
+public:
+    explicit EditTransaction(TextDocument *document);
+    ~EditTransaction();
+
+private:
+    Q_DISABLE_COPY_MOVE(EditTransaction)
+    TextDocument *const m_document;
 };
 
 } // namespace Core
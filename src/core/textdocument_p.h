@@ -12,7 +12,10 @@
 
 #include "utils/json.h"
 
+#include <QString>
+
 class QPlainTextEdit;
+class QTextDocument;
 
 namespace Core {
 
@@ -25,7 +28,27 @@ struct TabSettings
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(TabSettings, insertSpaces, tabSize);
 
+/**
+ * \brief Immutable copy of the plain text of a document
+ *
+ * Snapshots are shared: TextDocument returns the same one until the document is modified. The revision is
+ * increased on each modification, it's -1 for snapshots taken inside an edit transaction.
+ */
+class TextSnapshot
+{
+public:
+    TextSnapshot(QString text, int revision);
+
+    const QString &text() const;
+    int revision() const;
+
+    qint64 memoryUsage() const;
+
+private:
+    const QString m_text;
+    const int m_revision;
+};
+
 void indentTextInTextEdit(QPlainTextEdit *textEdit, int tabCount, bool relative = true);
-void gotoLineInTextEdit(QPlainTextEdit *textEdit, int line, int column = 1);
 
 } // namespace Core
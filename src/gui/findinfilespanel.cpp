@@ -11,37 +11,28 @@ Contact KDAB at <info@kdab.com> for commercial licensing options.
 #include "findinfilespanel.h"
 #include "core/project.h"
 #include "core/textdocument.h"
-#include <QFile>
 #include <QHBoxLayout>
 #include <QHeaderView>
+#include <QLabel>
 #include <QLineEdit>
-#include <QPainter>
 #include <QToolButton>
 #include <QTreeWidget>
 #include <QTreeWidgetItem>
 #include <QVBoxLayout>
+#include <algorithm>
 
 namespace Gui {
 
 enum { LineRole = Qt::UserRole + 1, ColumnRole };
 
-class FindInFilesTreeWidget : public QTreeWidget
-{
-    Q_OBJECT
-public:
-    explicit FindInFilesTreeWidget(QWidget *parent = nullptr);
-
-protected:
-    void paintEvent(QPaintEvent *) override;
-
-private:
-    const bool m_findInFilesAvailable;
-};
+// Number of results displayed at once, more are displayed on demand
+static constexpr int ResultLimit = 1000;
 
 FindInFilesPanel::FindInFilesPanel(QWidget *parent)
     : QWidget(parent)
     , m_toolBar(new QWidget(this))
-    , m_resultsDisplay(new FindInFilesTreeWidget(this))
+    , m_resultsDisplay(new QTreeWidget(this))
+    , m_search(new Core::FileSearch(this))
 {
     setWindowTitle(tr("Find in Files"));
     setObjectName("FindInFilesPanel");
@@ -59,8 +50,9 @@ FindInFilesPanel::FindInFilesPanel(QWidget *parent)
     connect(m_resultsDisplay, &QTreeWidget::itemActivated, this, [this](QTreeWidgetItem *item, int) {
         openFileAtItem(item);
     });
-    const bool available = Core::Project::instance()->isFindInFilesAvailable();
-    m_searchInput->setEnabled(available);
+
+    connect(m_search, &Core::FileSearch::matchesFound, this, &FindInFilesPanel::addMatches);
+    connect(m_search, &Core::FileSearch::finished, this, &FindInFilesPanel::updateStatus);
 }
 
 QWidget *FindInFilesPanel::toolBar() const
@@ -83,65 +75,108 @@ void FindInFilesPanel::setupToolBar()
     searchButton->setEnabled(false);
     layout->addWidget(searchButton);
 
+    m_cancelButton = new QToolButton(m_toolBar);
+    m_cancelButton->setText(tr("Cancel"));
+    m_cancelButton->setEnabled(false);
+    layout->addWidget(m_cancelButton);
+
+    m_statusLabel = new QLabel(m_toolBar);
+    m_statusLabel->setContentsMargins(6, 0, 6, 0);
+    layout->addWidget(m_statusLabel);
+
+    m_showMoreButton = new QToolButton(m_toolBar);
+    m_showMoreButton->setText(tr("Show More"));
+    m_showMoreButton->setVisible(false);
+    layout->addWidget(m_showMoreButton);
+
     connect(m_searchInput, &QLineEdit::textChanged, this, [searchButton, this]() {
         searchButton->setEnabled(!m_searchInput->text().isEmpty());
     });
 
     connect(searchButton, &QToolButton::clicked, this, &FindInFilesPanel::findInFiles);
     connect(m_searchInput, &QLineEdit::returnPressed, this, &FindInFilesPanel::findInFiles);
+    connect(m_cancelButton, &QToolButton::clicked, this, [this]() {
+        m_search->cancel();
+    });
+    connect(m_showMoreButton, &QToolButton::clicked, this, &FindInFilesPanel::showMoreResults);
 }
 
 void FindInFilesPanel::findInFiles()
 {
-    auto results = Core::Project::instance()->findInFiles(m_searchInput->text());
-
-    for (auto &resultVariant : results) {
-        auto result = resultVariant.toMap();
-
-        QFile file(result["file"].toString());
-        if (file.open(QFile::ReadOnly)) {
-            QTextStream stream(&file);
-            int currentLine = 0;
-            const int line = result["line"].toInt();
-            while (!stream.atEnd()) {
-                const QString lineText = stream.readLine();
-                ++currentLine;
-                if (currentLine == line) {
-                    result["text"] = lineText;
-                    break;
-                }
-            }
-        }
-        resultVariant = result;
-    }
+    const QString pattern = m_searchInput->text();
+    if (pattern.trimmed().isEmpty())
+        return;
+
+    // Cancel first, so the results of the previous search are not added anymore
+    m_search->cancel();
+    m_resultsDisplay->clear();
+    m_fileItems.clear();
+    m_hiddenMatches.clear();
+    m_displayedCount = 0;
+    m_resultLimit = ResultLimit;
 
-    displayResults(results);
+    auto project = Core::Project::instance();
+    if (project->root().isEmpty())
+        return;
+    m_search->start(project->allFiles(Core::Project::FullPath), pattern, project->changedTexts());
+    updateStatus();
 }
 
-void FindInFilesPanel::displayResults(const QVariantList &results) const
+void FindInFilesPanel::addMatches(const Core::FileSearchMatchList &matches)
 {
-    m_resultsDisplay->clear();
-    QMap<QString, QTreeWidgetItem *> fileItems;
-
-    for (const auto &result : results) {
-        const auto map = result.toMap();
-        const QString filePath = map["file"].toString();
-        const int line = map["line"].toInt();
-        const int column = map["column"].toInt();
-        const QString text = map["text"].toString();
-
-        auto it = fileItems.find(filePath);
-        if (it == fileItems.end()) {
-            auto fileItem = new QTreeWidgetItem(m_resultsDisplay);
-            fileItem->setText(0, filePath);
-            it = fileItems.insert(filePath, fileItem);
-        }
-
-        auto lineItem = new QTreeWidgetItem(it.value());
-        lineItem->setText(0, QString("%1        %2").arg(line).arg(text));
-        lineItem->setData(0, LineRole, line);
-        lineItem->setData(0, ColumnRole, column);
+    for (const auto &match : matches) {
+        if (m_displayedCount < m_resultLimit)
+            addResultItem(match);
+        else
+            m_hiddenMatches.push_back(match);
     }
+    // No need to search further until the user asks for more
+    if (m_displayedCount >= m_resultLimit)
+        m_search->pause();
+    updateStatus();
+}
+
+void FindInFilesPanel::addResultItem(const Core::FileSearchMatch &match)
+{
+    auto it = m_fileItems.find(match.fileName);
+    if (it == m_fileItems.end()) {
+        auto fileItem = new QTreeWidgetItem(m_resultsDisplay);
+        fileItem->setText(0, match.fileName);
+        it = m_fileItems.insert(match.fileName, fileItem);
+    }
+
+    auto lineItem = new QTreeWidgetItem(it.value());
+    lineItem->setText(0, QString("%1        %2").arg(match.line).arg(match.lineText.trimmed()));
+    lineItem->setData(0, LineRole, match.line);
+    lineItem->setData(0, ColumnRole, match.column);
+    ++m_displayedCount;
+}
+
+void FindInFilesPanel::showMoreResults()
+{
+    m_resultLimit += ResultLimit;
+    const auto count = std::min<qsizetype>(m_resultLimit - m_displayedCount, m_hiddenMatches.size());
+    for (qsizetype i = 0; i < count; ++i)
+        addResultItem(m_hiddenMatches.at(i));
+    m_hiddenMatches.remove(0, count);
+
+    if (m_displayedCount < m_resultLimit)
+        m_search->resume();
+    updateStatus();
+}
+
+void FindInFilesPanel::updateStatus()
+{
+    const bool running = m_search->isRunning();
+    const bool hasMore = !m_hiddenMatches.empty() || m_search->isPaused();
+    m_cancelButton->setEnabled(running);
+    m_showMoreButton->setVisible(hasMore);
+
+    QString status = hasMore ? tr("%n result(s), more available", "", m_displayedCount)
+                             : tr("%n result(s)", "", m_displayedCount);
+    if (running && !m_search->isPaused())
+        status = tr("Searching... %1").arg(status);
+    m_statusLabel->setText(status);
 }
 
 void FindInFilesPanel::openFileAtItem(QTreeWidgetItem *item)
@@ -162,28 +197,4 @@ void FindInFilesPanel::openFileAtItem(QTreeWidgetItem *item)
     }
 }
 
-FindInFilesTreeWidget::FindInFilesTreeWidget(QWidget *parent)
-    : QTreeWidget(parent)
-    , m_findInFilesAvailable(Core::Project::instance()->isFindInFilesAvailable())
-{
-}
-
-void FindInFilesTreeWidget::paintEvent(QPaintEvent *event)
-{
-    if (!m_findInFilesAvailable) {
-        QPainter p(viewport());
-
-        QFont font = p.font();
-        font.setItalic(true);
-        p.setFont(font);
-
-        p.drawText(QRect(0, 0, width(), height()), Qt::AlignCenter,
-                   tr("Ripgrep (rg) executable not found.\nPlease ensure that ripgrep is installed and its location is "
-                      "included in the PATH environment variable."));
-    } else {
-        QTreeWidget::paintEvent(event);
-    }
-}
-
 } // namespace Gui
-#include "findinfilespanel.moc"
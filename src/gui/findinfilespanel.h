@@ -10,10 +10,14 @@ Contact KDAB at <info@kdab.com> for commercial licensing options.
 
 #pragma once
 
+class QLabel;
 class QLineEdit;
 class QToolButton;
 class QTreeWidgetItem;
 
+#include "core/filesearch.h"
+
+#include <QHash>
 #include <QTreeWidget>
 
 namespace Gui {
@@ -28,14 +32,28 @@ public:
     QWidget *toolBar() const;
 
 private:
-    void displayResults(const QVariantList &results) const;
     void findInFiles();
+    void addMatches(const Core::FileSearchMatchList &matches);
+    void addResultItem(const Core::FileSearchMatch &match);
+    void showMoreResults();
+    void updateStatus();
     void openFileAtItem(QTreeWidgetItem *item);
     void setupToolBar();
 
     QWidget *const m_toolBar;
     QTreeWidget *m_resultsDisplay = nullptr;
     QLineEdit *m_searchInput;
+    QToolButton *m_cancelButton;
+    QToolButton *m_showMoreButton;
+    QLabel *m_statusLabel;
+
+    Core::FileSearch *const m_search;
+    QHash<QString, QTreeWidgetItem *> m_fileItems;
+    // Matches found but not displayed yet, because of the result limit: the search is paused, and only the files being
+    // searched when it was paused are here.
+    Core::FileSearchMatchList m_hiddenMatches;
+    int m_displayedCount = 0;
+    int m_resultLimit = 0;
 };
 
 } // namespace Gui
@@ -194,11 +194,29 @@ void TreeSitterInspector::changeQueryState()
 
         const QColor col = palette().color(QPalette::ColorGroup::Normal, QPalette::Highlight);
 
-        ui->queryInfo->setText(tr("<span style='color:%1'>%2 Patterns - %3 Matches - %4 Captures</span>")
-                                   .arg(patternCount == 0 || matchCount == 0 ? col.name() : "green")
-                                   .arg(patternCount)
-                                   .arg(matchCount)
-                                   .arg(m_treemodel.captureCount()));
+        auto info = tr("<span style='color:%1'>%2 Patterns - %3 Matches - %4 Captures</span>")
+                        .arg(patternCount == 0 || matchCount == 0 ? col.name() : "green")
+                        .arg(patternCount)
+                        .arg(matchCount)
+                        .arg(m_treemodel.captureCount());
+        // Expensive queries are stopped, the matches displayed are incomplete
+        if (m_treemodel.isQueryTimedOut())
+            info += tr("<br><span style='color:red'>Query stopped after %1ms, the matches are incomplete</span>")
+                        .arg(TreeSitterTreeModel::QueryTimeout);
+        else if (m_treemodel.didExceedMatchLimit())
+            info += tr("<br><span style='color:red'>More than %1 matches in progress, some matches may be "
+                       "missing</span>")
+                        .arg(TreeSitterTreeModel::QueryMatchLimit);
+        // Queries are always profiled in the inspector, the details per pattern and predicate are in the tooltip
+        const auto profile = m_treemodel.queryProfile();
+        if (profile.has_value()) {
+            info += tr("<br>%1ms - %2ms in predicates - %3 matches rejected")
+                        .arg(static_cast<double>(profile->time) / 1'000'000, 0, 'f', 3)
+                        .arg(static_cast<double>(profile->predicateTime()) / 1'000'000, 0, 'f', 3)
+                        .arg(profile->rejectedCount());
+        }
+        ui->queryInfo->setText(info);
+        ui->queryInfo->setToolTip(profile.has_value() ? profile->toString() : QString());
     }
 }
 
@@ -220,6 +238,7 @@ void TreeSitterInspector::changeQuery()
     if (text.isEmpty()) {
         m_treemodel.setQuery({}, makePredicates());
         ui->queryInfo->setText("");
+        ui->queryInfo->setToolTip("");
         m_errorHighlighter->setUtf8Position(-1);
         return;
     }
@@ -234,6 +253,7 @@ void TreeSitterInspector::changeQuery()
     } catch (treesitter::Query::Error &error) {
         m_treemodel.setQuery({}, nullptr);
         ui->queryInfo->setText(highlightQueryError(error));
+        ui->queryInfo->setToolTip("");
 
         // The error may be behind the last character, which couldn't be highlighted
         // So move back by one character in that case.
@@ -278,11 +278,19 @@ void TreeSitterTreeModel::clear()
 void TreeSitterTreeModel::executeQuery(std::unique_ptr<treesitter::Predicates> &&predicates)
 {
     treesitter::QueryCursor cursor;
+    cursor.setTimeout(QueryTimeout);
+    cursor.setMatchLimit(QueryMatchLimit);
+    // The profile is reported once the cursor is destroyed, at the end of this method
+    cursor.setProfiling([this](const treesitter::QueryProfile &profile) {
+        if (m_query.has_value())
+            m_query->profile = profile;
+    });
 
     if (m_rootNode && m_query.has_value()) {
         m_query->captures = decltype(m_query->captures)();
         m_query->numCaptures = 0;
         m_query->numMatches = 0;
+        m_query->profile.reset();
 
         cursor.execute(m_query->query, m_rootNode->tsNode(), std::move(predicates));
 
@@ -295,6 +303,8 @@ void TreeSitterTreeModel::executeQuery(std::unique_ptr<treesitter::Predicates> &
                 m_query->captures[capture.node] += " @" + m_query->query->captureAt(capture.id).name;
             }
         }
+        m_query->timedOut = cursor.isTimedOut();
+        m_query->exceededMatchLimit = cursor.didExceedMatchLimit();
     }
 }
 
@@ -389,4 +399,22 @@ int TreeSitterTreeModel::captureCount() const
     return 0;
 }
 
+bool TreeSitterTreeModel::isQueryTimedOut() const
+{
+    return m_query.has_value() && m_query->timedOut;
+}
+
+bool TreeSitterTreeModel::didExceedMatchLimit() const
+{
+    return m_query.has_value() && m_query->exceededMatchLimit;
+}
+
+std::optional<treesitter::QueryProfile> TreeSitterTreeModel::queryProfile() const
+{
+    if (m_query.has_value()) {
+        return m_query->profile;
+    }
+    return {};
+}
+
 }
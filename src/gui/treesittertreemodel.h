@@ -81,6 +81,13 @@ public:
     int patternCount() const;
     int captureCount() const;
     int matchCount() const;
+    bool isQueryTimedOut() const;
+    bool didExceedMatchLimit() const;
+    std::optional<treesitter::QueryProfile> queryProfile() const;
+
+    // The queries are run each time the query or the document changes: bound the time and memory they can use
+    static constexpr int QueryTimeout = 1000;
+    static constexpr uint32_t QueryMatchLimit = 4096;
 
 private:
     void positionChanged(int position);
@@ -96,6 +103,9 @@ private:
         std::unordered_map<treesitter::Node, QString> captures;
         int numMatches;
         int numCaptures;
+        bool timedOut = false;
+        bool exceededMatchLimit = false;
+        std::optional<treesitter::QueryProfile> profile;
     };
 
     std::optional<QueryData> m_query;
@@ -215,6 +215,14 @@ QString Node::textIn(const QString &source) const
     return source.sliced(start, end - start);
 }
 
+QStringView Node::textViewIn(const QString &source) const
+{
+    const auto start = this->startPosition();
+    const auto end = this->endPosition();
+
+    return QStringView(source).sliced(start, end - start);
+}
+
 QString Node::textExcept(const QString &source, const QList<QString> &nodeTypes) const
 {
     auto text = textIn(source);
@@ -18,6 +18,7 @@
 namespace treesitter {
 
 using Point = TSPoint;
+using Range = TSRange;
 
 class Node
 {
@@ -59,6 +60,8 @@ public:
     bool hasError() const;
 
     QString textIn(const QString &source) const;
+    // Same as textIn, without copying the text: the view is only valid as long as `source` is.
+    QStringView textViewIn(const QString &source) const;
     QString textExcept(const QString &source, const QVector<QString> &nodeTypes) const;
 
     Node descendantForRange(uint32_t left, uint32_t right) const;
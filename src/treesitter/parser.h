@@ -11,6 +11,8 @@
 #pragma once
 
 #include "core/document.h"
+#include "node.h"
+
 #include <QString>
 #include <tree_sitter/api.h>
 #include <vector>
@@ -21,7 +23,6 @@ struct TSLanguage;
 namespace treesitter {
 
 class Tree;
-using Range = TSRange;
 
 class Parser
 {
@@ -18,20 +18,20 @@
 #include <ranges>
 #include <set>
 
+#include <QElapsedTimer>
 #include <QRegularExpression>
 
 namespace treesitter {
 
-QString QString_identity(const QString &string)
+QString QString_no_whitespace(QStringView string)
 {
-    return string;
-}
-
-QString QString_no_whitespace(const QString &string)
-{
-    auto simplified = string.simplified();
-    simplified.replace(" ", "");
-    return simplified;
+    QString result;
+    result.reserve(string.size());
+    for (const auto c : string) {
+        if (!c.isSpace())
+            result.append(c);
+    }
+    return result;
 }
 
 Predicates::Filters Predicates::filters()
@@ -90,30 +90,41 @@ Predicates::Predicates(QString source)
 
 void Predicates::executeCommands(QueryMatch &match) const
 {
-    const auto patterns = match.query()->patterns();
-    const auto &pattern = patterns.at(match.patternIndex());
+    const auto &pattern = match.query()->patterns().at(match.patternIndex());
 
-    for (const auto &predicate : pattern.predicates) {
-        const auto commands = Predicates::commands();
+    static const auto commands = Predicates::commands();
+    QElapsedTimer timer;
+    for (int i = 0; i < pattern.predicates.size(); ++i) {
+        const auto &predicate = pattern.predicates.at(i);
         const auto it = commands.commandFunctions.find(predicate.name);
         if (it != commands.commandFunctions.cend()) {
             const auto commandPredicate = it->second;
+            if (m_profile)
+                timer.start();
             (this->*(commandPredicate))(match, predicate.arguments);
+            if (m_profile)
+                profilePredicate(match, i, timer.nsecsElapsed(), false);
         }
     }
 }
 
 bool Predicates::filterMatch(const QueryMatch &match) const
 {
-    const auto patterns = match.query()->patterns();
-    const auto &pattern = patterns.at(match.patternIndex());
+    const auto &pattern = match.query()->patterns().at(match.patternIndex());
 
-    for (const auto &predicate : pattern.predicates) {
-        const auto filters = Predicates::filters();
+    static const auto filters = Predicates::filters();
+    QElapsedTimer timer;
+    for (int i = 0; i < pattern.predicates.size(); ++i) {
+        const auto &predicate = pattern.predicates.at(i);
         const auto it = filters.filterFunctions.find(predicate.name);
         if (it != filters.filterFunctions.cend()) {
             const auto filterPredicate = it->second;
-            if (!(this->*(filterPredicate))(match, predicate.arguments)) {
+            if (m_profile)
+                timer.start();
+            const bool accepted = (this->*(filterPredicate))(match, predicate.arguments);
+            if (m_profile)
+                profilePredicate(match, i, timer.nsecsElapsed(), !accepted);
+            if (!accepted) {
                 return false;
             }
         }
@@ -122,6 +133,15 @@ bool Predicates::filterMatch(const QueryMatch &match) const
     return true;
 }
 
+void Predicates::profilePredicate(const QueryMatch &match, int predicateIndex, qint64 time, bool rejected) const
+{
+    auto &predicate = m_profile->patterns[match.patternIndex()].predicates[predicateIndex];
+    ++predicate.evaluationCount;
+    if (rejected)
+        ++predicate.rejectedCount;
+    predicate.time += time;
+}
+
 std::optional<QString> Predicates::checkCommand_exclude(const Predicates::PredicateArguments &arguments)
 {
     if (arguments.size() < 2) {
@@ -182,33 +202,49 @@ std::optional<QString> Predicates::checkFilter_eq(const Predicates::PredicateArg
     return {};
 }
 bool Predicates::filter_eq_with(const QueryMatch &match, const QList<std::variant<Query::Capture, QString>> &arguments,
-                                const std::function<QString(const QString &)> &textTransform) const
+                                const TextTransform &textTransform) const
 {
-    std::set<QString> texts;
+    // The texts are compared as views on the source, only transformed texts are allocated.
+    QString expectedStorage;
+    std::optional<QStringView> expected;
+    bool equal = true;
+    auto compare = [&](QStringView text) {
+        QString transformed;
+        if (textTransform) {
+            transformed = textTransform(text);
+            text = transformed;
+        }
+        if (!expected) {
+            expectedStorage = std::move(transformed);
+            expected = textTransform ? QStringView(expectedStorage) : text;
+        } else if (*expected != text) {
+            equal = false;
+        }
+    };
 
     const auto matched = matchArguments(match, arguments);
     for (const auto &arg : matched) {
         if (const auto *capture = std::get_if<QueryMatch::Capture>(&arg)) {
-            texts.emplace(textTransform(capture->node.textIn(m_source)));
+            compare(capture->node.textViewIn(m_source));
         } else if (const auto *string = std::get_if<QString>(&arg)) {
-            texts.emplace(textTransform(*string));
+            compare(*string);
         } else if (std::holds_alternative<MissingCapture>(arg)) {
             spdlog::warn("Predicates: #eq? - Unmatched capture!");
-            // Insert an empty string into the set if we find an unmatched capture.
+            // Compare with an empty string if we find an unmatched capture.
             // This likely means we have encountered a quantified capture that matched 0 times.
-            // By inserting an empty string, we can check that all other things are also "empty".
-            texts.emplace("");
+            // By comparing with an empty string, we can check that all other things are also "empty".
+            compare(QStringView());
         } else {
             spdlog::warn("Predicates: #eq? - Impossible argument type!");
             return false;
         }
     }
-    return texts.size() == 1;
+    return equal;
 }
 
 bool Predicates::filter_eq(const QueryMatch &match, const QList<std::variant<Query::Capture, QString>> &arguments) const
 {
-    return filter_eq_with(match, arguments, QString_identity);
+    return filter_eq_with(match, arguments, {});
 }
 
 std::optional<QString> Predicates::checkFilter_eq_except(const Predicates::PredicateArguments &arguments)
@@ -244,11 +280,11 @@ bool Predicates::filter_like(const QueryMatch &match,
 }
 bool Predicates::filter_eq_except_with(const QueryMatch &match,
                                        const QList<std::variant<Query::Capture, QString>> &arguments,
-                                       const std::function<QString(const QString &)> &textTransform) const
+                                       const TextTransform &textTransform) const
 {
     auto args = arguments;
     if (const auto *rawExpected = std::get_if<QString>(&args.front())) {
-        auto expected = textTransform(*rawExpected);
+        auto expected = textTransform ? textTransform(*rawExpected) : *rawExpected;
         args.pop_front();
         if (const auto *rawCapture = std::get_if<Query::Capture>(&args.front())) {
             // we need to copy the capture here, as otherwise it might get dropped
@@ -273,7 +309,8 @@ bool Predicates::filter_eq_except_with(const QueryMatch &match,
             }
 
             for (const auto &idCapture : idCaptures) {
-                if (expected != textTransform(idCapture.node.textExcept(m_source, types))) {
+                const auto text = idCapture.node.textExcept(m_source, types);
+                if (expected != (textTransform ? textTransform(text) : text)) {
                     return false;
                 }
             }
@@ -291,7 +328,7 @@ bool Predicates::filter_eq_except_with(const QueryMatch &match,
 
 bool Predicates::filter_eq_except(const QueryMatch &match, const PredicateArguments &arguments) const
 {
-    return filter_eq_except_with(match, arguments, QString_identity);
+    return filter_eq_except_with(match, arguments, {});
 }
 
 bool Predicates::filter_like_except(const QueryMatch &match, const PredicateArguments &arguments) const
@@ -380,6 +417,27 @@ std::optional<QString> Predicates::checkFilter_not_is(const Predicates::Predicat
     return std::nullopt;
 }
 
+// Keeps the regular expressions of the query for the thread of the cursor, so the query is only asked (and locked)
+// once, not for each match.
+class RegularExpressionCache : public PredicateCache
+{
+public:
+    ~RegularExpressionCache() override = default;
+
+    const QHash<QString, QRegularExpression> &regularExpressions(const Query *query)
+    {
+        if (query != m_query) {
+            m_query = query;
+            m_regularExpressions = &query->regularExpressions();
+        }
+        return *m_regularExpressions;
+    }
+
+private:
+    const Query *m_query = nullptr;
+    const QHash<QString, QRegularExpression> *m_regularExpressions = nullptr;
+};
+
 bool Predicates::filter_match(const QueryMatch &match,
                               const QList<std::variant<Query::Capture, QString>> &arguments) const
 {
@@ -390,7 +448,17 @@ bool Predicates::filter_match(const QueryMatch &match,
     }
 
     if (const auto regexString = std::get_if<QString>(&matched.first())) {
-        const QRegularExpression regex(*regexString);
+        // The regular expression is compiled by the query for this thread, see Query::regularExpressions
+        auto *cache = findCache<RegularExpressionCache>();
+        if (!cache) {
+            auto newCache = std::make_unique<RegularExpressionCache>();
+            cache = newCache.get();
+            insertCache(std::move(newCache));
+        }
+        const auto &regularExpressions = cache->regularExpressions(match.query().get());
+        const auto compiledRegex = regularExpressions.constFind(*regexString);
+        const auto regex =
+            compiledRegex != regularExpressions.cend() ? *compiledRegex : QRegularExpression(*regexString);
         if (!regex.isValid()) {
             spdlog::warn("Predicates: #match? - Invalid regex");
             return false;
@@ -398,8 +466,7 @@ bool Predicates::filter_match(const QueryMatch &match,
 
         for (const auto &argument : matched | std::views::drop(1)) {
             if (const auto *capture = std::get_if<QueryMatch::Capture>(&argument)) {
-                auto source = capture->node.textIn(m_source);
-                if (!regex.match(source).hasMatch()) {
+                if (!regex.matchView(capture->node.textViewIn(m_source)).hasMatch()) {
                     return false;
                 }
             } else if (std::holds_alternative<MissingCapture>(argument)) {
@@ -553,4 +620,9 @@ void Predicates::setRootNode(const Node &node)
 {
     m_rootNode = node;
 }
+
+void Predicates::setProfile(std::shared_ptr<QueryProfile> profile)
+{
+    m_profile = std::move(profile);
+}
 }
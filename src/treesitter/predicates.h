@@ -89,10 +89,12 @@ private:
     PREDICATE_FILTER(not_is);
 #undef PREDICATE_FILTER
 
+    // Transforms the texts before comparing them, an empty transform compares the texts as they are
+    using TextTransform = std::function<QString(QStringView)>;
     bool filter_eq_with(const QueryMatch &match, const QVector<std::variant<Query::Capture, QString>> &arguments,
-                        const std::function<QString(const QString &)> &textTransform) const;
+                        const TextTransform &textTransform) const;
     bool filter_eq_except_with(const QueryMatch &match, const QVector<std::variant<Query::Capture, QString>> &arguments,
-                               const std::function<QString(const QString &)> &textTransform) const;
+                               const TextTransform &textTransform) const;
 
     // ################## Argument matching #########################
     // Marker type indicating a capture is missing
@@ -125,9 +127,13 @@ private:
     // ################## Context data #########################
     friend class QueryCursor;
     void setRootNode(const Node &node);
+    void setProfile(std::shared_ptr<QueryProfile> profile);
+
+    void profilePredicate(const QueryMatch &match, int predicateIndex, qint64 time, bool rejected) const;
 
     const QString m_source;
     std::optional<Node> m_rootNode;
+    std::shared_ptr<QueryProfile> m_profile;
 };
 
 }
@@ -12,7 +12,11 @@
 #include "node.h"
 #include "predicates.h"
 
+#include <QDeadlineTimer>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QStringList>
+#include <algorithm>
 #include <kdalgorithms.h>
 #include <tree_sitter/api.h>
 
@@ -36,8 +40,16 @@ Query::Query(const TSLanguage *language, const QString &query)
         };
     }
 
-    const auto patterns = this->patterns();
-    for (const auto &pattern : patterns) {
+    auto count = ts_query_pattern_count(m_query);
+    m_patterns.reserve(count);
+    for (uint32_t patternIndex = 0; patternIndex < count; ++patternIndex) {
+        auto start_byte = ts_query_start_byte_for_pattern(m_query, patternIndex);
+        auto predicates = predicatesForPattern(patternIndex);
+
+        m_patterns.emplace_back(Pattern {.predicates = std::move(predicates), .utf8_start_byte = start_byte});
+    }
+
+    for (const auto &pattern : std::as_const(m_patterns)) {
         for (const auto &predicate : pattern.predicates) {
             auto error = Predicates::checkPredicate(predicate);
             if (error.has_value()) {
@@ -47,12 +59,23 @@ Query::Query(const TSLanguage *language, const QString &query)
 
                 throw Error {.utf8_offset = static_cast<uint32_t>(offset), .description = error.value()};
             }
+
+            // The regular expressions are compiled once per thread, instead of for each match, see regularExpressions
+            if (predicate.name == "match?" && !predicate.arguments.isEmpty()) {
+                if (const auto pattern = std::get_if<QString>(&predicate.arguments.first());
+                    pattern && !m_regularExpressionPatterns.contains(*pattern))
+                    m_regularExpressionPatterns.push_back(*pattern);
+            }
         }
     }
 }
 
 Query::Query(Query &&other) noexcept
-    : m_query(other.m_query)
+    : m_utf8_text(std::move(other.m_utf8_text))
+    , m_query(other.m_query)
+    , m_patterns(std::move(other.m_patterns))
+    , m_regularExpressionPatterns(std::move(other.m_regularExpressionPatterns))
+    , m_regularExpressions(std::move(other.m_regularExpressions))
 {
     other.m_query = nullptr;
 }
@@ -72,7 +95,11 @@ Query &Query::operator=(Query &&other) noexcept
 
 void Query::swap(Query &other) noexcept
 {
+    std::swap(m_utf8_text, other.m_utf8_text);
     std::swap(m_query, other.m_query);
+    std::swap(m_patterns, other.m_patterns);
+    std::swap(m_regularExpressionPatterns, other.m_regularExpressionPatterns);
+    std::swap(m_regularExpressions, other.m_regularExpressions);
 }
 
 QList<Query::Predicate> Query::predicatesForPattern(uint32_t index) const
@@ -110,19 +137,32 @@ QList<Query::Predicate> Query::predicatesForPattern(uint32_t index) const
     return predicates;
 }
 
-QList<Query::Pattern> Query::patterns() const
+QString Query::source() const
 {
-    QList<Query::Pattern> result;
+    return QString::fromUtf8(m_utf8_text);
+}
 
-    auto count = ts_query_pattern_count(m_query);
-    result.reserve(count);
-    for (uint32_t patternIndex = 0; patternIndex < count; ++patternIndex) {
-        auto start_byte = ts_query_start_byte_for_pattern(m_query, patternIndex);
-        auto predicates = predicatesForPattern(patternIndex);
+const QList<Query::Pattern> &Query::patterns() const
+{
+    return m_patterns;
+}
 
-        result.emplace_back(Pattern {.predicates = std::move(predicates), .utf8_start_byte = start_byte});
+const QHash<QString, QRegularExpression> &Query::regularExpressions() const
+{
+    std::lock_guard lock(m_regularExpressionsMutex);
+    auto it = m_regularExpressions.find(std::this_thread::get_id());
+    if (it == m_regularExpressions.end()) {
+        QHash<QString, QRegularExpression> regularExpressions;
+        for (const auto &pattern : m_regularExpressionPatterns) {
+            QRegularExpression regex(pattern);
+            regex.optimize();
+            regularExpressions.insert(pattern, std::move(regex));
+        }
+        // Thread ids may be reused, but only once the previous thread is done with the query
+        it = m_regularExpressions.emplace(std::this_thread::get_id(), std::move(regularExpressions)).first;
     }
-    return result;
+    // The node of the map, and the hash, are not changed anymore: no need to lock to use them
+    return it->second;
 }
 
 QList<Query::Capture> Query::captures() const
@@ -205,14 +245,57 @@ QList<QueryMatch::Capture> QueryMatch::capturesWithId(uint32_t id) const
     });
 }
 
+// ------------------- CancellationToken ------------------
+CancellationToken::CancellationToken()
+    : m_cancelled(std::make_shared<std::atomic<bool>>(false))
+{
+}
+
+void CancellationToken::cancel()
+{
+    m_cancelled->store(true, std::memory_order_relaxed);
+}
+
+bool CancellationToken::isCancelled() const
+{
+    return m_cancelled->load(std::memory_order_relaxed);
+}
+
 // ----------------------- QueryCursor --------------------
+struct QueryCursor::Interruption
+{
+    QDeadlineTimer deadline = QDeadlineTimer::Forever;
+    std::optional<CancellationToken> cancellationToken;
+    bool timedOut = false;
+    bool cancelled = false;
+
+    bool check()
+    {
+        if (!timedOut && !deadline.isForever())
+            timedOut = deadline.hasExpired();
+        if (!cancelled && cancellationToken.has_value())
+            cancelled = cancellationToken->isCancelled();
+        return timedOut || cancelled;
+    }
+
+#if TREE_SITTER_LANGUAGE_VERSION >= 15
+    // Called regularly by Tree-sitter while searching for the next match, returning true stops the query.
+    static bool progressCallback(TSQueryCursorState *state)
+    {
+        return static_cast<Interruption *>(state->payload)->check();
+    }
+#endif
+};
+
 QueryCursor::QueryCursor()
-    : m_cursor(ts_query_cursor_new())
+    : m_interruption(std::make_unique<Interruption>())
+    , m_cursor(ts_query_cursor_new())
 {
 }
 
 QueryCursor::~QueryCursor()
 {
+    reportProfile();
     if (m_cursor) {
         ts_query_cursor_delete(m_cursor);
     }
@@ -220,6 +303,11 @@ QueryCursor::~QueryCursor()
 
 QueryCursor::QueryCursor(QueryCursor &&other) noexcept
     : m_query(std::move(other.m_query))
+    , m_progressCallback(std::move(other.m_progressCallback))
+    , m_timeout(other.m_timeout)
+    , m_interruption(std::move(other.m_interruption))
+    , m_profileReport(std::move(other.m_profileReport))
+    , m_profile(std::move(other.m_profile))
     , m_predicates(std::move(other.m_predicates))
     , m_cursor(std::move(other.m_cursor))
 {
@@ -234,17 +322,42 @@ QueryCursor &QueryCursor::operator=(QueryCursor &&other) noexcept
 
 void QueryCursor::swap(QueryCursor &other) noexcept
 {
+    std::swap(m_query, other.m_query);
+    std::swap(m_progressCallback, other.m_progressCallback);
+    std::swap(m_timeout, other.m_timeout);
+    std::swap(m_interruption, other.m_interruption);
+    std::swap(m_profileReport, other.m_profileReport);
+    std::swap(m_profile, other.m_profile);
+    std::swap(m_predicates, other.m_predicates);
     std::swap(m_cursor, other.m_cursor);
 }
 
 void QueryCursor::execute(std::shared_ptr<Query> query, const Node &node, std::unique_ptr<Predicates> &&predicates)
 {
+    reportProfile();
+
     m_predicates = std::move(predicates);
     if (m_predicates) {
         m_predicates->setRootNode(node);
     }
     m_query = std::move(query);
+    if (m_profileReport) {
+        m_profile = std::make_shared<QueryProfile>(*m_query);
+        if (m_predicates)
+            m_predicates->setProfile(m_profile);
+    }
+    m_interruption->deadline = m_timeout > 0 ? QDeadlineTimer(m_timeout) : QDeadlineTimer(QDeadlineTimer::Forever);
+    m_interruption->timedOut = false;
+    m_interruption->cancelled = false;
+#if TREE_SITTER_LANGUAGE_VERSION >= 15
+    const TSQueryCursorOptions options {.payload = m_interruption.get(),
+                                        .progress_callback = &Interruption::progressCallback};
+    ts_query_cursor_exec_with_options(m_cursor, m_query->m_query, node.m_node, &options);
+#else
+    // Older Tree-sitter versions can't be cancelled while searching for a match, only timed out
+    ts_query_cursor_set_timeout_micros(m_cursor, static_cast<uint64_t>(std::max(m_timeout, 0)) * 1000);
     ts_query_cursor_exec(m_cursor, m_query->m_query, node.m_node);
+#endif
 }
 
 void QueryCursor::setProgressCallback(std::function<void()> callback)
@@ -252,17 +365,88 @@ void QueryCursor::setProgressCallback(std::function<void()> callback)
     m_progressCallback = std::move(callback);
 }
 
+void QueryCursor::setMatchLimit(uint32_t limit)
+{
+    ts_query_cursor_set_match_limit(m_cursor, limit);
+}
+
+uint32_t QueryCursor::matchLimit() const
+{
+    return ts_query_cursor_match_limit(m_cursor);
+}
+
+bool QueryCursor::didExceedMatchLimit() const
+{
+    return ts_query_cursor_did_exceed_match_limit(m_cursor);
+}
+
+void QueryCursor::setTimeout(int msecs)
+{
+    m_timeout = msecs;
+}
+
+void QueryCursor::setCancellationToken(CancellationToken token)
+{
+    m_interruption->cancellationToken = std::move(token);
+}
+
+bool QueryCursor::isTimedOut() const
+{
+    return m_interruption->timedOut;
+}
+
+bool QueryCursor::isCancelled() const
+{
+    return m_interruption->cancelled;
+}
+
+void QueryCursor::setProfiling(std::function<void(const QueryProfile &)> report)
+{
+    m_profileReport = std::move(report);
+}
+
+void QueryCursor::reportProfile()
+{
+    if (m_profile && m_profileReport)
+        m_profileReport(*m_profile);
+    m_profile.reset();
+}
+
+bool QueryCursor::isInterrupted()
+{
+    return m_interruption->check();
+}
+
 std::optional<QueryMatch> QueryCursor::nextMatch()
+{
+    if (!m_profile)
+        return findNextMatch();
+
+    QElapsedTimer timer;
+    timer.start();
+    auto result = findNextMatch();
+    m_profile->time += timer.nsecsElapsed();
+    return result;
+}
+
+std::optional<QueryMatch> QueryCursor::findNextMatch()
 {
     TSQueryMatch match;
 
-    while (ts_query_cursor_next_match(m_cursor, &match)) {
+    // Tree-sitter stops by itself once interrupted, checking between two matches is a fallback for the cancellation
+    // with older Tree-sitter versions.
+    while (!isInterrupted() && ts_query_cursor_next_match(m_cursor, &match)) {
+        if (m_profile)
+            ++m_profile->patterns[match.pattern_index].matchCount;
+
         QueryMatch result(match, m_query);
         if (m_predicates) {
             m_predicates->executeCommands(result);
             if (m_predicates->filterMatch(result)) {
                 return result;
             }
+            if (m_profile)
+                ++m_profile->patterns[match.pattern_index].rejectedCount;
         } else {
             return result;
         }
@@ -271,6 +455,8 @@ std::optional<QueryMatch> QueryCursor::nextMatch()
             m_progressCallback();
         }
     }
+    // Tree-sitter returns no match once timed out or cancelled: update the state for isTimedOut and isCancelled
+    isInterrupted();
     return {};
 }
 
@@ -283,4 +469,95 @@ QList<QueryMatch> QueryCursor::allRemainingMatches()
     return matches;
 }
 
+// ------------------------ QueryCache --------------------
+QueryCache &QueryCache::instance()
+{
+    static QueryCache cache;
+    return cache;
+}
+
+size_t QueryCache::KeyHash::operator()(const Key &key) const noexcept
+{
+    return std::hash<const void *> {}(key.language) ^ qHash(key.query);
+}
+
+std::shared_ptr<Query> QueryCache::get(const TSLanguage *language, const QString &query)
+{
+    Key key {.language = language, .query = query};
+    {
+        std::lock_guard lock(m_mutex);
+        auto it = m_index.find(key);
+        if (it != m_index.end()) {
+            ++m_hits;
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+            return it->second->second;
+        }
+        ++m_misses;
+    }
+
+    // Compile outside of the lock, so other threads are not blocked meanwhile.
+    auto result = std::make_shared<Query>(language, query);
+
+    std::lock_guard lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+        // Another thread compiled the same query in the meantime
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return it->second->second;
+    }
+    m_entries.emplace_front(key, result);
+    m_index.emplace(std::move(key), m_entries.begin());
+    evict();
+    return result;
+}
+
+int QueryCache::hits() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_hits;
+}
+
+int QueryCache::misses() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_misses;
+}
+
+int QueryCache::size() const
+{
+    std::lock_guard lock(m_mutex);
+    return static_cast<int>(m_entries.size());
+}
+
+int QueryCache::capacity() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_capacity;
+}
+
+void QueryCache::setCapacity(int capacity)
+{
+    std::lock_guard lock(m_mutex);
+    m_capacity = std::max(capacity, 0);
+    evict();
+}
+
+void QueryCache::clear()
+{
+    std::lock_guard lock(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_hits = 0;
+    m_misses = 0;
+}
+
+void QueryCache::evict()
+{
+    // Queries still in use are kept alive by their shared_ptr, only the cache entry is removed.
+    while (static_cast<int>(m_entries.size()) > m_capacity) {
+        m_index.erase(m_entries.back().first);
+        m_entries.pop_back();
+    }
+}
+
 }
@@ -11,12 +11,21 @@
 #pragma once
 
 #include "node.h"
+#include "query_profile.h"
 
 #include <QByteArray>
+#include <QHash>
+#include <QRegularExpression>
 #include <QString>
+#include <QStringList>
 #include <QVector>
+#include <atomic>
 #include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
 #include <tree_sitter/api.h>
+#include <unordered_map>
 
 struct TSLanguage;
 struct TSQuery;
@@ -67,7 +76,12 @@ public:
 
     void swap(Query &other) noexcept;
 
-    QVector<Pattern> patterns() const;
+    QString source() const;
+    const QVector<Pattern> &patterns() const;
+
+    // Returns the regular expressions of the `#match?` predicates, by pattern, compiled for the calling thread.
+    // QRegularExpression is only reentrant, so each thread using the query compiles its own copies, once.
+    const QHash<QString, QRegularExpression> &regularExpressions() const;
 
     QVector<Capture> captures() const;
     Capture captureAt(uint32_t index) const;
@@ -77,6 +91,13 @@ private:
 
     QByteArray m_utf8_text;
     TSQuery *m_query;
+    // Computed once, the query is immutable afterwards and can be used by multiple threads, the regular expressions
+    // excepted: they are compiled for each thread, see regularExpressions
+    QVector<Pattern> m_patterns;
+    QStringList m_regularExpressionPatterns;
+    // Compiled by each thread on first use, an entry is never changed once added
+    mutable std::mutex m_regularExpressionsMutex;
+    mutable std::unordered_map<std::thread::id, QHash<QString, QRegularExpression>> m_regularExpressions;
 
     friend class QueryCursor;
 };
@@ -121,6 +142,20 @@ private:
     friend class QueryCursor;
 };
 
+// Cooperative cancellation of a query: copies share the same state, so the query can be cancelled from elsewhere
+// (another thread, or an event processed while the query is running).
+class CancellationToken
+{
+public:
+    CancellationToken();
+
+    void cancel();
+    bool isCancelled() const;
+
+private:
+    std::shared_ptr<std::atomic<bool>> m_cancelled;
+};
+
 // TODO: Should this also be a member-class of Query?
 class QueryCursor
 {
@@ -150,11 +185,44 @@ public:
     // It allows the UI to update and remain responsive while the query is running.
     void setProgressCallback(std::function<void()> callback);
 
+    // Maximum number of in-progress matches kept by Tree-sitter, see ts_query_cursor_set_match_limit.
+    // When exceeded, the oldest in-progress matches are dropped: some matches may be missing.
+    // Must be set before calling execute.
+    void setMatchLimit(uint32_t limit);
+    uint32_t matchLimit() const;
+    bool didExceedMatchLimit() const;
+
+    // The timeout (in milliseconds, 0 for none) and the cancellation token are checked by Tree-sitter while searching
+    // for the next match, so a pathological pattern is stopped too. With Tree-sitter versions not supporting a
+    // progress callback, the timeout uses ts_query_cursor_set_timeout_micros and the cancellation token is only
+    // checked between two matches. Once timed out or cancelled, nextMatch doesn't return any new match.
+    // The timeout starts when calling execute.
+    void setTimeout(int msecs);
+    void setCancellationToken(CancellationToken token);
+    bool isTimedOut() const;
+    bool isCancelled() const;
+
+    // Opt-in profiling of the query: matches and time per pattern and per predicate. `report` is called with the
+    // profile once the query is done: when the cursor is destroyed, or executed again.
+    // Must be set before calling execute.
+    void setProfiling(std::function<void(const QueryProfile &)> report);
+
 private:
+    // State of the timeout and cancellation, on the heap so Tree-sitter can check it even if the cursor is moved
+    struct Interruption;
+
+    bool isInterrupted();
+    std::optional<QueryMatch> findNextMatch();
+    void reportProfile();
+
     // The query must be kept alive for as long as the cursor is alive.
     // Otherwise, no new matches can be returned and the Predicates can't be executed.
     std::shared_ptr<Query> m_query;
     std::function<void()> m_progressCallback;
+    int m_timeout = 0;
+    std::unique_ptr<Interruption> m_interruption;
+    std::function<void(const QueryProfile &)> m_profileReport;
+    std::shared_ptr<QueryProfile> m_profile;
 
     std::unique_ptr<Predicates> m_predicates;
     TSQueryCursor *m_cursor;
@@ -162,4 +230,50 @@ private:
 
 using QueryList = QVector<std::shared_ptr<Query>>;
 
+// Process-wide LRU cache of compiled queries, keyed by language and query text.
+// Constructing a query is expensive, and the same queries are run over and over by scripts and helpers.
+// The cache is thread-safe, compiled queries can be shared between threads.
+class QueryCache
+{
+public:
+    static QueryCache &instance();
+
+    // throws a Query::Error if the query is ill-formed, errors are not cached.
+    std::shared_ptr<Query> get(const TSLanguage *language, const QString &query);
+
+    int hits() const;
+    int misses() const;
+    int size() const;
+
+    int capacity() const;
+    void setCapacity(int capacity);
+
+    void clear();
+
+private:
+    QueryCache() = default;
+
+    struct Key
+    {
+        const TSLanguage *language;
+        QString query;
+        bool operator==(const Key &other) const = default;
+    };
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const noexcept;
+    };
+    using Entry = std::pair<Key, std::shared_ptr<Query>>;
+
+    void evict();
+
+    mutable std::mutex m_mutex;
+    // Most recently used first
+    std::list<Entry> m_entries;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> m_index;
+    int m_capacity = 256;
+    int m_hits = 0;
+    int m_misses = 0;
+};
+
 }
@@ -0,0 +1,105 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "query_profile.h"
+#include "query.h"
+
+#include <QJsonArray>
+#include <QStringList>
+
+namespace treesitter {
+
+static QString formatTime(qint64 nanoseconds)
+{
+    return QString("%1ms").arg(static_cast<double>(nanoseconds) / 1'000'000, 0, 'f', 3);
+}
+
+QueryProfile::QueryProfile(const Query &query)
+{
+    const auto &queryPatterns = query.patterns();
+    patterns.reserve(queryPatterns.size());
+    for (const auto &queryPattern : queryPatterns) {
+        Pattern pattern;
+        pattern.predicates.reserve(queryPattern.predicates.size());
+        for (const auto &predicate : queryPattern.predicates)
+            pattern.predicates.emplace_back(Predicate {.name = predicate.name});
+        patterns.emplace_back(std::move(pattern));
+    }
+}
+
+int QueryProfile::matchCount() const
+{
+    int result = 0;
+    for (const auto &pattern : patterns)
+        result += pattern.matchCount;
+    return result;
+}
+
+int QueryProfile::rejectedCount() const
+{
+    int result = 0;
+    for (const auto &pattern : patterns)
+        result += pattern.rejectedCount;
+    return result;
+}
+
+qint64 QueryProfile::predicateTime() const
+{
+    qint64 result = 0;
+    for (const auto &pattern : patterns) {
+        for (const auto &predicate : pattern.predicates)
+            result += predicate.time;
+    }
+    return result;
+}
+
+QString QueryProfile::toString() const
+{
+    QStringList lines;
+    lines.append(QString("%1 total, %2 in predicates - %3 matches, %4 rejected")
+                     .arg(formatTime(time), formatTime(predicateTime()))
+                     .arg(matchCount())
+                     .arg(rejectedCount()));
+    for (int index = 0; index < patterns.size(); ++index) {
+        const auto &pattern = patterns.at(index);
+        lines.append(QString("  pattern %1: %2 matches, %3 rejected")
+                         .arg(index)
+                         .arg(pattern.matchCount)
+                         .arg(pattern.rejectedCount));
+        for (const auto &predicate : pattern.predicates) {
+            lines.append(QString("    #%1: %2 evaluations, %3 rejected, %4")
+                             .arg(predicate.name)
+                             .arg(predicate.evaluationCount)
+                             .arg(predicate.rejectedCount)
+                             .arg(formatTime(predicate.time)));
+        }
+    }
+    return lines.join('\n');
+}
+
+QJsonObject QueryProfile::toJson() const
+{
+    QJsonArray jsonPatterns;
+    for (const auto &pattern : patterns) {
+        QJsonArray jsonPredicates;
+        for (const auto &predicate : pattern.predicates) {
+            jsonPredicates.append(QJsonObject {{"name", predicate.name},
+                                               {"evaluations", predicate.evaluationCount},
+                                               {"rejected", predicate.rejectedCount},
+                                               {"time", predicate.time}});
+        }
+        jsonPatterns.append(QJsonObject {{"matches", pattern.matchCount},
+                                         {"rejected", pattern.rejectedCount},
+                                         {"predicates", jsonPredicates}});
+    }
+    return QJsonObject {{"time", time}, {"patterns", jsonPatterns}};
+}
+
+}
@@ -0,0 +1,58 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#pragma once
+
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+namespace treesitter {
+
+class Query;
+
+// Cost of a query, recorded by a QueryCursor with profiling enabled (see QueryCursor::setProfiling).
+// Times are in nanoseconds.
+struct QueryProfile
+{
+    struct Predicate
+    {
+        QString name;
+        int evaluationCount = 0;
+        // Number of matches rejected by this predicate, only for filters (e.g. #eq?)
+        int rejectedCount = 0;
+        qint64 time = 0;
+    };
+
+    struct Pattern
+    {
+        // Matches found by Tree-sitter, before the predicates are run
+        int matchCount = 0;
+        int rejectedCount = 0;
+        // Same order as the predicates of the pattern in the query
+        QVector<Predicate> predicates;
+    };
+
+    explicit QueryProfile(const Query &query);
+
+    // Total time spent in QueryCursor::nextMatch, predicates included
+    qint64 time = 0;
+    QVector<Pattern> patterns;
+
+    int matchCount() const;
+    int rejectedCount() const;
+    qint64 predicateTime() const;
+
+    // Human readable summary, one line per pattern and predicate
+    QString toString() const;
+    QJsonObject toJson() const;
+};
+
+}
@@ -10,6 +10,7 @@
 
 #include "tree.h"
 
+#include <cstdlib>
 #include <tree_sitter/api.h>
 #include <utility>
 
@@ -49,4 +50,19 @@ Node Tree::rootNode() const
     return Node(ts_tree_root_node(m_tree));
 }
 
+void Tree::edit(const InputEdit &edit)
+{
+    ts_tree_edit(m_tree, &edit);
+}
+
+QList<Range> Tree::changedRanges(const Tree &newTree) const
+{
+    uint32_t length = 0;
+    auto *ranges = ts_tree_get_changed_ranges(m_tree, newTree.m_tree, &length);
+    QList<Range> result(ranges, ranges + length);
+    // The array is allocated by Tree-sitter, and must be freed by the caller
+    free(ranges);
+    return result;
+}
+
 }
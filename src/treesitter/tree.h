@@ -12,11 +12,14 @@
 
 #include "node.h"
 
+#include <tree_sitter/api.h>
+
 struct TSTree;
 
 namespace treesitter {
 
 class Parser;
+using InputEdit = TSInputEdit;
 
 class Tree
 {
@@ -31,6 +34,15 @@ public:
 
     Node rootNode() const;
 
+    // Adjusts the tree to be in sync with an edit of the source code.
+    // The edited tree can then be passed to Parser::parseString to reparse
+    // the document incrementally.
+    void edit(const InputEdit &edit);
+
+    // Returns the ranges whose syntactic structure changed between this tree, edited, and `newTree`, parsed from it.
+    // The ranges are using the positions of `newTree`.
+    QList<Range> changedRanges(const Tree &newTree) const;
+
     void swap(Tree &other) noexcept;
 
 private:
@@ -40,8 +52,8 @@ private:
 
     friend class Parser;
 
-    // TODO: Once update is implemented, store weak pointers to all
-    // TSNodes so that they may be updated as well.
+    // TODO: Store weak pointers to all TSNodes so that they may be updated
+    // as well when the tree is edited.
 };
 
 }
@@ -36,6 +36,11 @@ bool TreeCursor::gotoFirstChild()
     return ts_tree_cursor_goto_first_child(&m_cursor);
 }
 
+bool TreeCursor::gotoFirstChildForPosition(uint32_t position)
+{
+    return ts_tree_cursor_goto_first_child_for_byte(&m_cursor, position * sizeof(QChar)) != -1;
+}
+
 bool TreeCursor::gotoNextSibling()
 {
     return ts_tree_cursor_goto_next_sibling(&m_cursor);
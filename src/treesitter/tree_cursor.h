@@ -26,6 +26,8 @@ public:
     QString currentFieldName() const;
 
     bool gotoFirstChild();
+    /// Moves to the first child ending after `position` (in characters), skipping the children before it
+    bool gotoFirstChildForPosition(uint32_t position);
     bool gotoNextSibling();
     bool gotoParent();
 
@@ -34,33 +34,183 @@ Script {
         compare(rcdoc.type, Document.Rc)
     }
 
+    function test_get() {
+        Project.root = Dir.currentScriptPath + "/projects/mfc-dialog"
+
+        // Relative and absolute paths give the same document
+        let document = Project.get("Tutorial.h")
+        compare(Project.get(Project.root + "/Tutorial.h"), document)
+        compare(Project.get(Project.root + "/res/../Tutorial.h"), document)
+        compare(Project.documents.filter(d => d === document).length, 1)
+    }
+
+    function test_openPrevious() {
+        Project.root = Dir.currentScriptPath + "/projects/mfc-dialog"
+
+        let first = Project.open("pch.h")
+        let second = Project.open("pch.cpp")
+        compare(Project.openPrevious(), first)
+        compare(Project.currentDocument, first)
+        compare(Project.openPrevious(), second)
+        compare(Project.documents[Project.documents.length - 1], second)
+    }
+
     function test_findInFiles() {
-        if(Project.isFindInFilesAvailable()) {
         let simplePattern = "CTutorialApp::InitInstance()"
         let simpleResults = Project.findInFiles(simplePattern)
 
-            compare(simpleResults.length, 2)
+        compare(simpleResults.length, 2)
 
-            simpleResults.sort((a, b) => a.file.localeCompare(b.file));
+        simpleResults.sort((a, b) => a.file.localeCompare(b.file));
 
-            compare(simpleResults[0].file, Project.root + "/Tutorial.cpp")
-            compare(simpleResults[0].line, 38)
-            compare(simpleResults[0].column, 6)
-            compare(simpleResults[1].file, Project.root + "/TutorialDlg.h")
-            compare(simpleResults[1].line, 9)
-            compare(simpleResults[1].column, 9)
+        compare(simpleResults[0].file, Project.root + "/Tutorial.cpp")
+        compare(simpleResults[0].line, 38)
+        compare(simpleResults[0].column, 6)
+        verify(simpleResults[0].text.includes("CTutorialApp::InitInstance"))
+        compare(simpleResults[1].file, Project.root + "/TutorialDlg.h")
+        compare(simpleResults[1].line, 9)
+        compare(simpleResults[1].column, 9)
 
-            let multilinePattern = "SetIcon\\(m_hIcon,\\s*TRUE\\);.*\\s*SetIcon\\(m_hIcon,\\s*FALSE\\);";
-            let multilineResults = Project.findInFiles(multilinePattern)
+        let multilinePattern = "SetIcon\\(m_hIcon,\\s*TRUE\\);.*\\s*SetIcon\\(m_hIcon,\\s*FALSE\\);";
+        let multilineResults = Project.findInFiles(multilinePattern)
+
+        compare(multilineResults.length, 1)
+
+        compare(multilineResults[0].file, Project.root + "/TutorialDlg.cpp")
+        compare(multilineResults[0].line, 58)
+        compare(multilineResults[0].column, 2)
+    }
+
+    function test_queryInFiles() {
+        Project.root = Dir.currentScriptPath + "/projects/mfc-dialog"
+
+        let query = `(function_definition
+                        declarator: (function_declarator
+                            declarator: (qualified_identifier name: (identifier) @name))
+                        (#eq? @name "InitInstance"))`
+        let matches = Project.queryInFiles(["cpp", "h"], query)
+
+        compare(matches.length, 1)
+        compare(matches[0].file, Project.root + "/Tutorial.cpp")
+        compare(matches[0].captures.length, 1)
+        compare(matches[0].captures[0].name, "name")
+        compare(matches[0].captures[0].line, 38)
+        compare(matches[0].captures[0].column, 20)
+        compare(matches[0].captures[0].text, "InitInstance")
+
+        // Files without Tree-sitter support are ignored
+        compare(Project.queryInFiles(["rc"], query).length, 0)
+    }
 
-            compare(multilineResults.length, 1)
+    function test_queryEach() {
+        Project.root = Dir.currentScriptPath + "/projects/mfc-dialog"
 
-            compare(multilineResults[0].file, Project.root + "/TutorialDlg.cpp")
-            compare(multilineResults[0].line, 58)
-            compare(multilineResults[0].column, 2)
+        let document = Project.get("Tutorial.cpp")
+        let query = "(function_definition declarator: (_) @declarator)"
+        let matches = document.query(query)
+        verify(matches.length > 1)
+
+        let declarators = []
+        compare(document.queryEach(query, match => { declarators.push(match.get("declarator").text) }), matches.length)
+        compare(declarators, matches.map(match => match.get("declarator").text))
+
+        // Returning false stops the query
+        compare(document.queryEach(query, match => false), 1)
+
+        // The document queried is not released when the callback opens other documents over the memory budget
+        Settings.setValue("/project/memory_budget", 0.001)
+        let index = 0
+        let texts = []
+        compare(document.queryEach(query, match => {
+            Project.get("queryEach" + index++ + ".cpp")
+            texts.push(match.get("declarator").text)
+        }), matches.length)
+        compare(texts, declarators)
+        Settings.setValue("/project/memory_budget", 2048)
+
+        // Exceptions thrown by the callback stop the query, and are passed through
+        let error = ""
+        try {
+            document.queryEach(query, match => { throw new Error("failed") })
+        } catch (e) {
+            error = e.message
         }
-        else {
-            Message.warning("Ripgrep (rg) isn't available on the system")
+        compare(error, "failed")
+    }
+
+    function test_edit() {
+        Project.root = Dir.currentScriptPath + "/projects/mfc-dialog"
+
+        let document = Project.get("targetver.h")
+        const text = document.text
+
+        // The transaction is committed even if the callback throws, the exception is passed through
+        let error = ""
+        try {
+            document.edit(() => {
+                document.insertAtPosition("// First\n", 0)
+                document.insertAtPosition("// Second\n", 0)
+                throw new Error("failed")
+            })
+        } catch (e) {
+            error = e.message
         }
+        compare(error, "failed")
+        verify(document.text.startsWith("// Second\n// First\n"))
+
+        // Undone in one step
+        document.undo()
+        compare(document.text, text)
+    }
+
+    function test_findSymbol() {
+        Project.root = Dir.currentScriptPath + "/projects/mfc-dialog"
+
+        let results = Project.findSymbol("CTutorialApp::InitInstance")
+        verify(results.length >= 2)
+        verify(results.every(result => result.name === "CTutorialApp::InitInstance"))
+        verify(results.some(result => result.file === Project.root + "/Tutorial.cpp" && result.line === 38))
+        verify(results.some(result => result.file === Project.root + "/Tutorial.h" && result.line === 25))
+        compare(Project.findSymbol("InitInstance").length, results.length)
+
+        let classes = Project.findSymbol("CTutorialDlg").filter(result => result.kind === Symbol.Class)
+        compare(classes.length, 1)
+        compare(classes[0].file, Project.root + "/TutorialDlg.h")
+
+        compare(Project.findSymbol("Unknown").length, 0)
+    }
+
+    function test_memoryBudget() {
+        Project.root = Dir.currentScriptPath + "/projects/mfc-dialog"
+        // About 1KB, so documents not used recently are released each time a new document is opened
+        Settings.setValue("/project/memory_budget", 0.001)
+
+        let document = Project.get("Tutorial.cpp")
+        let symbolCount = document.symbols().length
+        let functionCount = document.query("(function_definition) @function").length
+        let usage = Project.memoryUsage().Cpp
+        verify(usage > 0)
+
+        Project.get("TutorialDlg.h")
+        verify(Project.memoryUsage().Cpp < usage)
+
+        // Released documents are still usable, the syntax tree is recreated on demand
+        compare(Project.get("Tutorial.cpp"), document)
+        compare(document.symbols().length, symbolCount)
+        compare(document.query("(function_definition) @function").length, functionCount)
+
+        // The text is released too, it's loaded again from the file through the document kept here
+        let text = document.text
+        Project.get("framework.h")
+        let released = Project.memoryUsage().Cpp
+        compare(document.text, text)
+        let used = Project.memoryUsage().Cpp
+        verify(used > released)
+
+        // Used again without Project.get, it's still released when opening another document
+        Project.get("resource.h")
+        verify(Project.memoryUsage().Cpp < released + (used - released) / 2)
+
+        Settings.setValue("/project/memory_budget", 2048)
     }
 }
@@ -17,6 +17,7 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QString>
+#include <QStringList>
 #include <QTest>
 #include <iostream>
 #include <memory>
@@ -105,6 +106,24 @@ inline bool compareDirectories(const QString &current, const QString &expected)
     return result;
 }
 
+// Creates the file `path` with `content`, and its parent directories if needed
+inline bool createFile(const QString &path, const QByteArray &content = {})
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(content) == content.size();
+}
+
+// Creates the empty `files`, relative to `root`
+inline bool createTree(const QString &root, const QStringList &files)
+{
+    for (const auto &file : files) {
+        if (!createFile(root + '/' + file))
+            return false;
+    }
+    return true;
+}
+
 /**
  * @brief The FileTester class to handle expected/original files
  * Create a temporary file based on an original one, and also compare to an expected one.
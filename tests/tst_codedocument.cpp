@@ -14,6 +14,7 @@
 #include "core/lsp_utils.h"
 #include "core/project.h"
 #include "core/querymatch.h"
+#include "core/textdocument_p.h"
 
 #include <QAction>
 #include <QPlainTextEdit>
@@ -326,6 +327,35 @@ private slots:
         }
     }
 
+    void incrementalEditorChanges()
+    {
+        CHECK_CLANGD_VERSION;
+
+        Test::FileTester file(Test::testDataPath() + "/tst_codedocument/notifyEditorChanges/section.cpp");
+        {
+            Core::KnutCore core;
+            auto project = Core::Project::instance();
+            project->setRoot(Test::testDataPath() + "/cpp-project");
+
+            auto cppFile = qobject_cast<Core::CodeDocument *>(Core::Project::instance()->get(file.fileName()));
+            QVERIFY(cppFile);
+
+            // Those changes are batched and sent together to the Language server before the next request.
+            cppFile->deleteRegion(cppFile->positionAt(9, 1), cppFile->positionAt(14, 1));
+            cppFile->gotoStartOfDocument();
+            cppFile->insert("// First line\n// Second line\n");
+            cppFile->gotoLine(5);
+            cppFile->insert("    ");
+
+            const auto symbol = cppFile->findSymbol("Section::bar");
+            QVERIFY(symbol);
+            QCOMPARE(symbol->range().start(), 311);
+
+            // If the Language server is out of sync, the hover would be at a different place.
+            QVERIFY(cppFile->hover(symbol->selectionRange().start() + 1).contains("bar"));
+        }
+    }
+
     void asyncHover()
     {
         CHECK_CLANGD;
@@ -419,6 +449,69 @@ private slots:
                       )EOF");
 
         QCOMPARE(matches.size(), 2);
+
+        // Range of a single node
+        const auto function = codedocument->queryFirst("(function_definition body: (_) @body) @function");
+        matches = codedocument->queryInRange(function.get("function"), "(function_definition) @function");
+        QCOMPARE(matches.size(), 1);
+        QCOMPARE(matches.first().get("function"), function.get("function"));
+        matches = codedocument->queryInRange(function.get("body"), "(return_statement) @return");
+        QCOMPARE(matches.size(), 1);
+        QVERIFY(function.get("body").contains(matches.first().get("return")));
+        QVERIFY(codedocument->queryInRange(function.get("body"), "(function_definition) @function").isEmpty());
+    }
+
+    void lazyQuery()
+    {
+        INIT_KNUT_PROJECT;
+
+        auto codedocument = qobject_cast<Core::CodeDocument *>(Core::Project::instance()->get("main.cpp"));
+        const auto queryString = "(function_definition declarator: (_) @declarator) @function";
+
+        const auto expected = kdalgorithms::transformed<QList<std::pair<int, QString>>>(
+            codedocument->query(queryString), [](const Core::QueryMatch &match) {
+                return std::make_pair(match.get("declarator").start(), match.get("declarator").text());
+            });
+        QVERIFY(expected.size() > 1);
+
+        // The captures are created lazily: either when accessed, or before the document is changed
+        auto matches = codedocument->query(queryString);
+        QCOMPARE(matches.size(), expected.size());
+        QCOMPARE(matches.first().captures().size(), 2);
+        QVERIFY(!matches.last().isEmpty());
+
+        const QString comment = "// Comment\n";
+        codedocument->gotoStartOfDocument();
+        codedocument->insert(comment);
+
+        for (int i = 0; i < matches.size(); ++i) {
+            const auto declarator = matches.at(i).get("declarator");
+            QVERIFY(declarator.isValid());
+            QCOMPARE(declarator.start(), expected.at(i).first + comment.size());
+            QCOMPARE(declarator.text(), expected.at(i).second);
+        }
+    }
+
+    void snapshot()
+    {
+        INIT_KNUT_PROJECT;
+
+        auto codedocument = qobject_cast<Core::CodeDocument *>(Core::Project::instance()->get("main.cpp"));
+        QVERIFY(codedocument);
+
+        // The snapshot shares the text kept for Tree-sitter, it's not counted twice
+        const auto memoryUsage = codedocument->memoryUsage();
+        auto snapshot = codedocument->snapshot();
+        QCOMPARE(snapshot->text(), codedocument->document()->toPlainText());
+        QCOMPARE(codedocument->memoryUsage(), memoryUsage);
+
+        // The previous snapshot is kept as it is after a change
+        const QString text = snapshot->text();
+        codedocument->gotoStartOfDocument();
+        codedocument->insert("// Comment\n");
+        QCOMPARE(snapshot->text(), text);
+        QCOMPARE(codedocument->snapshot()->text(), codedocument->document()->toPlainText());
+        QVERIFY(codedocument->text().startsWith("// Comment\n"));
     }
 
     void ast()
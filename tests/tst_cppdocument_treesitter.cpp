@@ -13,7 +13,10 @@
 #include "core/cppdocument.h"
 #include "core/knutcore.h"
 #include "core/project.h"
+#include "core/scriptdialogitem.h"
+#include "core/scriptrunner.h"
 
+#include <QApplication>
 #include <kdalgorithms.h>
 
 class TestCppDocumentTreeSitter : public QObject
@@ -121,6 +124,181 @@ private slots:
         }
     }
 
+    void incrementalParsing()
+    {
+        Test::FileTester file(Test::testDataPath() + "/tst_cppdocument/message_map/TutorialDlg.cpp");
+        Test::testCppDocument("tst_cppdocument/message_map", file.fileName(), [](auto *document) {
+            const auto functionQuery = "(function_definition declarator: (_) @declarator) @function";
+            auto toText = [](const Core::QueryMatch &match) {
+                return match.get("function").text();
+            };
+
+            // Make sure the tree exists, so the following edits are applied incrementally.
+            QVERIFY(!document->query(functionQuery).isEmpty());
+
+            document->gotoStartOfDocument();
+            document->insert("void foo() {}\n");
+            document->replace(document->positionAt(32, 2), document->positionAt(32, 11), "DDX_Radio");
+            document->deleteRegion(document->positionAt(33, 1), document->positionAt(35, 1));
+            document->gotoEndOfDocument();
+            document->insert("\nvoid bar() { foo(); }\n");
+            const auto incremental = kdalgorithms::transformed<QStringList>(document->query(functionQuery), toText);
+
+            // Setting the text forces a full parse of the document
+            document->setText(document->text());
+            const auto full = kdalgorithms::transformed<QStringList>(document->query(functionQuery), toText);
+
+            QCOMPARE(incremental, full);
+            QCOMPARE(incremental.first(), "void foo() {}");
+            QCOMPARE(incremental.last(), "void bar() { foo(); }");
+        });
+    }
+
+    void incrementalSymbols()
+    {
+        Test::FileTester file(Test::testDataPath() + "/tst_cppdocument/message_map/TutorialDlg.cpp");
+        Test::testCppDocument("tst_cppdocument/message_map", file.fileName(), [](auto *document) {
+            auto toStrings = [](const QList<Core::Symbol *> &symbols) {
+                auto strings = kdalgorithms::transformed<QStringList>(symbols, [](const Core::Symbol *symbol) {
+                    return QString("%1 %2 %3-%4")
+                        .arg(symbol->name())
+                        .arg(symbol->kind())
+                        .arg(symbol->range().start())
+                        .arg(symbol->range().end());
+                });
+                strings.sort();
+                return strings;
+            };
+
+            const auto *onPaint = document->findSymbol("CTutorialDlg::OnPaint");
+            QVERIFY(onPaint);
+
+            // Edits inside a function body and of a function name
+            document->replace(document->positionAt(32, 2), document->positionAt(32, 14), "DDX_Radio");
+            document->deleteRegion(document->positionAt(33, 1), document->positionAt(35, 1));
+            const int onInitDialog = document->text().indexOf("OnInitDialog()");
+            document->replace(onInitDialog, onInitDialog + 12, "OnInitDialogChanged");
+            auto incremental = document->symbols();
+
+            // Symbols outside of the changes are kept
+            QVERIFY(incremental.contains(onPaint));
+            QVERIFY(document->findSymbol("CTutorialDlg::OnInitDialogChanged"));
+            QVERIFY(!document->findSymbol("CTutorialDlg::OnInitDialog"));
+            const auto incrementalStrings = toStrings(incremental);
+
+            // Setting the text forces a full parse of the document
+            document->setText(document->text());
+            QCOMPARE(incrementalStrings, toStrings(document->symbols()));
+
+            // Edits changing the structure of the document
+            document->gotoStartOfDocument();
+            document->insert("void foo() {}\n");
+            document->gotoEndOfDocument();
+            document->insert("\nclass Bar {\n    int m_bar;\n};\n");
+            const auto editedStrings = toStrings(document->symbols());
+            QVERIFY(document->findSymbol("foo"));
+            QVERIFY(document->findSymbol("Bar::m_bar"));
+
+            document->setText(document->text());
+            QCOMPARE(editedStrings, toStrings(document->symbols()));
+        });
+    }
+
+    void incrementalParsing_benchmark_data()
+    {
+        QTest::addColumn<int>("copies");
+
+        QTest::newRow("140 lines") << 1;
+        QTest::newRow("21000 lines") << 150;
+    }
+
+    void incrementalParsing_benchmark()
+    {
+        QFETCH(int, copies);
+
+        Test::FileTester file(Test::testDataPath() + "/tst_cppdocument/message_map/TutorialDlg.cpp");
+        Test::testCppDocument("tst_cppdocument/message_map", file.fileName(), [copies](auto *document) {
+            document->setText(document->text().repeated(copies));
+            document->query("(function_definition) @function");
+
+            document->gotoLine(document->lineCount() / 2);
+            QBENCHMARK {
+                document->insert("\n");
+                document->query("(function_definition) @function");
+            }
+        });
+    }
+
+    void symbolContexts_benchmark()
+    {
+        Test::FileTester file(Test::testDataPath() + "/tst_cppdocument/message_map/TutorialDlg.cpp");
+        Test::testCppDocument("tst_cppdocument/message_map", file.fileName(), [](auto *document) {
+            // 10000 symbols: 2000 classes, each with a member, a method and a nested class with a member
+            QString text;
+            for (int i = 0; i < 2000; ++i)
+                text += QString("class Foo%1 {\n    int m_a;\n    void bar();\n"
+                                "    class Inner {\n        int m_b;\n    };\n};\n")
+                            .arg(i);
+            document->setText(text);
+            document->query("(class_specifier) @class");
+
+            QList<Core::Symbol *> symbols;
+            QBENCHMARK {
+                document->insert(" ");
+                symbols = document->symbols();
+            }
+            QCOMPARE(symbols.size(), 10000);
+            QVERIFY(document->findSymbol("Foo1999::Inner::m_b"));
+            QCOMPARE(document->findSymbol("Foo1999::bar")->kind(), Core::Symbol::Method);
+        });
+    }
+
+    void queryProgress_benchmark_data()
+    {
+        QTest::addColumn<bool>("progressDialog");
+
+        QTest::newRow("progress dialog closed") << false;
+        QTest::newRow("progress dialog open") << true;
+    }
+
+    // Throughput of a query discarding most of its matches: the progress is updated for each discarded match.
+    void queryProgress_benchmark()
+    {
+        QFETCH(bool, progressDialog);
+
+        Test::FileTester file(Test::testDataPath() + "/tst_cppdocument/message_map/TutorialDlg.cpp");
+        Test::testCppDocument("tst_cppdocument/message_map", file.fileName(), [progressDialog](auto *document) {
+            QString text;
+            for (int i = 0; i < 20000; ++i)
+                text += QString("void function%1() { }\n").arg(i);
+            document->setText(text);
+            const auto query =
+                R"((function_declarator declarator: (identifier) @name (#eq? @name "function19999")))";
+            QCOMPARE(document->query(query).size(), 1);
+
+            // The progress dialog is shown by a script dialog, as while running a script
+            Core::ScriptRunner runner;
+            Core::ScriptDialogItem *dialog = nullptr;
+            if (progressDialog) {
+                runner.runScript(Test::examplesPath() + "/ex_gui_progressbar.qml", {});
+                for (auto widget : QApplication::topLevelWidgets()) {
+                    if (auto scriptDialog = qobject_cast<Core::ScriptDialogItem *>(widget))
+                        dialog = scriptDialog;
+                }
+                QVERIFY(dialog);
+                dialog->firstStep("Query");
+            }
+
+            Core::QueryMatchList matches;
+            QBENCHMARK {
+                matches = document->query(query);
+            }
+            QCOMPARE(matches.size(), 1);
+            if (dialog)
+                dialog->reject();
+        });
+    }
+
 private:
     void messageMapForNonExistingClass(Core::CppDocument *cppdocument)
     {
@@ -0,0 +1,80 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "common/test_utils.h"
+#include "core/directorywalker.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+
+///////////////////////////////////////////////////////////////////////////////
+// Tests
+///////////////////////////////////////////////////////////////////////////////
+class TestDirectoryWalker : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void files()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(Test::createTree(dir.path(), {"main.cpp", "README", "src/a/b/c.cpp", "src/a/d.h", ".hidden/foo.cpp"}));
+
+        Core::DirectoryWalker walker(dir.path());
+        QCOMPARE(walker.files(), QStringList({"README", "main.cpp", "src/a/b/c.cpp", "src/a/d.h"}));
+
+        const auto directories = walker.walk("src");
+        QCOMPARE(directories.size(), 3);
+
+        Core::DirectoryWalker filtered(dir.path(), {.nameFilters = {"*.CPP"}});
+        QCOMPARE(filtered.files(), QStringList({"main.cpp", "src/a/b/c.cpp"}));
+
+        Core::DirectoryWalker flat(dir.path(), {.recursive = false});
+        QCOMPARE(flat.files(), QStringList({"README", "main.cpp"}));
+        const auto root = flat.list({});
+        QCOMPARE(root.directories, QStringList({"src"}));
+
+#ifdef Q_OS_UNIX
+        // Links to files are listed, links to directories are not followed
+        QVERIFY(QFile::link(dir.path() + "/src", dir.path() + "/link"));
+        QVERIFY(QFile::link(dir.path() + "/main.cpp", dir.path() + "/link.cpp"));
+        QCOMPARE(walker.files(), QStringList({"README", "link.cpp", "main.cpp", "src/a/b/c.cpp", "src/a/d.h"}));
+#endif
+    }
+
+    void ignoreRules()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(Test::createTree(dir.path(),
+                                 {"main.cpp", "main.o", "keep.o", "root.txt", "build/main.o", "3rdparty/lib.cpp",
+                                  "src/root.txt", "src/build/foo.cpp", "src/foo.tmp", "src/data/bar.tmp",
+                                  "src/data/bar.txt", "docs/api/index.html", "docs/index.html", "other/foo.tmp"}));
+        QVERIFY(Test::createFile(dir.path() + "/.gitignore",
+                                 "# Comment\nbuild/\n*.o\n!keep.o\n/root.txt\ndocs/**/*.html\n"));
+        QVERIFY(Test::createFile(dir.path() + "/src/.gitignore", "*.tmp\n"));
+
+        Core::DirectoryWalker walker(dir.path(), {.excludes = {"3rdparty/"}});
+        QCOMPARE(walker.files(),
+                 QStringList({"keep.o", "main.cpp", "other/foo.tmp", "src/data/bar.txt", "src/root.txt"}));
+
+        // Rules from the parent directories are used when listing a sub-directory
+        QCOMPARE(walker.list("src/data").files, QStringList({"bar.txt"}));
+        QCOMPARE(walker.list("src").directories, QStringList({"data"}));
+
+        Core::DirectoryWalker noGitIgnore(dir.path(), {.recursive = false, .useGitIgnore = false});
+        QCOMPARE(noGitIgnore.files(), QStringList({"keep.o", "main.cpp", "main.o", "root.txt"}));
+    }
+};
+
+QTEST_MAIN(TestDirectoryWalker)
+#include "tst_directorywalker.moc"
@@ -0,0 +1,162 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "common/test_utils.h"
+#include "core/fileindex.h"
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+
+///////////////////////////////////////////////////////////////////////////////
+// Tests
+///////////////////////////////////////////////////////////////////////////////
+class TestFileIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void files()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(Test::createTree(dir.path(),
+                                 {"main.cpp", "main.h", "README", "res/icon.PNG", "res/logo.png", "src/a/b/c.cpp",
+                                  "src/a/b/c.h", "src/Z.CPP", ".hidden/foo.cpp", ".gitignore"}));
+
+        Core::FileIndex index;
+        index.setRoot(dir.path());
+
+        QCOMPARE(index.files(),
+                 QStringList({"README", "main.cpp", "main.h", "res/icon.PNG", "res/logo.png", "src/Z.CPP",
+                              "src/a/b/c.cpp", "src/a/b/c.h"}));
+        QCOMPARE(index.filesWithExtension("cpp"), QStringList({"main.cpp", "src/a/b/c.cpp"}));
+        QCOMPARE(index.filesWithExtension("CPP"), QStringList({"src/Z.CPP"}));
+        QCOMPARE(index.filesWithExtension("rc"), QStringList());
+        QCOMPARE(index.filesWithExtensions({"cpp", "h"}),
+                 QStringList({"main.cpp", "main.h", "src/Z.CPP", "src/a/b/c.cpp", "src/a/b/c.h"}));
+        QCOMPARE(index.filesWithExtensions({"png", "PNG"}), QStringList({"res/icon.PNG", "res/logo.png"}));
+    }
+
+    void watch()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(Test::createTree(dir.path(), {"main.cpp", "src/foo.cpp", "src/foo.h"}));
+
+        Core::FileIndex index;
+        index.setRoot(dir.path());
+        QCOMPARE(index.files(), QStringList({"main.cpp", "src/foo.cpp", "src/foo.h"}));
+
+        // New file
+        QVERIFY(Test::createFile(dir.path() + "/src/bar.cpp"));
+        QTRY_COMPARE(index.filesWithExtension("cpp"), QStringList({"main.cpp", "src/bar.cpp", "src/foo.cpp"}));
+
+        // New directory
+        QVERIFY(Test::createTree(dir.path(), {"lib/a/a.cpp", "lib/b.h"}));
+        QTRY_COMPARE(index.files(),
+                     QStringList({"lib/a/a.cpp", "lib/b.h", "main.cpp", "src/bar.cpp", "src/foo.cpp", "src/foo.h"}));
+
+        // Removed file
+        QVERIFY(QFile::remove(dir.path() + "/main.cpp"));
+        QTRY_COMPARE(index.filesWithExtension("cpp"), QStringList({"lib/a/a.cpp", "src/bar.cpp", "src/foo.cpp"}));
+
+        // Removed directory
+        QVERIFY(QDir(dir.path() + "/src").removeRecursively());
+        QTRY_COMPARE(index.files(), QStringList({"lib/a/a.cpp", "lib/b.h"}));
+
+        // File added in a directory created after the initial scan
+        QVERIFY(Test::createFile(dir.path() + "/lib/a/a.h"));
+        QTRY_COMPARE(index.filesWithExtensions({"h"}), QStringList({"lib/a/a.h", "lib/b.h"}));
+    }
+
+    void updateFile()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(Test::createTree(dir.path(), {"main.cpp", "src/foo.cpp", "build/main.o"}));
+        QVERIFY(Test::createFile(dir.path() + "/.gitignore", "build/\n"));
+
+        Core::FileIndex index;
+        index.setRoot(dir.path());
+        QCOMPARE(index.files(), QStringList({"main.cpp", "src/foo.cpp"}));
+
+        // Files created synchronously are indexed right away, without waiting for the watcher
+        QVERIFY(Test::createFile(dir.path() + "/src/bar.cpp"));
+        index.updateFile(dir.path() + "/src/bar.cpp");
+        QCOMPARE(index.files(), QStringList({"main.cpp", "src/bar.cpp", "src/foo.cpp"}));
+
+        // Including in new directories
+        QVERIFY(Test::createFile(dir.path() + "/lib/a/a.h"));
+        index.updateFile(dir.path() + "/lib/a/a.h");
+        QCOMPARE(index.filesWithExtension("h"), QStringList({"lib/a/a.h"}));
+
+        // Ignored files and files outside of the root are not indexed
+        QVERIFY(Test::createFile(dir.path() + "/build/build.cpp"));
+        index.updateFile(dir.path() + "/build/build.cpp");
+        index.updateFile(QDir::tempPath() + "/outside.cpp");
+        QCOMPARE(index.filesWithExtension("cpp"), QStringList({"main.cpp", "src/bar.cpp", "src/foo.cpp"}));
+
+        // Removed files
+        QVERIFY(QFile::remove(dir.path() + "/main.cpp"));
+        index.updateFile(dir.path() + "/main.cpp");
+        QCOMPARE(index.filesWithExtension("cpp"), QStringList({"src/bar.cpp", "src/foo.cpp"}));
+    }
+
+    void benchmarkScan()
+    {
+        if (!qEnvironmentVariableIsSet("KNUT_BENCHMARK"))
+            QSKIP("Set KNUT_BENCHMARK to run the benchmark on a 100k-file tree");
+
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(createBenchmarkTree(dir.path()));
+
+        Core::FileIndex index;
+        QBENCHMARK_ONCE {
+            index.setRoot(dir.path());
+            QCOMPARE(index.files().size(), 100000);
+        }
+    }
+
+    void benchmarkFilesWithExtensions()
+    {
+        if (!qEnvironmentVariableIsSet("KNUT_BENCHMARK"))
+            QSKIP("Set KNUT_BENCHMARK to run the benchmark on a 100k-file tree");
+
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(createBenchmarkTree(dir.path()));
+
+        Core::FileIndex index;
+        index.setRoot(dir.path());
+        QBENCHMARK {
+            QCOMPARE(index.filesWithExtensions({"ui"}).size(), 20000);
+        }
+    }
+
+private:
+    static bool createBenchmarkTree(const QString &root)
+    {
+        const QStringList extensions = {"cpp", "h", "txt", "png", "ui"};
+        for (int i = 0; i < 1000; ++i) {
+            const auto directory = QString("%1/dir%2/sub%3").arg(root).arg(i / 10).arg(i % 10);
+            for (int j = 0; j < 100; ++j) {
+                if (!Test::createFile(QString("%1/file%2.%3").arg(directory).arg(j).arg(extensions[j % 5])))
+                    return false;
+            }
+        }
+        return true;
+    }
+};
+
+QTEST_MAIN(TestFileIndex)
+#include "tst_fileindex.moc"
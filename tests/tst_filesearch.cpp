@@ -0,0 +1,192 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "common/test_utils.h"
+#include "core/filesearch.h"
+
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+
+///////////////////////////////////////////////////////////////////////////////
+// Tests
+///////////////////////////////////////////////////////////////////////////////
+class TestFileSearch : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void search()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString first = dir.filePath("first.cpp");
+        const QString second = dir.filePath("second.cpp");
+        const QString binary = dir.filePath("binary.dat");
+        QVERIFY(Test::createFile(first, "int foo = 1;\r\n\tfoo(foo);\r\n"));
+        QVERIFY(Test::createFile(second, "// Some foo\nvoid bar()\n{\n}\n"));
+        QVERIFY(Test::createFile(binary, QByteArray("foo\0bar", 7)));
+
+        const auto matches = Core::searchInFiles({first, second, binary}, "foo");
+        QCOMPARE(matches.size(), 4);
+        QCOMPARE(matches[0].fileName, first);
+        QCOMPARE(matches[0].line, 1);
+        QCOMPARE(matches[0].column, 5);
+        QCOMPARE(matches[0].start, 4);
+        QCOMPARE(matches[0].end, 7);
+        QCOMPARE(matches[0].lineText, "int foo = 1;");
+        QCOMPARE(matches[1].line, 2);
+        QCOMPARE(matches[1].column, 2);
+        QCOMPARE(matches[2].line, 2);
+        QCOMPARE(matches[2].column, 6);
+        QCOMPARE(matches[2].lineText, "\tfoo(foo);");
+        QCOMPARE(matches[3].fileName, second);
+        QCOMPARE(matches[3].line, 1);
+        QCOMPARE(matches[3].column, 9);
+
+        // `.` matches new lines
+        const auto multiline = Core::searchInFiles({first, second}, "bar\\(\\).*\\}");
+        QCOMPARE(multiline.size(), 1);
+        QCOMPARE(multiline[0].line, 2);
+        QCOMPARE(multiline[0].column, 6);
+        QCOMPARE(multiline[0].end - multiline[0].start, 9);
+
+        // Overridden texts are used instead of the files
+        const auto changed = Core::searchInFiles({first, second}, "bar", {{first, "foo\nbar"}});
+        QCOMPARE(changed.size(), 2);
+        QCOMPARE(changed[0].fileName, first);
+        QCOMPARE(changed[0].line, 2);
+        QCOMPARE(changed[1].fileName, second);
+
+        QVERIFY(Core::searchInFiles({first, second}, "(foo").isEmpty());
+    }
+
+    void asynchronousSearch()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QStringList fileNames;
+        for (int i = 0; i < 100; ++i) {
+            fileNames.push_back(dir.filePath(QString("file%1.txt").arg(i)));
+            QVERIFY(Test::createFile(fileNames.back(), QByteArray("foo bar\n").repeated(i)));
+        }
+
+        Core::FileSearch search;
+        Core::FileSearchMatchList matches;
+        connect(&search, &Core::FileSearch::matchesFound, this, [&matches](const Core::FileSearchMatchList &found) {
+            matches.append(found);
+        });
+        QSignalSpy finishedSpy(&search, &Core::FileSearch::finished);
+
+        // The matches are reported in order, the same as a synchronous search
+        search.start(fileNames, "bar");
+        QVERIFY(search.isRunning());
+        QVERIFY(finishedSpy.wait());
+        QCOMPARE(finishedSpy.takeFirst().at(0).toBool(), false);
+        QVERIFY(!search.isRunning());
+        const auto expected = Core::searchInFiles(fileNames, "bar");
+        QCOMPARE(matches.size(), expected.size());
+        QCOMPARE(matches.size(), 4950);
+        for (int i = 0; i < matches.size(); ++i) {
+            QCOMPARE(matches[i].fileName, expected[i].fileName);
+            QCOMPARE(matches[i].start, expected[i].start);
+        }
+
+        // Nothing is reported after canceling
+        matches.clear();
+        search.start(fileNames, "bar");
+        search.cancel();
+        QCOMPARE(finishedSpy.size(), 1);
+        QCOMPARE(finishedSpy.takeFirst().at(0).toBool(), true);
+        QVERIFY(!search.isRunning());
+        QTest::qWait(100);
+        QVERIFY(matches.isEmpty());
+        QCOMPARE(finishedSpy.size(), 0);
+
+        // Invalid patterns finish right away
+        search.start(fileNames, "(bar");
+        QCOMPARE(finishedSpy.size(), 1);
+        QVERIFY(!search.isRunning());
+    }
+
+    void pauseSearch()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QStringList fileNames;
+        for (int i = 0; i < 1000; ++i) {
+            fileNames.push_back(dir.filePath(QString("file%1.txt").arg(i)));
+            QVERIFY(Test::createFile(fileNames.back(), QByteArray("foo bar\n").repeated(10)));
+        }
+
+        Core::FileSearch search;
+        Core::FileSearchMatchList matches;
+        connect(&search, &Core::FileSearch::matchesFound, this, [&](const Core::FileSearchMatchList &found) {
+            matches.append(found);
+        });
+        QSignalSpy finishedSpy(&search, &Core::FileSearch::finished);
+
+        // Only the files being searched are finished once paused
+        search.start(fileNames, "bar");
+        search.pause();
+        QTest::qWait(200);
+        QVERIFY(search.isPaused());
+        QVERIFY(search.isRunning());
+        QVERIFY(matches.size() < 10000);
+        QCOMPARE(finishedSpy.size(), 0);
+
+        // Resuming reports the rest, in order
+        search.resume();
+        QVERIFY(!search.isPaused());
+        QVERIFY(finishedSpy.wait());
+        QCOMPARE(matches.size(), 10000);
+        const auto expected = Core::searchInFiles(fileNames, "bar");
+        for (int i = 0; i < matches.size(); ++i) {
+            QCOMPARE(matches[i].fileName, expected[i].fileName);
+            QCOMPARE(matches[i].start, expected[i].start);
+        }
+
+    }
+
+    void literalPrefilter_data()
+    {
+        QTest::addColumn<QString>("pattern");
+        QTest::addColumn<int>("count");
+
+        QTest::newRow("literal") << "hello world" << 1;
+        QTest::newRow("alternation") << "missing|hello" << 1;
+        QTest::newRow("group-alternation") << "(missing|hello) world" << 1;
+        QTest::newRow("optional") << "colou?r" << 2;
+        QTest::newRow("star") << "hel*o" << 1;
+        QTest::newRow("plus") << "hel+o" << 1;
+        QTest::newRow("repeat") << "hel{2}o" << 1;
+        QTest::newRow("escaped") << "world\\." << 1;
+        QTest::newRow("class") << "[xyh]ello" << 1;
+        QTest::newRow("hexadecimal") << "\\x68ello" << 1;
+        QTest::newRow("case-insensitive") << "(?i)HELLO" << 1;
+        QTest::newRow("no-match") << "hello there" << 0;
+    }
+
+    void literalPrefilter()
+    {
+        QFETCH(QString, pattern);
+        QFETCH(int, count);
+
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString fileName = dir.filePath("file.txt");
+        QVERIFY(Test::createFile(fileName, "hello world.\ncolor colour\n"));
+
+        QCOMPARE(Core::searchInFiles({fileName}, pattern).size(), count);
+    }
+};
+
+QTEST_MAIN(TestFileSearch)
+#include "tst_filesearch.moc"
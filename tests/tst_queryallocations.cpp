@@ -0,0 +1,178 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "core/cppdocument.h"
+#include "core/knutcore.h"
+#include "treesitter/languages.h"
+#include "treesitter/parser.h"
+#include "treesitter/predicates.h"
+#include "treesitter/query.h"
+#include "treesitter/tree.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+#include <atomic>
+#include <cstdlib>
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocation counting
+///////////////////////////////////////////////////////////////////////////////
+static std::atomic<qint64> allocationCount = 0;
+static std::atomic<qint64> allocatedBytes = 0;
+
+// The sanitizers replace malloc themselves, the test is skipped with them
+#if defined(__SANITIZE_ADDRESS__)
+#define KNUT_SANITIZER
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer) || __has_feature(thread_sanitizer)
+#define KNUT_SANITIZER
+#endif
+#endif
+
+#if defined(__GLIBC__) && !defined(KNUT_SANITIZER)
+#define KNUT_COUNT_ALLOCATIONS
+// malloc is used by both operator new and the Qt containers, replacing it counts all the allocations of the process.
+// Growing containers (QString::append, for example) go through realloc, so it's counted as a new allocation.
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static void countAllocation(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(static_cast<qint64>(size), std::memory_order_relaxed);
+}
+
+extern "C" void *malloc(size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) noexcept
+{
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+struct Allocations
+{
+    qint64 count = 0;
+    qint64 bytes = 0;
+};
+
+template <typename Function>
+static Allocations countAllocations(Function function)
+{
+    const qint64 count = allocationCount.load();
+    const qint64 bytes = allocatedBytes.load();
+    function();
+    return {.count = allocationCount.load() - count, .bytes = allocatedBytes.load() - bytes};
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Tests Data
+///////////////////////////////////////////////////////////////////////////////
+static QString generatedSource()
+{
+    QString source;
+    for (int i = 0; i < 2000; ++i)
+        source += QString("void function%1()\n{\n    int value = %1;\n}\n\n").arg(i);
+    return source;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Tests
+///////////////////////////////////////////////////////////////////////////////
+class TestQueryAllocations : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase()
+    {
+        Q_INIT_RESOURCE(core);
+#ifndef KNUT_COUNT_ALLOCATIONS
+        QSKIP("Allocations are only counted with glibc, without sanitizers");
+#endif
+    }
+
+    void predicates_benchmark_data()
+    {
+        QTest::addColumn<QString>("predicate");
+
+        QTest::newRow("eq") << R"((#eq? @name "function1999"))";
+        QTest::newRow("like") << R"((#like? @name "function 1999"))";
+        QTest::newRow("match") << R"((#match? "^function1999$" @name))";
+    }
+
+    // Allocations done by the predicates, while running a query on 2000 functions.
+    void predicates_benchmark()
+    {
+        QFETCH(QString, predicate);
+
+        const auto source = generatedSource();
+        treesitter::Parser parser(tree_sitter_cpp());
+        auto tree = parser.parseString(source);
+        QVERIFY(tree.has_value());
+        auto query = std::make_shared<treesitter::Query>(
+            tree_sitter_cpp(),
+            QString("(function_declarator declarator: (identifier) @name %1)").arg(predicate));
+
+        QList<treesitter::QueryMatch> matches;
+        const auto allocations = countAllocations([&]() {
+            treesitter::QueryCursor cursor;
+            cursor.execute(query, tree->rootNode(), std::make_unique<treesitter::Predicates>(source));
+            matches = cursor.allRemainingMatches();
+        });
+
+        QCOMPARE(matches.size(), 1);
+        QTest::setBenchmarkResult(allocations.count, QTest::Events);
+    }
+
+    // Bytes allocated by a document query: the text of the document is shared with the predicates, not copied.
+    void documentQuery_benchmark()
+    {
+        Core::KnutCore core;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const auto source = generatedSource();
+        QFile file(dir.filePath("functions.cpp"));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(source.toUtf8());
+        file.close();
+
+        Core::CppDocument document;
+        document.load(file.fileName());
+        const auto queryString = R"((function_declarator declarator: (identifier) @name (#eq? @name "function1999")))";
+        // The first query parses the document
+        QCOMPARE(document.query(queryString).size(), 1);
+
+        Core::QueryMatchList matches;
+        const auto allocations = countAllocations([&]() {
+            matches = document.query(queryString);
+        });
+
+        QCOMPARE(matches.size(), 1);
+        QVERIFY(allocations.bytes < source.size() * static_cast<qint64>(sizeof(QChar)));
+        QTest::setBenchmarkResult(allocations.bytes, QTest::BytesAllocated);
+    }
+};
+
+QTEST_MAIN(TestQueryAllocations)
+#include "tst_queryallocations.moc"
@@ -0,0 +1,186 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "common/test_utils.h"
+#include "core/cppdocument.h"
+#include "core/knutcore.h"
+#include "core/symbolindex.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+#include <algorithm>
+
+///////////////////////////////////////////////////////////////////////////////
+// Tests Data
+///////////////////////////////////////////////////////////////////////////////
+static const char header[] = R"(
+class Foo
+{
+public:
+    Foo();
+    int bar(int value);
+    enum Color { Red, Green };
+
+private:
+    int m_value = 0;
+};
+
+void freeFunction();
+)";
+
+static const char source[] = R"(
+#include "foo.h"
+
+Foo::Foo() { }
+
+int Foo::bar(int value)
+{
+    return value;
+}
+)";
+
+///////////////////////////////////////////////////////////////////////////////
+// Tests
+///////////////////////////////////////////////////////////////////////////////
+class TestSymbolIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase() { Q_INIT_RESOURCE(core); }
+
+    void sameAsDocument()
+    {
+        Core::KnutCore core;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(Test::createFile(dir.filePath("foo.h"), header));
+        QVERIFY(Test::createFile(dir.filePath("foo.cpp"), source));
+
+        Core::SymbolIndex index(dir.path(), dir.filePath("index/symbols.idx"));
+        QCOMPARE(index.update({"foo.cpp", "foo.h"}), 2);
+        QVERIFY(QFile::exists(index.indexFileName()));
+
+        // The index has the same symbols as the documents
+        int symbolCount = 0;
+        for (const auto &fileName : {dir.filePath("foo.cpp"), dir.filePath("foo.h")}) {
+            Core::CppDocument document;
+            document.load(fileName);
+            const auto symbols = document.symbols();
+            symbolCount += symbols.size();
+            for (const auto *symbol : symbols) {
+                const auto locations = index.find(symbol->name());
+                QVERIFY2(std::ranges::any_of(locations,
+                                             [&](const Core::SymbolLocation &location) {
+                                                 return location.fileName == fileName && location.name == symbol->name()
+                                                     && location.kind == symbol->kind()
+                                                     && location.start == symbol->range().start()
+                                                     && location.end == symbol->range().end()
+                                                     && location.selectionStart == symbol->selectionRange().start();
+                                             }),
+                         qPrintable(symbol->name()));
+            }
+        }
+        QCOMPARE(index.symbolCount(), symbolCount);
+    }
+
+    void find()
+    {
+        Core::KnutCore core;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(Test::createFile(dir.filePath("foo.h"), header));
+        QVERIFY(Test::createFile(dir.filePath("foo.cpp"), source));
+
+        Core::SymbolIndex index(dir.path(), dir.filePath("symbols.idx"));
+        index.update({"foo.cpp", "foo.h"});
+
+        const auto classes = index.find("Foo");
+        QVERIFY(std::ranges::any_of(classes, [&](const Core::SymbolLocation &location) {
+            return location.kind == Core::Symbol::Class && location.fileName == dir.filePath("foo.h")
+                && location.line == 2 && location.column == 7;
+        }));
+
+        // Partially qualified names match the end of the qualified name
+        const auto methods = index.find("bar");
+        QVERIFY(!methods.isEmpty());
+        QVERIFY(std::ranges::all_of(methods, [](const Core::SymbolLocation &location) {
+            return location.name == "Foo::bar" && location.kind == Core::Symbol::Method;
+        }));
+        QCOMPARE(index.find("Foo::bar").size(), methods.size());
+        QVERIFY(std::ranges::any_of(methods, [&](const Core::SymbolLocation &location) {
+            return location.fileName == dir.filePath("foo.cpp") && location.line == 6;
+        }));
+        QVERIFY(index.find("oo::bar").isEmpty());
+
+        QVERIFY(!index.find("Color::Red").isEmpty());
+        QVERIFY(index.find("Foo::Red").isEmpty());
+        QVERIFY(index.find("m_value").size() == 1);
+        QVERIFY(index.find("unknown").isEmpty());
+    }
+
+    void incrementalUpdate()
+    {
+        Core::KnutCore core;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(Test::createFile(dir.filePath("foo.h"), header));
+        QVERIFY(Test::createFile(dir.filePath("foo.cpp"), source));
+        const QString indexFileName = dir.filePath("symbols.idx");
+
+        int symbolCount = 0;
+        {
+            Core::SymbolIndex index(dir.path(), indexFileName);
+            QCOMPARE(index.update({"foo.cpp", "foo.h"}), 2);
+            QCOMPARE(index.update({"foo.cpp", "foo.h"}), 0);
+            symbolCount = index.symbolCount();
+        }
+
+        // The index is loaded from the disk, nothing changed
+        Core::SymbolIndex index(dir.path(), indexFileName);
+        QCOMPARE(index.symbolCount(), symbolCount);
+        QVERIFY(!index.find("freeFunction").isEmpty());
+        QCOMPARE(index.update({"foo.cpp", "foo.h"}), 0);
+
+        // Only changed files are parsed again
+        QVERIFY(Test::createFile(dir.filePath("foo.cpp"), QByteArray(source) + "void added() { }\n"));
+        QCOMPARE(index.update({"foo.cpp", "foo.h"}), 1);
+        QCOMPARE(index.find("added").size(), 1);
+        QVERIFY(!index.find("freeFunction").isEmpty());
+
+        // Removed files are removed from the index
+        QCOMPARE(index.update({"foo.h"}), 0);
+        QVERIFY(index.find("added").isEmpty());
+        QVERIFY(!index.find("freeFunction").isEmpty());
+
+        // Only the files given are checked, the others are kept as they are
+        QVERIFY(Test::createFile(dir.filePath("foo.h"), QByteArray(header) + "void changedOutside();\n"));
+        QVERIFY(Test::createFile(dir.filePath("bar.h"), "void barFunction();\n"));
+        QCOMPARE(index.updateFiles({"bar.h"}), 1);
+        QCOMPARE(index.find("barFunction").size(), 1);
+        QVERIFY(index.find("changedOutside").isEmpty());
+        QVERIFY(!index.find("freeFunction").isEmpty());
+        QCOMPARE(index.updateFiles({"bar.h"}), 0);
+        QVERIFY(QFile::remove(dir.filePath("bar.h")));
+        QCOMPARE(index.updateFiles({"bar.h"}), 0);
+        QVERIFY(index.find("barFunction").isEmpty());
+        QVERIFY(!index.find("freeFunction").isEmpty());
+
+        // Invalid index files are rebuilt
+        QVERIFY(Test::createFile(dir.filePath("invalid.idx"), "invalid"));
+        Core::SymbolIndex invalid(dir.path(), dir.filePath("invalid.idx"));
+        QCOMPARE(invalid.symbolCount(), 0);
+        QCOMPARE(invalid.update({"foo.h"}), 1);
+    }
+};
+
+QTEST_MAIN(TestSymbolIndex)
+#include "tst_symbolindex.moc"
@@ -13,12 +13,18 @@
 #include "core/mark.h"
 #include "core/rangemark.h"
 #include "core/textdocument.h"
+#include "core/textdocument_p.h"
 #include "core/utils.h"
 
+#include <QApplication>
 #include <QDir>
 #include <QFile>
+#include <QPlainTextEdit>
+#include <QSignalSpy>
 #include <QTest>
+#include <QTextBlock>
 #include <QTextStream>
+#include <stdexcept>
 
 static const char *LoremIpsumText = R"(
 Lorem ipsum dolor sit amet, consectetur adipiscing elit.
@@ -347,6 +353,230 @@ private slots:
         QVERIFY(mark == 10);
     }
 
+    void markRegistry()
+    {
+        Core::TextDocument document;
+        document.load(Test::testDataPath() + "/tst_textdocument/loremipsum_lf_utf8.txt");
+
+        // Compare the marks with a plain list of positions, updated with Mark::updateMark
+        std::vector<std::pair<Core::Mark, int>> marks;
+        std::vector<std::pair<Core::RangeMark, std::pair<int, int>>> rangeMarks;
+        for (int pos = 0; pos < document.text().size(); pos += 3) {
+            marks.push_back({document.createMark(pos), pos});
+            rangeMarks.push_back({document.createRangeMark(pos, pos + 10), {pos, pos + 10}});
+        }
+
+        QObject::connect(document.textEdit()->document(), &QTextDocument::contentsChange, &document,
+                         [&](int from, int charsRemoved, int charsAdded) {
+                             for (auto &[mark, pos] : marks)
+                                 Core::Mark::updateMark(pos, from, charsRemoved, charsAdded);
+                             for (auto &[mark, range] : rangeMarks) {
+                                 Core::Mark::updateMark(range.first, from, charsRemoved, charsAdded);
+                                 Core::Mark::updateMark(range.second, from, charsRemoved, charsAdded);
+                             }
+                         });
+        auto edit = [&](int from, int charsRemoved, const QString &text) {
+            document.replace(from, from + charsRemoved, text);
+        };
+        auto compareMarks = [&]() {
+            for (const auto &[mark, pos] : marks)
+                QCOMPARE(mark.position(), pos);
+            for (const auto &[mark, range] : rangeMarks) {
+                QCOMPARE(mark.start(), range.first);
+                QCOMPARE(mark.end(), range.second);
+            }
+        };
+
+        // Typing at the same place
+        for (int i = 0; i < 10; ++i)
+            edit(100 + i, 0, "a");
+        compareMarks();
+
+        // Edits going back and forth in the document
+        edit(500, 20, "");
+        edit(30, 0, "Hello World!");
+        edit(700, 3, "foo");
+        edit(5, 40, "bar");
+        compareMarks();
+
+        // Removing marks, and adding new ones, in the middle of pending changes
+        marks.erase(marks.begin() + 10, marks.begin() + 60);
+        rangeMarks.erase(rangeMarks.begin(), rangeMarks.begin() + 200);
+        edit(200, 0, "\n\n");
+        marks.push_back({document.createMark(150), 150});
+        marks.push_back({document.createMark(600), 600});
+        edit(400, 15, "");
+        edit(120, 1, "b");
+        compareMarks();
+
+        // Adding and removing marks before they are merged, in any order and at the same positions
+        for (int pos : {300, 40, 300, 800, 40, 0})
+            marks.push_back({document.createMark(pos), pos});
+        marks.erase(marks.end() - 5);
+        marks.erase(marks.end() - 1);
+        compareMarks();
+        edit(40, 0, "x");
+        edit(300, 2, "");
+        compareMarks();
+
+        // Marks keep their last position once the document is deleted
+        Core::Mark mark;
+        {
+            Core::TextDocument other;
+            other.setText("Lorem ipsum");
+            mark = other.createMark(5);
+            other.insertAtPosition("Hello ", 0);
+        }
+        QVERIFY(!mark.isValid());
+        QCOMPARE(mark.position(), 11);
+    }
+
+    void editTransaction()
+    {
+        Core::TextDocument document;
+        document.load(Test::testDataPath() + "/tst_textdocument/loremipsum_lf_utf8.txt");
+        const QString originalText = document.text();
+
+        auto mark = document.createMark(document.positionAt(5, 1));
+        const int markPosition = mark.position();
+        QSignalSpy spy(document.document(), &QTextDocument::contentsChange);
+
+        document.beginEdit();
+        document.insertAtPosition("A", 1);
+        document.insertAtPosition("B", 10);
+        document.beginEdit();
+        document.deleteRegion(20, 25);
+        document.commitEdit();
+        // Nothing is notified until the outermost transaction is committed
+        QCOMPARE(spy.count(), 0);
+        QCOMPARE(mark.position(), markPosition);
+        document.commitEdit();
+
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(mark.position(), markPosition - 3);
+        QCOMPARE(document.text().mid(1, 10), "ALorem ipB");
+
+        // The transaction is undone in one step
+        document.undo();
+        QCOMPARE(document.text(), originalText);
+    }
+
+    void editTransactionGuard()
+    {
+        Core::TextDocument document;
+        document.load(Test::testDataPath() + "/tst_textdocument/loremipsum_lf_utf8.txt");
+        QSignalSpy spy(document.document(), &QTextDocument::contentsChange);
+
+        // The transaction is committed when leaving the scope, even with an exception
+        try {
+            Core::EditTransaction transaction(&document);
+            document.insertAtPosition("A", 1);
+            throw std::runtime_error("failed");
+        } catch (const std::runtime_error &) {
+        }
+        QCOMPARE(spy.count(), 1);
+        QVERIFY(!document.closeEditTransactions());
+
+        // Transactions left open by a script are committed when it ends
+        document.beginEdit();
+        document.beginEdit();
+        document.insertAtPosition("B", 1);
+        QCOMPARE(spy.count(), 1);
+        QVERIFY(document.closeEditTransactions());
+        QCOMPARE(spy.count(), 2);
+        QVERIFY(!document.closeEditTransactions());
+        QCOMPARE(document.text().mid(1, 2), "BA");
+    }
+
+    void textSnapshot()
+    {
+        Core::TextDocument document;
+        document.load(Test::testDataPath() + "/tst_textdocument/loremipsum_lf_utf8.txt");
+        auto qtextDocument = document.document();
+
+        // Lines and columns are the same as the ones computed from the QTextDocument blocks
+        const int characterCount = qtextDocument->characterCount();
+        for (int pos = 0; pos < characterCount; ++pos) {
+            const QTextBlock block = qtextDocument->findBlock(pos);
+            QCOMPARE(document.lineAtPosition(pos), block.blockNumber() + 1);
+            QCOMPARE(document.columnAtPosition(pos), pos - block.position() + 1);
+            QCOMPARE(document.positionAt(block.blockNumber() + 1, pos - block.position() + 1), pos);
+        }
+        QCOMPARE(document.lineAtPosition(characterCount), -1);
+        QCOMPARE(document.lineAtPosition(-1), -1);
+        QCOMPARE(document.positionAt(qtextDocument->blockCount() + 1, 1), -1);
+
+        // The snapshot is shared until the document is modified
+        auto snapshot = document.snapshot();
+        QCOMPARE(document.snapshot(), snapshot);
+        QCOMPARE(snapshot->text(), qtextDocument->toPlainText());
+        document.insertAtPosition("Hello\n", 1);
+        QVERIFY(document.snapshot() != snapshot);
+        QVERIFY(document.snapshot()->revision() > snapshot->revision());
+        QCOMPARE(document.lineAtPosition(7), 3);
+        QVERIFY(!snapshot->text().startsWith("\nHello"));
+        QVERIFY(document.text().startsWith("\nHello\n"));
+
+        // Inside a transaction, the text is always up-to-date
+        document.beginEdit();
+        document.insertAtPosition("World\n", 1);
+        QVERIFY(document.text().startsWith("\nWorld\nHello\n"));
+        QCOMPARE(document.lineAtPosition(7), 3);
+        document.commitEdit();
+        QVERIFY(document.text().startsWith("\nWorld\nHello\n"));
+        QCOMPARE(document.lineAtPosition(13), 4);
+
+        // Line separators (U+2028) don't start a new line, like in the blocks of the QTextDocument
+        Core::TextDocument separators;
+        separators.setText(QString("first%1still first\nsecond").arg(QChar(QChar::LineSeparator)));
+        QCOMPARE(separators.lineAtPosition(10), 1);
+        QCOMPARE(separators.columnAtPosition(10), 11);
+        QCOMPARE(separators.lineAtPosition(18), 2);
+        QCOMPARE(separators.positionAt(2, 1), 18);
+    }
+
+    void headless()
+    {
+        const auto widgetCount = QApplication::allWidgets().size();
+
+        Core::TextDocument document;
+        document.load(Test::testDataPath() + "/tst_textdocument/loremipsum_lf_utf8.txt");
+        const QString originalLine = "Quisque convallis ipsum ac odio aliquet tincidunt.";
+
+        QSignalSpy positionSpy(&document, &Core::TextDocument::positionChanged);
+        document.gotoLine(3, 5);
+        QCOMPARE(positionSpy.count(), 1);
+        QCOMPARE(document.line(), 3);
+        QCOMPARE(document.column(), 5);
+
+        document.selectNextWord();
+        QCOMPARE(document.selectedText(), "que ");
+        document.insert("X");
+        QCOMPARE(document.currentLine(), "QuisXconvallis ipsum ac odio aliquet tincidunt.");
+        document.undo();
+        QCOMPARE(document.currentLine(), originalLine);
+
+        QVERIFY(document.find("ipsum"));
+        QCOMPARE(document.line(), 3);
+        QCOMPARE(document.selectedText(), "ipsum");
+        document.indent();
+        QCOMPARE(document.currentLine(), "    " + originalLine);
+        document.undo();
+
+        // Nothing above needs an editor widget
+        QCOMPARE(QApplication::allWidgets().size(), widgetCount);
+
+        // The editor, once created, shares the text and the cursor of the document
+        const int position = document.position();
+        auto textEdit = document.textEdit();
+        QCOMPARE(textEdit->document(), document.document());
+        QCOMPARE(textEdit->textCursor().position(), position);
+        textEdit->moveCursor(QTextCursor::Start);
+        QCOMPARE(document.position(), 0);
+        document.gotoLine(2);
+        QCOMPARE(textEdit->textCursor().blockNumber(), 1);
+    }
+
     void indent()
     {
         auto spaces = [](int count) {
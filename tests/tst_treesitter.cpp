@@ -15,7 +15,9 @@
 #include "treesitter/query.h"
 #include "treesitter/tree.h"
 
+#include <QJsonArray>
 #include <QTest>
+#include <thread>
 
 class TestTreeSitter : public QObject
 {
@@ -74,6 +76,41 @@ private slots:
         VERIFY_PREDICATE_ERROR("(#non_existing_predicate?)");
     }
 
+    void queryCache()
+    {
+        auto &cache = treesitter::QueryCache::instance();
+        cache.clear();
+
+        const QString queryText = "(function_definition) @function";
+        auto query = cache.get(tree_sitter_cpp(), queryText);
+        QVERIFY(query);
+        QCOMPARE(cache.misses(), 1);
+        QCOMPARE(cache.hits(), 0);
+
+        // Same language and text, the compiled query is shared
+        QCOMPARE(cache.get(tree_sitter_cpp(), queryText), query);
+        QCOMPARE(cache.hits(), 1);
+
+        // Different language or text, the query is compiled again
+        QVERIFY(cache.get(tree_sitter_rust(), "(function_item) @function") != query);
+        QVERIFY(cache.get(tree_sitter_cpp(), "(function_definition) @definition") != query);
+        QCOMPARE(cache.misses(), 3);
+        QCOMPARE(cache.size(), 3);
+
+        // Ill-formed queries throw and are not cached
+        QVERIFY_THROWS_EXCEPTION(treesitter::Query::Error, cache.get(tree_sitter_cpp(), "(field_expr)"));
+        QCOMPARE(cache.size(), 3);
+
+        // Least recently used queries are evicted first
+        const auto capacity = cache.capacity();
+        cache.get(tree_sitter_cpp(), queryText);
+        cache.setCapacity(1);
+        QCOMPARE(cache.size(), 1);
+        QCOMPARE(cache.get(tree_sitter_cpp(), queryText), query);
+        cache.setCapacity(capacity);
+        cache.clear();
+    }
+
     void simpleQuery()
     {
         auto source = readTestFile("/tst_treesitter/main.cpp");
@@ -178,6 +215,102 @@ private slots:
         QCOMPARE(matches[6].captures().size(), 2);
     }
 
+    void interruptQuery()
+    {
+        auto source = readTestFile("/tst_treesitter/main.cpp");
+
+        treesitter::Parser parser(tree_sitter_cpp());
+        auto tree = parser.parseString(source);
+        QVERIFY(tree.has_value());
+
+        auto query = std::make_shared<treesitter::Query>(tree_sitter_cpp(), "(parameter_declaration) @param");
+
+        // Cancelled while running: no new match is returned
+        treesitter::CancellationToken token;
+        treesitter::QueryCursor cursor;
+        cursor.setCancellationToken(token);
+        cursor.execute(query, tree->rootNode(), nullptr /*disable predicates*/);
+        QVERIFY(cursor.nextMatch().has_value());
+        QVERIFY(!cursor.isCancelled());
+        token.cancel();
+        QVERIFY(!cursor.nextMatch().has_value());
+        QVERIFY(cursor.isCancelled());
+        QVERIFY(!cursor.isTimedOut());
+
+        treesitter::QueryCursor timedOutCursor;
+        timedOutCursor.setTimeout(1);
+        timedOutCursor.execute(query, tree->rootNode(), nullptr /*disable predicates*/);
+        QTest::qSleep(10);
+        QVERIFY(!timedOutCursor.nextMatch().has_value());
+        QVERIFY(timedOutCursor.isTimedOut());
+        QVERIFY(!timedOutCursor.isCancelled());
+
+        // Any pair of children of any node: a lot of matches are in progress at the same time
+        auto permutations = std::make_shared<treesitter::Query>(tree_sitter_cpp(), "(_ (_) @first (_) @second)");
+        treesitter::QueryCursor limitedCursor;
+        limitedCursor.setMatchLimit(1);
+        QCOMPARE(limitedCursor.matchLimit(), 1u);
+        limitedCursor.execute(permutations, tree->rootNode(), nullptr /*disable predicates*/);
+        limitedCursor.allRemainingMatches();
+        QVERIFY(limitedCursor.didExceedMatchLimit());
+    }
+
+    void profileQuery()
+    {
+        auto source = readTestFile("/tst_treesitter/main.cpp");
+
+        treesitter::Parser parser(tree_sitter_cpp());
+        auto tree = parser.parseString(source);
+        QVERIFY(tree.has_value());
+
+        auto query = std::make_shared<treesitter::Query>(tree_sitter_cpp(), R"EOF(
+        (function_definition
+            declarator: (function_declarator
+                declarator: (identifier) @name)
+            (#eq? @name "main"))
+        (parameter_declaration) @param
+        )EOF");
+
+        std::optional<treesitter::QueryProfile> profile;
+        int matchCount = 0;
+        {
+            treesitter::QueryCursor cursor;
+            cursor.setProfiling([&profile](const treesitter::QueryProfile &result) {
+                profile = result;
+            });
+            cursor.execute(query, tree->rootNode(), std::make_unique<treesitter::Predicates>(source));
+            matchCount = cursor.allRemainingMatches().size();
+            // Reported once the cursor is destroyed
+            QVERIFY(!profile.has_value());
+        }
+        QVERIFY(profile.has_value());
+        QCOMPARE(profile->patterns.size(), 2);
+
+        // main, myFreeFunction, myOtherFreeFunction and freeFunction are evaluated, only main is kept
+        const auto &functions = profile->patterns.at(0);
+        QCOMPARE(functions.matchCount, 4);
+        QCOMPARE(functions.rejectedCount, 3);
+        QCOMPARE(functions.predicates.size(), 1);
+        QCOMPARE(functions.predicates.at(0).name, "eq?");
+        QCOMPARE(functions.predicates.at(0).evaluationCount, 4);
+        QCOMPARE(functions.predicates.at(0).rejectedCount, 3);
+
+        const auto &parameters = profile->patterns.at(1);
+        QVERIFY(parameters.matchCount > 0);
+        QCOMPARE(parameters.rejectedCount, 0);
+        QVERIFY(parameters.predicates.isEmpty());
+
+        QCOMPARE(profile->matchCount() - profile->rejectedCount(), matchCount);
+        QVERIFY(profile->time >= profile->predicateTime());
+
+        const auto json = profile->toJson();
+        QVERIFY(json.contains("time"));
+        const auto jsonPatterns = json["patterns"].toArray();
+        QCOMPARE(jsonPatterns.size(), 2);
+        QCOMPARE(jsonPatterns.at(0)["rejected"].toInt(), 3);
+        QCOMPARE(jsonPatterns.at(0)["predicates"].toArray().at(0)["evaluations"].toInt(), 4);
+    }
+
     void eq_predicate_errors()
     {
         using Error = treesitter::Query::Error;
@@ -264,6 +397,19 @@ private slots:
         QCOMPARE(secondCaptures.first().node.textIn(source), "myOtherFreeFunction");
 
         QVERIFY(!cursor.nextMatch().has_value());
+
+        // The regular expression is compiled once per thread, by the query
+        const auto query = firstMatch->query();
+        const auto &regularExpressions = query->regularExpressions();
+        QCOMPARE(regularExpressions.size(), 1);
+        QVERIFY(regularExpressions.value("my(Other)?FreeFunction").isValid());
+        QCOMPARE(&query->regularExpressions(), &regularExpressions);
+        const QHash<QString, QRegularExpression> *otherThreadExpressions = nullptr;
+        std::thread([&]() {
+            otherThreadExpressions = &query->regularExpressions();
+        }).join();
+        QVERIFY(otherThreadExpressions != &regularExpressions);
+        QCOMPARE(otherThreadExpressions->keys(), regularExpressions.keys());
     }
 
     void in_message_map_predicate_errors()